@@ -21,6 +21,10 @@ using namespace mowa::sgui;
 #include "pixelpunch/PixelPunch.h"
 #include "pixelpunch/PixelScale.h"
 #include "pixelpunch/PixelTransform.h"
+#include "pixelpunch/TileCache.h"
+#include "pixelpunch/RotSprite.h"
+#include "pixelpunch/MappedImage.h"
+#include "pixelpunch/SurfacePool.h"
 
 #include <boost/format.hpp>
 
@@ -48,6 +52,7 @@ public:
 private:
 	void initOptions();
 	void validateResultImage();
+	void releaseResultImage();
 
 	//GUI
 	SimpleGUI*				mGui;
@@ -78,15 +83,28 @@ private:
 	float					mMixThreshold;
 	bool					mPrevDiffWithSmoothBicubic;
 	bool					mDiffWithSmoothBicubic;
+	bool					mPrevUseTileCache;
+	bool					mUseTileCache;
+	bool					mPrevUseVirtualSrc;
+	bool					mUseVirtualSrc;
 	float					mViewScale;
 	bool					mDisplaySource;
 
 	//DATA
 	std::string				mSourceFileName;
+	pp::MappedImage			mSourceMapping;
 	Surface					mSourceImage;
 	Surface					mScaledSrc;
+	pp::TileCache			mTileCache;
+	pp::SurfacePool			mPool;
+	pp::ExecutionContext	mContext; //threads shared by all pp calls, buffers from mPool
+	pp::CoordinateMap		mCoordMap;
+	pp::UniformBlocks		mUniformBlocks;
+	pp::TiledImage			mTiledSrc;
+	pp::VirtualScaledImage	mVirtualSrc; //sampled instead of mScaledSrc, which then has no pixels
 	gl::TextureRef             mPrevTexture;
 	Surface					mResultImage;
+	SurfaceRef				mResultBuffer; //pool buffer of transformed results, mResultImage refers to it
 	gl::TextureRef             mResultTexture;
 };
 
@@ -102,6 +120,9 @@ void PixelPunchApp::initOptions()
 	mScaleOptions[pp::SM_SCALE2x_HQ] = "Scale2xHQ";
 	mScaleOptions[pp::SM_SCALE3x_HQ] = "Scale3xHQ";
 	mScaleOptions[pp::SM_SCALE4x_HQ] = "Scale4xHQ";
+	mScaleOptions[pp::SM_HQ2x] = "hq2x";
+	mScaleOptions[pp::SM_HQ3x] = "hq3x";
+	mScaleOptions[pp::SM_HQ4x] = "hq4x";
 	mScaleMethod = pp::SM_NONE;
 
 	//TRANSFORM OPTIONS
@@ -125,15 +146,19 @@ void PixelPunchApp::initOptions()
 	mSamplingOptions[pp::SAMPLE_BEST_FIT_WIDE] = "Best Fit Wide";
 	mSamplingOptions[pp::SAMPLE_BEST_FIT_ANY] = "Best Fit Any";
 	mSamplingOptions[pp::SAMPLE_MINIMIZE_ERROR] = "Bilinear Mix";
+	mSamplingOptions[pp::SAMPLE_ROTSPRITE] = "RotSprite";
 	mSamplingMethod = pp::SAMPLE_NEAREST;
 }
 
 void PixelPunchApp::setup()
 {
 	initOptions();
+	mContext.setPool(&mPool);
 
 	mViewScale = 3.0f;
 	mDisplaySource = false;
+	mPrevUseTileCache = false;
+	mPrevUseVirtualSrc = false;
 
 	mGui = new SimpleGUI(this);
 	mGui->addLabel("View");
@@ -167,6 +192,8 @@ void PixelPunchApp::setup()
 	}
 	mGui->addParam("Mix Threshold", &mMixThreshold, 0.0f, 1.0f, 0.5f); //if we specify group id, we create radio button set
 	mGui->addParam("Show Diff", &mDiffWithSmoothBicubic, false);
+	mGui->addParam("Tile Cache", &mUseTileCache, false);
+	mGui->addParam("Virtual Scale", &mUseVirtualSrc, false);
 
 	mPerfLabel = mGui->addLabel("Perf: 0 ms");
 }
@@ -174,11 +201,21 @@ void PixelPunchApp::setup()
 void PixelPunchApp::fileDrop(FileDropEvent event)
 {
 	mSourceFileName = event.getFile(0).string();
-	mSourceImage = loadImage(mSourceFileName);
+	mSourceImage = Surface();
+	//raw PAM sources are sampled straight from the mapped file
+	if (event.getFile(0).extension() == ".pam" && mSourceMapping.open(mSourceFileName))
+		mSourceImage = mSourceMapping.surface();
+	else
+	{
+		mSourceMapping.close();
+		mSourceImage = loadImage(mSourceFileName);
+	}
 	mPrevTexture = gl::Texture::create(mSourceImage);
 	mPrevTexture->setMagFilter(GL_NEAREST);
-	mResultImage = Surface();
+	releaseResultImage();
 	mScaledSrc = Surface();
+	mVirtualSrc.clear();
+	mTileCache.clear();
 
 	mTransformUI.setShape(cinder::Rectf(0, 0, (float)mSourceImage.getWidth(), (float)mSourceImage.getHeight()));
 	mTransformUI.center();
@@ -215,6 +252,8 @@ void PixelPunchApp::validateResultImage()
 	isValid = isValid && (newSamplingMethod == mSamplingMethod);
 	isValid = isValid && (mPrevMixThreshold == mMixThreshold);
 	isValid = isValid && (mPrevDiffWithSmoothBicubic == mDiffWithSmoothBicubic);
+	isValid = isValid && (mPrevUseTileCache == mUseTileCache);
+	isValid = isValid && (mPrevUseVirtualSrc == mUseVirtualSrc);
 
 	if (mSourceImage.getData() && !isValid)
 	{
@@ -226,110 +265,188 @@ void PixelPunchApp::validateResultImage()
 			mPrevTexture = mResultTexture;
 
 		//UPSCALE SOURCE
-		if (newScaleMethod != mScaleMethod || !mScaledSrc.getData())
+		bool haveScaled = mUseVirtualSrc ? !mVirtualSrc.empty() : mScaledSrc.getData() != NULL;
+		if (newScaleMethod != mScaleMethod || mPrevUseTileCache != mUseTileCache || mPrevUseVirtualSrc != mUseVirtualSrc || !haveScaled)
 		{
 			mScaleMethod = newScaleMethod;
-			mScaledSrc = pp::scale(mSourceImage, mScaleMethod);
+			//the HQ cleanup methods can't be scaled in blocks, the toggle turns itself off
+			if (mUseVirtualSrc && !pp::scaleIsLocal(mScaleMethod))
+				mUseVirtualSrc = false;
+			mPrevUseTileCache = mUseTileCache;
+			mPrevUseVirtualSrc = mUseVirtualSrc;
+			releaseResultImage();
+			mScaledSrc = Surface();
+			mVirtualSrc.clear();
+			if (mUseVirtualSrc)
+			{
+				//only the size, blocks are scaled when the samplers read them
+				mVirtualSrc.build(mSourceImage, mScaleMethod);
+				mScaledSrc = mVirtualSrc.shape();
+			}
+			else
+			{
+				//unscaled mapped sources are copied, the mapping goes away with the next drop
+				if (mUseTileCache)
+					mScaledSrc = mTileCache.scale(mSourceImage, mScaleMethod, &mContext, !mSourceMapping.isOpen());
+				else
+					mScaledSrc = pp::scale(mSourceImage, mScaleMethod, &mContext, false, !mSourceMapping.isOpen());
+				mUniformBlocks.build(mScaledSrc);
+				mTiledSrc.build(mScaledSrc);
+			}
 		}
 
 		//TRANSFORM
 		mTransformMethod = newTransformMethod;
+		releaseResultImage();
 
 		if (mTransformMethod == pp::TM_IDENTITY)
 		{
-			mResultImage = mScaledSrc;
+			if (mUseVirtualSrc)
+				mResultImage = pp::scale(mSourceImage, mScaleMethod, &mContext, false, !mSourceMapping.isOpen());
+			else
+				mResultImage = mScaledSrc;
 		}
 		else
 		{
 			pp::TransformMapping tfx = pp::TransformMapping(mTransformUI.shape);
+			//shared by all samplers below, only rebuilt when the shape or the source size changes
+			if (!mCoordMap.matches(tfx, mTransformMethod, mScaledSrc.getWidth(), mScaledSrc.getHeight()))
+				mCoordMap.build(tfx, mTransformMethod, mScaledSrc.getWidth(), mScaledSrc.getHeight());
 			//SAMPLING
 			mSamplingMethod = newSamplingMethod;
 			pp::Palette colors;
+			const pp::UniformBlocks* blocks = mUseVirtualSrc ? NULL : &mUniformBlocks;
+			const pp::TiledImage* tiles = mUseVirtualSrc ? NULL : &mTiledSrc;
+			const pp::VirtualScaledImage* scaled = mUseVirtualSrc ? &mVirtualSrc : NULL;
+			//rendered into a pool buffer, which goes back for the next render with releaseResultImage
+			mResultBuffer = mContext.acquire(mCoordMap.width, mCoordMap.height, mScaledSrc.hasAlpha());
+			Surface& result = *mResultBuffer;
 
 			switch (mSamplingMethod)
 			{
 			case pp::SAMPLE_NEAREST:
 			{
 				pp::NearestNeighbourSampler NNS = pp::NearestNeighbourSampler(mScaledSrc);
-				mResultImage = pp::transform(NNS, tfx, mTransformMethod);
+				NNS.tiles = tiles;
+				NNS.scaled = scaled;
+				pp::transform(NNS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_BILINEAR:
 			{
 				pp::BilinearSampler BS = pp::BilinearSampler(mScaledSrc);
-				mResultImage = pp::transform(BS, tfx, mTransformMethod);
+				BS.tiles = tiles;
+				BS.scaled = scaled;
+				pp::transform(BS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_BICUBIC:
 			{
 				pp::BicubicSampler BCS = pp::BicubicSampler(mScaledSrc);
-				mResultImage = pp::transform(BCS, tfx, mTransformMethod);
+				BCS.blocks = blocks;
+				BCS.tiles = tiles;
+				BCS.scaled = scaled;
+				pp::transform(BCS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_FIRST_BILINEAR:
 			{
 				pp::BilinearDominanceSampler BDSF = pp::BilinearDominanceSampler(mScaledSrc, 0);
-				mResultImage = pp::transform(BDSF, tfx, mTransformMethod);
+				BDSF.blocks = blocks;
+				BDSF.tiles = tiles;
+				BDSF.scaled = scaled;
+				pp::transform(BDSF, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_SECOND_BILINEAR:
 			{
 				pp::BilinearDominanceSampler BDSS = pp::BilinearDominanceSampler(mScaledSrc, 1);
-				mResultImage = pp::transform(BDSS, tfx, mTransformMethod);
+				BDSS.blocks = blocks;
+				BDSS.tiles = tiles;
+				BDSS.scaled = scaled;
+				pp::transform(BDSS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_BEST_FIT_NARROW:
 			{
 				pp::BicubicBestFitSampler BSFS = pp::BicubicBestFitSampler(mScaledSrc, false);
-				mResultImage = pp::transform(BSFS, tfx, mTransformMethod);
+				BSFS.blocks = blocks;
+				BSFS.tiles = tiles;
+				BSFS.scaled = scaled;
+				pp::transform(BSFS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_BEST_FIT_WIDE:
 			{
 				pp::BicubicBestFitSampler BSFW = pp::BicubicBestFitSampler(mScaledSrc, true);
-				mResultImage = pp::transform(BSFW, tfx, mTransformMethod);
+				BSFW.blocks = blocks;
+				BSFW.tiles = tiles;
+				BSFW.scaled = scaled;
+				pp::transform(BSFW, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_BEST_FIT_ANY:
 			{
 				pp::getColors(mSourceImage, colors);
 				pp::BicubicBestFitSampler BBFS = pp::BicubicBestFitSampler(mScaledSrc, colors);
-				mResultImage = pp::transform(BBFS, tfx, mTransformMethod);
+				BBFS.tiles = tiles;
+				BBFS.scaled = scaled;
+				pp::transform(BBFS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_FIRST_WEIGHT:
 			{
 				pp::WeightSampler WSF = pp::WeightSampler(mScaledSrc, 0);
-				mResultImage = pp::transform(WSF, tfx, mTransformMethod);
+				WSF.blocks = blocks;
+				WSF.tiles = tiles;
+				WSF.scaled = scaled;
+				pp::transform(WSF, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_SECOND_WEIGHT:
 			{
 				pp::WeightSampler WSS = pp::WeightSampler(mScaledSrc, 1);
-				mResultImage = pp::transform(WSS, tfx, mTransformMethod);
+				WSS.blocks = blocks;
+				WSS.tiles = tiles;
+				WSS.scaled = scaled;
+				pp::transform(WSS, mCoordMap, result, &mContext);
+				break;
+			}
+			case pp::SAMPLE_ROTSPRITE:
+			{
+				//expands its own tiles of the source, so it needs the pixels
+				Surface source = mUseVirtualSrc ? pp::scale(mSourceImage, mScaleMethod, &mContext, false, !mSourceMapping.isOpen()) : mScaledSrc;
+				pp::RotSpriteSampler RSS = pp::RotSpriteSampler(source);
+				RSS.blocks = blocks;
+				pp::transform(RSS, mCoordMap, result, &mContext);
 				break;
 			}
 			case pp::SAMPLE_MINIMIZE_ERROR:
 			{
-
 				pp::BicubicSampler BCS = pp::BicubicSampler(mScaledSrc);
-				pp::BilinearDominanceSampler BDSF = pp::BilinearDominanceSampler(mScaledSrc, 0);
-				pp::BilinearDominanceSampler BDSS = pp::BilinearDominanceSampler(mScaledSrc, 1);
-				pp::WeightSampler WSF = pp::WeightSampler(mScaledSrc, 0);
-				Surface bicubic = pp::transform(BCS, tfx, mTransformMethod);
-				Surface first = pp::transform(BDSF, tfx, mTransformMethod);
-				Surface second = pp::transform(BDSS, tfx, mTransformMethod);
-				Surface secondWeight = pp::transform(WSF, tfx, mTransformMethod);
-				Surface compare = pp::compare(bicubic, first);
-				mResultImage = pp::choose(first, second, compare, secondWeight, mMixThreshold*mMixThreshold);
+				BCS.blocks = blocks;
+				BCS.tiles = tiles;
+				BCS.scaled = scaled;
+				pp::BilinearDominanceSampler BDS = pp::BilinearDominanceSampler(mScaledSrc, 0);
+				BDS.blocks = blocks;
+				BDS.tiles = tiles;
+				BDS.scaled = scaled;
+				pp::transformMinimizeError(BCS, BDS, mCoordMap, mMixThreshold*mMixThreshold, result, &mContext);
 			}
 			}
 			if (mDiffWithSmoothBicubic)
 			{
 				pp::BicubicSampler BCS = pp::BicubicSampler(mScaledSrc);
-				Surface bicubic = pp::transform(BCS, tfx, mTransformMethod);
-				mResultImage = pp::compare(bicubic, mResultImage);
+				BCS.blocks = blocks;
+				BCS.tiles = tiles;
+				BCS.scaled = scaled;
+				SurfaceRef bicubic = mContext.acquire(result.getWidth(), result.getHeight(), result.hasAlpha());
+				pp::transform(BCS, mCoordMap, *bicubic, &mContext);
+				SurfaceRef diff = mContext.acquire(result.getWidth(), result.getHeight(), false);
+				pp::compare(*bicubic, result, *diff, &mContext);
+				mResultBuffer = diff;
 			}
+			mResultImage = *mResultBuffer;
 
 		}
 		mResultTexture = gl::Texture::create(mResultImage);
@@ -338,10 +455,21 @@ void PixelPunchApp::validateResultImage()
 		//PRINT TIME TAKEN
 		double t2 = getElapsedSeconds();
 		int ms = (int)((t2 - t1) * 1000);
-		mPerfLabel->setText(str(boost::format("Perf: %i ms") % ms));
+		pp::SurfacePoolStats pool = mPool.stats();
+		std::string perf = str(boost::format("Perf: %i ms, buffers %i new / %i reused") % ms % pool.allocations % pool.reuses);
+		if (mUseTileCache)
+			perf += str(boost::format(", tiles %i hit / %i miss") % mTileCache.stats().hits % mTileCache.stats().misses);
+		mPerfLabel->setText(perf);
 	}
 }
 
+void PixelPunchApp::releaseResultImage()
+{
+	//the pool buffer goes back with its last SurfaceRef, mResultImage only refers to it
+	mResultImage = Surface();
+	mResultBuffer.reset();
+}
+
 void PixelPunchApp::keyDown(KeyEvent event)
 {
 	if (event.getChar() == 'f')
@@ -361,23 +489,23 @@ void PixelPunchApp::keyUp(KeyEvent event)
 void PixelPunchApp::mouseMove(MouseEvent event)
 {
 	if (mTransformUI.mouseMove(event))
-		mResultImage = Surface();
+		releaseResultImage();
 }
 void PixelPunchApp::mouseDown(MouseEvent event)
 {
 	if (mTransformUI.mouseDown(event))
-		mResultImage = Surface();
+		releaseResultImage();
 }
 void PixelPunchApp::mouseUp(MouseEvent event)
 {
 	if (mTransformUI.mouseUp(event))
-		mResultImage = Surface();
+		releaseResultImage();
 }
 
 void PixelPunchApp::mouseDrag(MouseEvent event)
 {
 	if (mTransformUI.mouseDrag(event))
-		mResultImage = Surface();
+		releaseResultImage();
 }
 
 void PixelPunchApp::update()
@@ -431,11 +559,14 @@ void PixelPunchApp::saveResultToFile()
 	if (mResultImage.getData() != NULL)
 	{
 		std::vector<std::string> extensions = ImageIo::getWriteExtensions();
+		extensions.push_back("pam");
 		std::string suffix = mScaleOptions[mScaleMethod];
 		std::string path = mSourceFileName;
 		path.insert(path.find_last_of('.'), suffix);
-		std::string savePath = getSaveFilePath(path, extensions).string();
-		if (!savePath.empty())
+		fs::path savePath = getSaveFilePath(path, extensions);
+		if (savePath.extension() == ".pam")
+			pp::writeMapped(savePath.string(), mResultImage);
+		else if (!savePath.empty())
 			writeImage(savePath, mResultImage);
 	}
 
@@ -0,0 +1,156 @@
+#include "EqualityMask.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PP_MASK_SSE2
+	#include <emmintrin.h>
+#endif
+
+using namespace pp;
+
+inline uint16_t _maskAt(const uint32_t* r0, const uint32_t* r1, const uint32_t* r2, int x, int xl, int xr)
+{
+	uint32_t a = r0[xl], b = r0[x], c = r0[xr];
+	uint32_t d = r1[xl], e = r1[x], f = r1[xr];
+	uint32_t g = r2[xl], h = r2[x], i = r2[xr];
+	return (a == e) | (b == e) << 1 | (c == e) << 2 | (d == e) << 3 |
+		(f == e) << 4 | (g == e) << 5 | (h == e) << 6 | (i == e) << 7 |
+		(b == d) << 8 | (b == f) << 9 | (d == h) << 10 | (f == h) << 11 |
+		(b == h) << 12 | (d == f) << 13;
+}
+
+#ifdef PP_MASK_SSE2
+inline __m128i _bitIfEqual(__m128i x, __m128i y, int bit)
+{
+	return _mm_and_si128(_mm_cmpeq_epi32(x, y), _mm_set1_epi32(bit));
+}
+#endif
+
+void _maskRow(const PixelPlane& source, MaskPlane& mask, int y, int x0, int x1)
+{
+	int w = source.width;
+	const uint32_t* r0 = source.row(std::max(y - 1, 0));
+	const uint32_t* r1 = source.row(y);
+	const uint32_t* r2 = source.row(std::min(y + 1, source.height - 1));
+	uint16_t* dst = mask.row(y);
+	int x = x0;
+	//left border
+	for(; x <= x1 && x < 1; x++)
+		dst[x] = _maskAt(r0, r1, r2, x, 0, std::min(x + 1, w - 1));
+#ifdef PP_MASK_SSE2
+	//4 pixels at once while no clamping is needed
+	for(; x + 4 <= std::min(x1 + 1, w - 1); x += 4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(r0 + x - 1));
+		__m128i b = _mm_loadu_si128((const __m128i*)(r0 + x));
+		__m128i c = _mm_loadu_si128((const __m128i*)(r0 + x + 1));
+		__m128i d = _mm_loadu_si128((const __m128i*)(r1 + x - 1));
+		__m128i e = _mm_loadu_si128((const __m128i*)(r1 + x));
+		__m128i f = _mm_loadu_si128((const __m128i*)(r1 + x + 1));
+		__m128i g = _mm_loadu_si128((const __m128i*)(r2 + x - 1));
+		__m128i h = _mm_loadu_si128((const __m128i*)(r2 + x));
+		__m128i i = _mm_loadu_si128((const __m128i*)(r2 + x + 1));
+		__m128i m = _mm_or_si128(_bitIfEqual(a, e, EQ_A), _bitIfEqual(b, e, EQ_B));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(c, e, EQ_C), _bitIfEqual(d, e, EQ_D)));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(f, e, EQ_F), _bitIfEqual(g, e, EQ_G)));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(h, e, EQ_H), _bitIfEqual(i, e, EQ_I)));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(b, d, EQ_BD), _bitIfEqual(b, f, EQ_BF)));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(d, h, EQ_DH), _bitIfEqual(f, h, EQ_FH)));
+		m = _mm_or_si128(m, _mm_or_si128(_bitIfEqual(b, h, EQ_BH), _bitIfEqual(d, f, EQ_DF)));
+		//all values fit into a signed 16 bit integer
+		_mm_storel_epi64((__m128i*)(dst + x), _mm_packs_epi32(m, m));
+	}
+#endif
+	for(; x <= x1; x++)
+		dst[x] = _maskAt(r0, r1, r2, x, std::max(x - 1, 0), std::min(x + 1, w - 1));
+}
+
+void pp::equalityMask(const PixelPlane& source, MaskPlane& mask)
+{
+	mask.resize(source.width, source.height);
+	for(int y = 0; y < source.height; y++)
+		_maskRow(source, mask, y, 0, source.width - 1);
+}
+
+void pp::updateMask(const PixelPlane& source, MaskPlane& mask, int x0, int y0, int x1, int y1)
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, source.width - 1);
+	y1 = std::min(y1, source.height - 1);
+	for(int y = y0; y <= y1; y++)
+		_maskRow(source, mask, y, x0, x1);
+}
+
+void pp::deriveMask(const MaskPlane& sourceMask, int factor, const PixelPlane& scaled, MaskPlane& mask, PixelList* edges)
+{
+	mask.resize(scaled.width, scaled.height);
+	if(edges)
+		edges->clear();
+	int w = sourceMask.width;
+	int h = sourceMask.height;
+	std::vector<int> mixed;
+	for(int y = 0; y < h; y++)
+	{
+		const uint16_t* m0 = sourceMask.row(std::max(y - 1, 0));
+		const uint16_t* m1 = sourceMask.row(y);
+		const uint16_t* m2 = sourceMask.row(std::min(y + 1, h - 1));
+		mixed.clear();
+		for(int x = 0; x < w; x++)
+		{
+			int xl = std::max(x - 1, 0);
+			int xr = std::min(x + 1, w - 1);
+			uint16_t all = m0[xl] & m0[x] & m0[xr] & m1[xl] & m1[x] & m1[xr] & m2[xl] & m2[x] & m2[xr];
+			if((all & EQ_NEIGHBOURS) == EQ_NEIGHBOURS)
+			{
+				for(int sy = 0; sy < factor; sy++)
+				{
+					uint16_t* dst = mask.row(y * factor + sy) + x * factor;
+					for(int sx = 0; sx < factor; sx++)
+						dst[sx] = EQ_ALL;
+				}
+			}
+			else
+			{
+				for(int sy = 0; sy < factor; sy++)
+					_maskRow(scaled, mask, y * factor + sy, x * factor, x * factor + factor - 1);
+				mixed.push_back(x);
+			}
+		}
+		if(!edges)
+			continue;
+		//row by row to keep the list in scan order
+		for(int sy = 0; sy < factor; sy++)
+		{
+			int dy = y * factor + sy;
+			const uint16_t* bits = mask.row(dy);
+			for(size_t i = 0; i < mixed.size(); i++)
+				for(int dx = mixed[i] * factor; dx < (mixed[i] + 1) * factor; dx++)
+					if((bits[dx] & EQ_NEIGHBOURS) != EQ_NEIGHBOURS)
+						edges->push_back((uint32_t)dy * mask.width + dx);
+		}
+	}
+}
+
+void pp::edgePixels(const MaskPlane& mask, PixelList& edges)
+{
+	edges.clear();
+	const uint16_t* bits = mask.pixels.empty() ? NULL : &mask.pixels[0];
+	size_t count = mask.pixels.size();
+	size_t i = 0;
+#ifdef PP_MASK_SSE2
+	//skip 8 uniform pixels at once
+	const __m128i neighbours = _mm_set1_epi16(EQ_NEIGHBOURS);
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i m = _mm_and_si128(_mm_loadu_si128((const __m128i*)(bits + i)), neighbours);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi16(m, neighbours)) == 0xFFFF)
+			continue;
+		for(size_t j = i; j < i + 8; j++)
+			if((bits[j] & EQ_NEIGHBOURS) != EQ_NEIGHBOURS)
+				edges.push_back((uint32_t)j);
+	}
+#endif
+	for(; i < count; i++)
+		if((bits[i] & EQ_NEIGHBOURS) != EQ_NEIGHBOURS)
+			edges.push_back((uint32_t)i);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Plane.h"
+#include <vector>
+
+namespace pp
+{
+	//Per pixel bits telling which neighbours equal the center and which of the edge
+	//neighbours equal each other. Cells are named like rules::Cell3, borders are clamped.
+	enum EqualityBits {
+		EQ_A = 0x0001, EQ_B = 0x0002, EQ_C = 0x0004, EQ_D = 0x0008,
+		EQ_F = 0x0010, EQ_G = 0x0020, EQ_H = 0x0040, EQ_I = 0x0080,
+		EQ_BD = 0x0100, EQ_BF = 0x0200, EQ_DH = 0x0400, EQ_FH = 0x0800,
+		EQ_BH = 0x1000, EQ_DF = 0x2000,
+
+		EQ_NEIGHBOURS = 0x00FF,
+		EQ_ALL = 0x3FFF
+	};
+	typedef Plane<uint16_t> MaskPlane;
+	//pixel indices y * width + x in scan order
+	typedef std::vector<uint32_t> PixelList;
+
+	void equalityMask(const PixelPlane& source, MaskPlane& mask);
+	//recomputes the masks of [x0, x1] x [y0, y1] after pixels in there changed
+	void updateMask(const PixelPlane& source, MaskPlane& mask, int x0, int y0, int x1, int y1);
+	//mask of a plane scaled by factor by a scaler that only looks at 3x3 neighbourhoods.
+	//Blocks of uniform 5x5 areas are uniform too, only the others are compared pixel by pixel
+	//and their edge pixels are added to edges.
+	void deriveMask(const MaskPlane& sourceMask, int factor, const PixelPlane& scaled, MaskPlane& mask, PixelList* edges = NULL);
+	//pixels that differ from at least one of their neighbours
+	void edgePixels(const MaskPlane& mask, PixelList& edges);
+}
@@ -0,0 +1,186 @@
+#include "ExecutionContext.h"
+#include "SurfacePool.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+using namespace cinder;
+using namespace pp;
+
+void* Scratch::get(size_t bytes)
+{
+	if(mMemory.size() < bytes + 63)
+		mMemory.resize(bytes + 63);
+	uintptr_t address = reinterpret_cast<uintptr_t>(&mMemory[0]);
+	return reinterpret_cast<void*>((address + 63) & ~(uintptr_t)63);
+}
+
+//no affinity API on OS X, workers are left to the scheduler there
+void _pin(int core)
+{
+#if defined(_WIN32)
+	if(core < (int)sizeof(DWORD_PTR) * 8)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+ExecutionContext::ExecutionContext(int threads, bool pinWorkers)
+:	mStopping(false), mTileWidth(64), mTileHeight(64), mPool(NULL), mStats(NULL)
+{
+	int cores = std::max(1u, std::thread::hardware_concurrency());
+	if(threads <= 0)
+		threads = cores;
+	//the calling thread is the first one, workers get the other cores
+	for(int i = 1; i < threads; i++)
+	{
+		Worker* worker = new Worker();
+		worker->thread = std::thread(&ExecutionContext::work, this, worker, pinWorkers ? i % cores : -1);
+		mWorkers.push_back(worker);
+	}
+}
+
+ExecutionContext::~ExecutionContext()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for(size_t i = 0; i < mWorkers.size(); i++)
+	{
+		mWorkers[i]->thread.join();
+		delete mWorkers[i];
+	}
+}
+
+//created on first use and never destroyed so workers don't have to be joined at exit.
+//Function local statics aren't thread safe in VS2013.
+static std::mutex sDefaultLock;
+static ExecutionContext* sDefaultContext = NULL;
+
+ExecutionContext& ExecutionContext::defaultContext()
+{
+	std::lock_guard<std::mutex> lock(sDefaultLock);
+	if(!sDefaultContext)
+		sDefaultContext = new ExecutionContext(0, false);
+	return *sDefaultContext;
+}
+
+void ExecutionContext::setTileSize(int width, int height)
+{
+	mTileWidth = std::max(width, 1);
+	mTileHeight = std::max(height, 1);
+}
+
+SurfaceRef ExecutionContext::acquire(int width, int height, bool alpha)
+{
+	return mPool ? mPool->acquire(width, height, alpha) : Surface::create(width, height, alpha);
+}
+
+void ExecutionContext::drain(Batch& batch, Scratch& scratch)
+{
+	for(int i = batch.next++; i < batch.count; i = batch.next++)
+		batch.function(batch.task, i, scratch);
+}
+
+//takes the batch out of the queue so no more workers join it, call with mLock held
+void ExecutionContext::retire(Batch* batch)
+{
+	std::deque<Batch*>::iterator found = std::find(mBatches.begin(), mBatches.end(), batch);
+	if(found != mBatches.end())
+		mBatches.erase(found);
+}
+
+//the calling thread keeps its scratch from call to call like the workers do
+struct CallerScratch
+{
+	CallerScratch() : busy(false) {}
+	Scratch scratch;
+	bool busy; //a task of this thread is using it
+};
+
+//the scratch of the calling thread for one run, a run from inside one of its tasks gets its own
+struct ClaimScratch
+{
+	ClaimScratch(CallerScratch& c) : caller(c), claimed(!c.busy) { caller.busy = true; }
+	~ClaimScratch()
+	{
+		if(claimed)
+			caller.busy = false;
+	}
+	Scratch& get() { return claimed ? caller.scratch : own; }
+
+	CallerScratch& caller;
+	bool claimed;
+	Scratch own;
+};
+
+void ExecutionContext::run(int count, TaskFunction function, const void* task)
+{
+	static thread_local CallerScratch caller;
+	ClaimScratch claim(caller);
+	Scratch& scratch = claim.get();
+	if(mWorkers.empty() || count <= 1)
+	{
+		for(int i = 0; i < count; i++)
+			function(task, i, scratch);
+		return;
+	}
+
+	Batch batch;
+	batch.function = function;
+	batch.task = task;
+	batch.count = count;
+	batch.next = 0;
+	batch.active = 0;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mBatches.push_back(&batch);
+	}
+	mWake.notify_all();
+
+	drain(batch, scratch);
+
+	//all indices are taken, wait for the workers still running one
+	std::unique_lock<std::mutex> lock(mLock);
+	retire(&batch);
+	while(batch.active > 0)
+		mDone.wait(lock);
+}
+
+void ExecutionContext::work(Worker* worker, int core)
+{
+	if(core >= 0)
+		_pin(core);
+
+	std::unique_lock<std::mutex> lock(mLock);
+	while(true)
+	{
+		while(!mStopping && mBatches.empty())
+			mWake.wait(lock);
+		if(mStopping)
+			return;
+
+		Batch* batch = mBatches.front();
+		batch->active++;
+		lock.unlock();
+		drain(*batch, worker->scratch);
+		lock.lock();
+		retire(batch);
+		if(--batch->active == 0)
+			mDone.notify_all();
+	}
+}
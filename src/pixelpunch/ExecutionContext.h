@@ -0,0 +1,141 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pp
+{
+	class SurfacePool;
+
+	//Memory of one worker or calling thread that is reused by all tasks it runs. Contents don't
+	//survive the task.
+	class Scratch
+	{
+	public:
+		void* get(size_t bytes); //aligned to 64 bytes
+		template<typename T> T* get(size_t count) { return static_cast<T*>(get(count * sizeof(T))); }
+
+	private:
+		std::vector<uint8_t> mMemory;
+	};
+
+	//Receives a record for every pp call made with a context.
+	class StatsSink
+	{
+	public:
+		virtual ~StatsSink() {}
+		//called from the thread that made the call, pixels is the size of the result
+		virtual void record(const char* operation, double milliseconds, size_t pixels) = 0;
+	};
+
+	//Threads, memory and instrumentation used by pp calls. Workers are started once and
+	//shared by all calls, also concurrent ones from different threads, so a service running
+	//many jobs at once doesn't start more threads than there are cores. The calling thread
+	//takes part in its own work. Calls without a context use defaultContext().
+	class ExecutionContext
+	{
+	public:
+		//threads = 0 uses all cores, the calling thread counts as one of them
+		ExecutionContext(int threads = 0, bool pinWorkers = true);
+		~ExecutionContext();
+
+		//all cores, workers not pinned, no pool and no stats
+		static ExecutionContext& defaultContext();
+		static ExecutionContext& get(ExecutionContext* context) { return context ? *context : defaultContext(); }
+
+		int threads() const { return (int)mWorkers.size() + 1; }
+
+		//preferred size of the pieces images are split into, rows only use the height
+		void setTileSize(int width, int height);
+		int tileWidth() const { return mTileWidth; }
+		int tileHeight() const { return mTileHeight; }
+
+		//buffers for intermediate images, not owned
+		void setPool(SurfacePool* pool) { mPool = pool; }
+		SurfacePool* pool() const { return mPool; }
+		//for intermediate images, allocates from the pool if there is one
+		cinder::SurfaceRef acquire(int width, int height, bool alpha);
+
+		//not owned, may be NULL
+		void setStats(StatsSink* stats) { mStats = stats; }
+		StatsSink* stats() const { return mStats; }
+
+		//runs task(index, scratch) for all indices in [0, count) and returns when all are done
+		template<class Task>
+		void parallelFor(int count, const Task& task)
+		{
+			run(count, &ExecutionContext::runTask<Task>, &task);
+		}
+
+	private:
+		typedef void (*TaskFunction)(const void* task, int index, Scratch& scratch);
+
+		struct Batch
+		{
+			TaskFunction function;
+			const void* task;
+			int count;
+			std::atomic<int> next;
+			int active; //workers that took the batch, guarded by mLock
+		};
+
+		struct Worker
+		{
+			std::thread thread;
+			Scratch scratch;
+			char padding[64]; //keeps the scratch of neighbouring workers on different cache lines
+		};
+
+		template<class Task>
+		static void runTask(const void* task, int index, Scratch& scratch)
+		{
+			(*static_cast<const Task*>(task))(index, scratch);
+		}
+
+		void run(int count, TaskFunction function, const void* task);
+		void work(Worker* worker, int core);
+		static void drain(Batch& batch, Scratch& scratch);
+		void retire(Batch* batch);
+
+		std::vector<Worker*> mWorkers;
+		std::deque<Batch*> mBatches;
+		std::mutex mLock;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		bool mStopping;
+		int mTileWidth;
+		int mTileHeight;
+		SurfacePool* mPool;
+		StatsSink* mStats;
+	};
+
+	//reports the time until it goes out of scope to the stats sink of a context, if there is one
+	class StatsScope
+	{
+	public:
+		StatsScope(ExecutionContext& context, const char* operation) : mStats(context.stats()), mOperation(operation), mPixels(0)
+		{
+			if(mStats)
+				mStart = std::chrono::steady_clock::now();
+		}
+		~StatsScope()
+		{
+			if(mStats)
+				mStats->record(mOperation, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count(), mPixels);
+		}
+		void setPixels(size_t pixels) { mPixels = pixels; }
+
+	private:
+		StatsSink* mStats;
+		const char* mOperation;
+		size_t mPixels;
+		std::chrono::steady_clock::time_point mStart;
+	};
+}
@@ -0,0 +1,493 @@
+#include "HqScale.h"
+#include "ScaleRules.h"
+#include <cstring>
+#include <new>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PP_HQ_SSE2
+	#include <emmintrin.h>
+#endif
+
+using namespace pp;
+using namespace pp::rules;
+
+//hqx thresholds for Y, U and V
+const int HQ_Y = 48;
+const int HQ_U = 7;
+const int HQ_V = 6;
+
+void _toYuv(uint32_t c, int& y, int& u, int& v)
+{
+	int r = (c >> 16) & 0xFF;
+	int g = (c >> 8) & 0xFF;
+	int b = c & 0xFF;
+	y = (77 * r + 150 * g + 29 * b) >> 8;
+	u = ((-43 * r - 85 * g + 128 * b) >> 8) + 128;
+	v = ((128 * r - 107 * g - 21 * b) >> 8) + 128;
+}
+
+int _maskBit(int cell)
+{
+	return cell < E ? (1 << cell) : (1 << (cell - 1));
+}
+
+//****** DIFF CACHE ******
+
+HqDiffCache::HqDiffCache()
+{
+	//a == b is never looked up so the zero key can't collide
+	memset(mKeys, 0, sizeof(mKeys));
+	memset(mDiffers, 0, sizeof(mDiffers));
+}
+
+bool HqDiffCache::compute(uint32_t a, uint32_t b)
+{
+	int ya, ua, va, yb, ub, vb;
+	_toYuv(a, ya, ua, va);
+	_toYuv(b, yb, ub, vb);
+	return std::abs(ya - yb) > HQ_Y || std::abs(ua - ub) > HQ_U || std::abs(va - vb) > HQ_V;
+}
+
+bool HqDiffCache::differs(uint32_t a, uint32_t b)
+{
+	if(a == b)
+		return false;
+	if(a > b)
+		std::swap(a, b);
+	uint64_t key = ((uint64_t)a << 32) | b;
+	uint32_t slot = ((a * 0x9E3779B1u) ^ (b * 0x85EBCA77u)) >> 20;
+	if(mKeys[slot] != key)
+	{
+		mKeys[slot] = key;
+		mDiffers[slot] = compute(a, b);
+	}
+	return mDiffers[slot];
+}
+
+//****** DIFF MASK ******
+
+void pp::hqDiffMask(const PixelPlane& source, Plane<uint8_t>& mask)
+{
+	int w = source.width;
+	int h = source.height;
+	mask.resize(w, h);
+	if(w == 0 || h == 0)
+		return;
+
+	//YUV planes with a replicated border of one pixel
+	int pw = w + 2;
+	Plane<int16_t> yuv[3];
+	for(int i = 0; i < 3; i++)
+		yuv[i].resize(pw, h + 2);
+	for(int y = 0; y < h; y++)
+	{
+		const uint32_t* src = source.row(y);
+		int16_t* dst[3] = { yuv[0].row(y + 1), yuv[1].row(y + 1), yuv[2].row(y + 1) };
+		for(int x = 0; x < w; x++)
+		{
+			int cy, cu, cv;
+			_toYuv(src[x], cy, cu, cv);
+			dst[0][x + 1] = cy;
+			dst[1][x + 1] = cu;
+			dst[2][x + 1] = cv;
+		}
+		for(int i = 0; i < 3; i++)
+		{
+			dst[i][0] = dst[i][1];
+			dst[i][w + 1] = dst[i][w];
+		}
+	}
+	for(int i = 0; i < 3; i++)
+	{
+		memcpy(yuv[i].row(0), yuv[i].row(1), pw * sizeof(int16_t));
+		memcpy(yuv[i].row(h + 1), yuv[i].row(h), pw * sizeof(int16_t));
+	}
+
+	//offsets of A B C D F G H I in the padded planes
+	const int offsets[8] = { -pw - 1, -pw, -pw + 1, -1, 1, pw - 1, pw, pw + 1 };
+	for(int y = 0; y < h; y++)
+	{
+		const int16_t* py = yuv[0].row(y + 1) + 1;
+		const int16_t* pu = yuv[1].row(y + 1) + 1;
+		const int16_t* pv = yuv[2].row(y + 1) + 1;
+		uint8_t* dst = mask.row(y);
+		int x = 0;
+#ifdef PP_HQ_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ty = _mm_set1_epi16(HQ_Y);
+		const __m128i tu = _mm_set1_epi16(HQ_U);
+		const __m128i tv = _mm_set1_epi16(HQ_V);
+		for(; x + 8 <= w; x += 8)
+		{
+			__m128i cy = _mm_loadu_si128((const __m128i*)(py + x));
+			__m128i cu = _mm_loadu_si128((const __m128i*)(pu + x));
+			__m128i cv = _mm_loadu_si128((const __m128i*)(pv + x));
+			__m128i bits = zero;
+			for(int k = 0; k < 8; k++)
+			{
+				__m128i dy = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(py + x + offsets[k])), cy);
+				__m128i du = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(pu + x + offsets[k])), cu);
+				__m128i dv = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(pv + x + offsets[k])), cv);
+				dy = _mm_max_epi16(dy, _mm_sub_epi16(zero, dy));
+				du = _mm_max_epi16(du, _mm_sub_epi16(zero, du));
+				dv = _mm_max_epi16(dv, _mm_sub_epi16(zero, dv));
+				__m128i differs = _mm_or_si128(_mm_cmpgt_epi16(dy, ty), _mm_or_si128(_mm_cmpgt_epi16(du, tu), _mm_cmpgt_epi16(dv, tv)));
+				bits = _mm_or_si128(bits, _mm_and_si128(differs, _mm_set1_epi16(1 << k)));
+			}
+			_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(bits, bits));
+		}
+#endif
+		for(; x < w; x++)
+		{
+			uint8_t bits = 0;
+			for(int k = 0; k < 8; k++)
+			{
+				int o = x + offsets[k];
+				if(std::abs(py[o] - py[x]) > HQ_Y || std::abs(pu[o] - pu[x]) > HQ_U || std::abs(pv[o] - pv[x]) > HQ_V)
+					bits |= 1 << k;
+			}
+			dst[x] = bits;
+		}
+	}
+}
+
+//****** PATTERN TABLES ******
+
+/*
+	The hqx tables pick the blend of each output pixel by the 256 patterns of the diff mask,
+	some cases also ask whether two edge neighbours differ from each other. _hqRule has the
+	cases of the top left pixel of hq2x, the other corners see the neighbourhood mirrored.
+	Rules are named after the hq2x blend they give:
+
+	0	E							60	5E + 2B + D
+	10	3E + A						61	5E + 2D + B
+	11	3E + D						70	6E + B + D
+	12	3E + B						90	2E + 3B + 3D
+	20	2E + B + D					100	14E + B + D
+	21	2E + A + B
+	22	2E + A + D
+
+	hq3x and hq4x cover the corners with more pixels: the corner pixel gets the blend and
+	the ones further in fade towards E, diagonal edges through the corner (the 20 cases
+	where B and D differ, 90) are followed more closely. The edge pixels of hq3x lie
+	between two corners, they blend with their edge neighbour when it's similar to E.
+*/
+enum HqRule { HQ_0, HQ_10, HQ_11, HQ_12, HQ_20, HQ_20_DIAGONAL, HQ_21, HQ_22, HQ_60, HQ_61, HQ_70, HQ_90, HQ_100, HQ_RULES };
+
+//edge neighbour pairs whose difference some cases ask for
+enum HqPair { HQ_BD = 1, HQ_BF = 2, HQ_DH = 4, HQ_FH = 8 };
+const int HQ_PAIRS = 16;
+
+//the neighbourhood as seen from each corner, the top left corner sees it as it is
+const uint8_t HQ_FRAMES[4][9] = {
+	{ A, B, C, D, E, F, G, H, I },
+	{ C, B, A, F, E, D, I, H, G },
+	{ G, H, I, D, E, F, A, B, C },
+	{ I, H, G, F, E, D, C, B, A }
+};
+
+//weights of E, A, B and D in 16ths for the top left corner: hq2x, hq3x, then the pixels
+//00 01 10 11 of hq4x (01 is next to B, 10 next to D)
+const uint8_t HQ_KERNELS[HQ_RULES][6][4] = {
+	{ { 16, 0, 0, 0 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 } }, //0
+	{ { 12, 4, 0, 0 }, { 12, 4, 0, 0 }, { 10, 6, 0, 0 }, { 12, 4, 0, 0 }, { 12, 4, 0, 0 }, { 16, 0, 0, 0 } }, //10
+	{ { 12, 0, 0, 4 }, { 12, 0, 0, 4 }, { 10, 0, 0, 6 }, { 14, 0, 0, 2 }, { 12, 0, 0, 4 }, { 16, 0, 0, 0 } }, //11
+	{ { 12, 0, 4, 0 }, { 12, 0, 4, 0 }, { 10, 0, 6, 0 }, { 12, 0, 4, 0 }, { 14, 0, 2, 0 }, { 16, 0, 0, 0 } }, //12
+	{ {  8, 0, 4, 4 }, {  8, 0, 4, 4 }, {  8, 0, 4, 4 }, { 10, 0, 4, 2 }, { 10, 0, 2, 4 }, { 12, 0, 2, 2 } }, //20
+	{ {  8, 0, 4, 4 }, {  0, 0, 8, 8 }, {  0, 0, 8, 8 }, {  8, 0, 8, 0 }, {  8, 0, 0, 8 }, { 16, 0, 0, 0 } }, //20, B and D differ
+	{ {  8, 4, 4, 0 }, { 12, 4, 0, 0 }, { 10, 6, 0, 0 }, { 10, 2, 4, 0 }, { 12, 4, 0, 0 }, { 14, 2, 0, 0 } }, //21
+	{ {  8, 4, 0, 4 }, { 12, 4, 0, 0 }, { 10, 6, 0, 0 }, { 12, 4, 0, 0 }, { 10, 2, 0, 4 }, { 14, 2, 0, 0 } }, //22
+	{ { 10, 0, 4, 2 }, { 10, 0, 4, 2 }, { 10, 0, 4, 2 }, { 12, 0, 4, 0 }, { 14, 0, 2, 0 }, { 16, 0, 0, 0 } }, //60
+	{ { 10, 0, 2, 4 }, { 10, 0, 2, 4 }, { 10, 0, 2, 4 }, { 14, 0, 0, 2 }, { 12, 0, 0, 4 }, { 16, 0, 0, 0 } }, //61
+	{ { 12, 0, 2, 2 }, { 12, 0, 2, 2 }, { 12, 0, 2, 2 }, { 14, 0, 2, 0 }, { 14, 0, 0, 2 }, { 16, 0, 0, 0 } }, //70
+	{ {  4, 0, 6, 6 }, {  2, 0, 7, 7 }, {  0, 0, 8, 8 }, {  4, 0, 8, 4 }, {  4, 0, 4, 8 }, { 12, 0, 2, 2 } }, //90
+	{ { 14, 0, 1, 1 }, { 14, 0, 1, 1 }, { 12, 0, 2, 2 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 }, { 16, 0, 0, 0 } }  //100
+};
+
+//patterns as (mask, value) pairs, the pattern matches if the masked bits have the value
+const uint8_t HQ_DIAGONAL_10[13][2] = {
+	{ 0x6f, 0x2a }, { 0x5b, 0x0a }, { 0xbf, 0x3a }, { 0xdf, 0x5a }, { 0x9f, 0x8a }, { 0xcf, 0x8a }, { 0xef, 0x4e },
+	{ 0x3f, 0x0e }, { 0xfb, 0x5a }, { 0xbb, 0x8a }, { 0x7f, 0x5a }, { 0xaf, 0x8a }, { 0xeb, 0x8a }
+};
+const uint8_t HQ_PLAIN_11[4][2] = { { 0x1b, 0x03 }, { 0x4f, 0x43 }, { 0x8b, 0x83 }, { 0x6b, 0x43 } };
+const uint8_t HQ_PLAIN_12[4][2] = { { 0x4b, 0x09 }, { 0x8b, 0x89 }, { 0x1f, 0x19 }, { 0x3b, 0x19 } };
+const uint8_t HQ_PLAIN_90[4][2] = { { 0x7e, 0x2a }, { 0xef, 0xab }, { 0xbf, 0x8f }, { 0x7e, 0x0e } };
+const uint8_t HQ_PLAIN_10[6][2] = { { 0xfb, 0x6a }, { 0x6f, 0x6e }, { 0x3f, 0x3e }, { 0xfb, 0xfa }, { 0xdf, 0xde }, { 0xdf, 0x1e } };
+const uint8_t HQ_DIAGONAL_20[8][2] = {
+	{ 0x4f, 0x4b }, { 0x9f, 0x1b }, { 0x2f, 0x0b }, { 0xbe, 0x0a }, { 0xee, 0x0a }, { 0x7e, 0x0a }, { 0xeb, 0x4b }, { 0x3b, 0x1b }
+};
+
+inline bool _is(int pattern, int mask, int value)
+{
+	return (pattern & mask) == value;
+}
+
+template<size_t N>
+bool _any(int pattern, const uint8_t (&cases)[N][2])
+{
+	for(size_t i = 0; i < N; i++)
+		if(_is(pattern, cases[i][0], cases[i][1]))
+			return true;
+	return false;
+}
+
+int _pairBit(int a, int b)
+{
+	if(a > b)
+		std::swap(a, b);
+	if(a == B)
+		return b == D ? HQ_BD : HQ_BF;
+	return a == D ? HQ_DH : HQ_FH;
+}
+
+//top left pixel of hq2x, p is the diff mask as seen from the corner and the flags tell
+//whether those edge neighbours differ from each other
+int _hqRule(int p, bool diffBF, bool diffHD, bool diffDB)
+{
+	bool up = _is(p, 0xbf, 0x37) || _is(p, 0xdb, 0x13);
+	bool left = _is(p, 0xdb, 0x49) || _is(p, 0xef, 0x6d);
+	if(up && diffBF)
+		return HQ_11;
+	if(left && diffHD)
+		return HQ_12;
+	if((_is(p, 0x0b, 0x0b) || _is(p, 0xfe, 0x4a) || _is(p, 0xfe, 0x1a)) && diffDB)
+		return HQ_0;
+	if(_any(p, HQ_DIAGONAL_10) && diffDB)
+		return HQ_10;
+	if(_is(p, 0x0b, 0x08))
+		return HQ_21;
+	if(_is(p, 0x0b, 0x02))
+		return HQ_22;
+	if(_is(p, 0x2f, 0x2f))
+		return HQ_100;
+	if(up)
+		return HQ_60;
+	if(left)
+		return HQ_61;
+	if(_any(p, HQ_PLAIN_11))
+		return HQ_11;
+	if(_any(p, HQ_PLAIN_12))
+		return HQ_12;
+	if(_any(p, HQ_PLAIN_90))
+		return HQ_90;
+	if(_any(p, HQ_PLAIN_10))
+		return HQ_10;
+	if(_is(p, 0x0a, 0x00))
+		return HQ_20;
+	if(_any(p, HQ_DIAGONAL_20))
+		return HQ_20_DIAGONAL;
+	return HQ_70;
+}
+
+int _cornerRule(int pattern, int pairs, const uint8_t* frame)
+{
+	int p = 0;
+	for(int cell = 0; cell < 9; cell++)
+		if(cell != E && (pattern & _maskBit(frame[cell])))
+			p |= _maskBit(cell);
+	bool diffBF = (pairs & _pairBit(frame[B], frame[F])) != 0;
+	bool diffHD = (pairs & _pairBit(frame[H], frame[D])) != 0;
+	bool diffDB = (pairs & _pairBit(frame[D], frame[B])) != 0;
+	return _hqRule(p, diffBF, diffHD, diffDB);
+}
+
+//weighted sum of up to four neighbours, weights add up to 16
+struct HqBlend
+{
+	uint8_t count;
+	uint8_t cells[4];
+	uint8_t weights[4];
+};
+
+struct HqTables
+{
+	HqTables();
+	void buildBlends(int factor);
+
+	uint8_t rules[256][HQ_PAIRS][4]; //per pattern, differing pairs and corner
+	uint8_t pairs[256];              //pairs the rules of a pattern ask for
+	std::vector<HqBlend> blends[5];  //per factor: 256 * HQ_PAIRS * factor * factor
+};
+
+HqTables::HqTables()
+{
+	for(int pattern = 0; pattern < 256; pattern++)
+	{
+		for(int diffs = 0; diffs < HQ_PAIRS; diffs++)
+			for(int k = 0; k < 4; k++)
+				rules[pattern][diffs][k] = _cornerRule(pattern, diffs, HQ_FRAMES[k]);
+		pairs[pattern] = 0;
+		for(int pair = 1; pair < HQ_PAIRS; pair <<= 1)
+			for(int diffs = 0; diffs < HQ_PAIRS; diffs++)
+				if(memcmp(rules[pattern][diffs], rules[pattern][diffs | pair], 4) != 0)
+					pairs[pattern] |= pair;
+	}
+
+	for(int factor = 2; factor <= 4; factor++)
+		buildBlends(factor);
+}
+
+//adds the kernel of a corner to the weights, mapped from its frame
+void _addKernel(const uint8_t* kernel, const uint8_t* frame, int* weights)
+{
+	weights[frame[E]] += kernel[0];
+	weights[frame[A]] += kernel[1];
+	weights[frame[B]] += kernel[2];
+	weights[frame[D]] += kernel[3];
+}
+
+//edge pixel of hq3x between two corners, next to the edge neighbour cell
+void _addEdge(int pattern, int cell, int rule1, int rule2, int* weights)
+{
+	int diagonals = (rule1 == HQ_20_DIAGONAL || rule1 == HQ_90) + (rule2 == HQ_20_DIAGONAL || rule2 == HQ_90);
+	int weight = !(pattern & _maskBit(cell)) ? 4 : diagonals * 2;
+	weights[E] += 16 - weight;
+	weights[cell] += weight;
+}
+
+void HqTables::buildBlends(int factor)
+{
+	std::vector<HqBlend>& table = blends[factor];
+	table.resize(256 * HQ_PAIRS * factor * factor);
+	for(int pattern = 0; pattern < 256; pattern++)
+		for(int diffs = 0; diffs < HQ_PAIRS; diffs++)
+		{
+			const uint8_t* rule = rules[pattern][diffs];
+			for(int sy = 0; sy < factor; sy++)
+				for(int sx = 0; sx < factor; sx++)
+				{
+					int weights[9] = { 0 };
+					//corner seen from this pixel and the position in its frame
+					int corner = (2 * sx >= factor ? 1 : 0) + (2 * sy >= factor ? 2 : 0);
+					int fx = (corner & 1) ? factor - 1 - sx : sx;
+					int fy = (corner & 2) ? factor - 1 - sy : sy;
+					if(factor == 2)
+						_addKernel(HQ_KERNELS[rule[corner]][0], HQ_FRAMES[corner], weights);
+					else if(factor == 4)
+						_addKernel(HQ_KERNELS[rule[corner]][2 + fy * 2 + fx], HQ_FRAMES[corner], weights);
+					else if(sx == 1 && sy == 1)
+						weights[E] = 16;
+					else if(sx == 1)
+						_addEdge(pattern, sy == 0 ? B : H, rule[sy == 0 ? 0 : 2], rule[sy == 0 ? 1 : 3], weights);
+					else if(sy == 1)
+						_addEdge(pattern, sx == 0 ? D : F, rule[sx == 0 ? 0 : 1], rule[sx == 0 ? 2 : 3], weights);
+					else
+						_addKernel(HQ_KERNELS[rule[corner]][1], HQ_FRAMES[corner], weights);
+
+					HqBlend& blend = table[((pattern * HQ_PAIRS + diffs) * factor + sy) * factor + sx];
+					blend.count = 0;
+					for(int cell = 0; cell < 9; cell++)
+						if(weights[cell] > 0)
+						{
+							blend.cells[blend.count] = cell;
+							blend.weights[blend.count] = weights[cell];
+							blend.count++;
+						}
+				}
+		}
+}
+
+//built once at start up
+static const HqTables sHqTables;
+
+inline uint32_t _blend(const uint32_t* n, const HqBlend& blend)
+{
+	if(blend.count == 1)
+		return n[blend.cells[0]];
+
+	//two bytes at a time, weights add up to 16 so the sums fit their 16 bits
+	uint32_t rb = 0;
+	uint32_t ag = 0;
+	for(int i = 0; i < blend.count; i++)
+	{
+		uint32_t c = n[blend.cells[i]];
+		rb += (c & 0x00FF00FF) * blend.weights[i];
+		ag += ((c >> 8) & 0x00FF00FF) * blend.weights[i];
+	}
+	return ((rb >> 4) & 0x00FF00FF) | (((ag >> 4) & 0x00FF00FF) << 8);
+}
+
+//****** SCALING ******
+
+void _hqRows(const PixelPlane& source, const Plane<uint8_t>& mask, PixelPlane& dest, int factor, int y0, int y1, Scratch& scratch)
+{
+	//too large for the stack of some worker threads
+	HqDiffCache& cache = *new(scratch.get<HqDiffCache>(1)) HqDiffCache();
+	const HqBlend* blends = &sHqTables.blends[factor][0];
+	int w = source.width;
+	uint32_t n[9];
+	for(int y = y0; y < y1; y++)
+	{
+		const uint32_t* r0 = source.row(std::max(y - 1, 0));
+		const uint32_t* r1 = source.row(y);
+		const uint32_t* r2 = source.row(std::min(y + 1, source.height - 1));
+		const uint8_t* bits = mask.row(y);
+		uint32_t* out[4];
+		for(int i = 0; i < factor; i++)
+			out[i] = dest.row(y * factor + i);
+
+		for(int x = 0; x < w; x++)
+		{
+			int xl = std::max(x - 1, 0);
+			int xr = std::min(x + 1, w - 1);
+			n[A] = r0[xl]; n[B] = r0[x]; n[C] = r0[xr];
+			n[D] = r1[xl]; n[E] = r1[x]; n[F] = r1[xr];
+			n[G] = r2[xl]; n[H] = r2[x]; n[I] = r2[xr];
+
+			//with the edge neighbours equal to E every rule gives E
+			if(n[B] == n[E] && n[D] == n[E] && n[F] == n[E] && n[H] == n[E])
+			{
+				for(int sy = 0; sy < factor; sy++)
+					for(int sx = 0; sx < factor; sx++)
+						out[sy][x * factor + sx] = n[E];
+				continue;
+			}
+
+			int pattern = bits[x];
+			int ask = sHqTables.pairs[pattern];
+			int diffs = 0;
+			if((ask & HQ_BD) && cache.differs(n[B], n[D]))
+				diffs |= HQ_BD;
+			if((ask & HQ_BF) && cache.differs(n[B], n[F]))
+				diffs |= HQ_BF;
+			if((ask & HQ_DH) && cache.differs(n[D], n[H]))
+				diffs |= HQ_DH;
+			if((ask & HQ_FH) && cache.differs(n[F], n[H]))
+				diffs |= HQ_FH;
+
+			const HqBlend* blend = blends + (pattern * HQ_PAIRS + diffs) * factor * factor;
+			for(int sy = 0; sy < factor; sy++)
+				for(int sx = 0; sx < factor; sx++)
+					out[sy][x * factor + sx] = _blend(n, blend[sy * factor + sx]);
+		}
+	}
+}
+
+struct HqBands
+{
+	HqBands(const PixelPlane& src, const Plane<uint8_t>& diffMask, PixelPlane& dst, int scaleFactor, int bandHeight)
+	:	source(src), mask(diffMask), dest(dst), factor(scaleFactor), rows(bandHeight) {}
+	void operator()(int band, Scratch& scratch) const
+	{
+		_hqRows(source, mask, dest, factor, band * rows, std::min((band + 1) * rows, source.height), scratch);
+	}
+	const PixelPlane& source;
+	const Plane<uint8_t>& mask;
+	PixelPlane& dest;
+	int factor;
+	int rows;
+};
+
+void pp::hqScale(const PixelPlane& source, PixelPlane& dest, int factor, ExecutionContext* context)
+{
+	factor = std::min(4, std::max(2, factor));
+	dest.resize(source.width * factor, source.height * factor);
+
+	Plane<uint8_t> mask;
+	hqDiffMask(source, mask);
+
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	int rows = ctx.tileHeight();
+	ctx.parallelFor((source.height + rows - 1) / rows, HqBands(source, mask, dest, factor, rows));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Plane.h"
+#include "ExecutionContext.h"
+
+namespace pp
+{
+	//Colors differ when their YUV distance exceeds the hqx thresholds. Results are cached
+	//per packed RGB pair since pixel art keeps comparing the same few colors.
+	class HqDiffCache
+	{
+	public:
+		HqDiffCache();
+		bool differs(uint32_t a, uint32_t b);
+		static bool compute(uint32_t a, uint32_t b);
+
+	private:
+		enum { SIZE = 4096 };
+		uint64_t mKeys[SIZE];
+		bool mDiffers[SIZE];
+	};
+
+	//Builds the byte plane of "neighbour differs from center" bits, one bit per cell of
+	//the 3x3 neighbourhood (A = 0x01, B = 0x02, C = 0x04, D = 0x08, F = 0x10, G = 0x20, H = 0x40, I = 0x80)
+	void hqDiffMask(const PixelPlane& source, Plane<uint8_t>& mask);
+
+	//hq2x, hq3x or hq4x for factor 2, 3 or 4: each output pixel is blended from its neighbourhood
+	//by the hqx case of the diff mask. All four bytes are blended, anything packed into the
+	//upper byte (e.g. alpha) is mixed like the colors.
+	void hqScale(const PixelPlane& source, PixelPlane& dest, int factor, ExecutionContext* context = NULL);
+}
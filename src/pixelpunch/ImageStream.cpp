@@ -0,0 +1,233 @@
+#include "PixelPunch.h"
+#include "ImageStream.h"
+#include <sstream>
+#include <cstring>
+
+using namespace cinder;
+using namespace pp;
+
+bool pp::readPamHeader(std::istream& in, PamHeader& header)
+{
+	header = PamHeader();
+	std::string line;
+	if(!std::getline(in, line) || line.compare(0, 2, "P7") != 0)
+		return false;
+
+	int maxVal = 0;
+	while(std::getline(in, line))
+	{
+		if(line.empty() || line[0] == '#')
+			continue;
+		std::istringstream tokens(line);
+		std::string key;
+		tokens >> key;
+		if(key == "WIDTH")
+			tokens >> header.width;
+		else if(key == "HEIGHT")
+			tokens >> header.height;
+		else if(key == "DEPTH")
+			tokens >> header.depth;
+		else if(key == "MAXVAL")
+			tokens >> maxVal;
+		else if(key == "ENDHDR")
+		{
+			header.dataOffset = (size_t)in.tellg();
+			return header.width > 0 && header.height > 0 && maxVal == 255 && (header.depth == 3 || header.depth == 4);
+		}
+	}
+	return false;
+}
+
+std::string pp::formatPamHeader(int width, int height, int depth, size_t alignment)
+{
+	std::ostringstream out;
+	out << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH " << depth << "\nMAXVAL 255\nTUPLTYPE " << (depth == 4 ? "RGB_ALPHA" : "RGB") << "\n";
+	std::string header = out.str();
+
+	const std::string end = "ENDHDR\n";
+	if(alignment > 1)
+	{
+		size_t padding = (alignment - (header.size() + end.size()) % alignment) % alignment;
+		if(padding == 1) //a comment line needs at least '#' and '\n'
+			padding += alignment;
+		if(padding > 0)
+			header += "#" + std::string(padding - 2, ' ') + "\n";
+	}
+	return header + end;
+}
+
+void pp::unpackRow(const uint8_t* src, int depth, Surface& dest, int destY)
+{
+	uint8_t* line = dest.getData() + destY * dest.getRowBytes();
+	int inc = dest.getPixelInc();
+	int width = dest.getWidth();
+	if(inc == depth && dest.getRedOffset() == 0 && dest.getGreenOffset() == 1 && dest.getBlueOffset() == 2 && (depth == 3 || dest.getAlphaOffset() == 3))
+	{
+		memcpy(line, src, width * depth);
+		return;
+	}
+
+	int r = dest.getRedOffset();
+	int g = dest.getGreenOffset();
+	int b = dest.getBlueOffset();
+	int a = dest.hasAlpha() ? dest.getAlphaOffset() : -1;
+	for(int x = 0; x < width; x++, src += depth, line += inc)
+	{
+		line[r] = src[0];
+		line[g] = src[1];
+		line[b] = src[2];
+		if(a >= 0)
+			line[a] = (depth == 4) ? src[3] : 255;
+	}
+}
+
+void pp::packRow(const Surface& src, int srcY, uint8_t* dest, int depth)
+{
+	const uint8_t* line = src.getData() + srcY * src.getRowBytes();
+	int inc = src.getPixelInc();
+	int width = src.getWidth();
+	if(inc == depth && src.getRedOffset() == 0 && src.getGreenOffset() == 1 && src.getBlueOffset() == 2 && (depth == 3 || src.getAlphaOffset() == 3))
+	{
+		memcpy(dest, line, width * depth);
+		return;
+	}
+
+	int r = src.getRedOffset();
+	int g = src.getGreenOffset();
+	int b = src.getBlueOffset();
+	int a = src.hasAlpha() ? src.getAlphaOffset() : -1;
+	for(int x = 0; x < width; x++, dest += depth, line += inc)
+	{
+		dest[0] = line[r];
+		dest[1] = line[g];
+		dest[2] = line[b];
+		if(depth == 4)
+			dest[3] = (a >= 0) ? line[a] : 255;
+	}
+}
+
+//****** READERS & WRITERS ******
+
+bool SurfaceRowReader::readRow(int y, Surface& dest, int destY)
+{
+	if(y < 0 || y >= mSource.getHeight() || dest.getWidth() != mSource.getWidth())
+		return false;
+
+	const uint8_t* src = mSource.getData() + y * mSource.getRowBytes();
+	uint8_t* dst = dest.getData() + destY * dest.getRowBytes();
+	if(dest.getChannelOrder().getCode() == mSource.getChannelOrder().getCode())
+	{
+		memcpy(dst, src, mSource.getWidth() * mSource.getPixelInc());
+		return true;
+	}
+	for(int x = 0; x < mSource.getWidth(); x++, src += mSource.getPixelInc(), dst += dest.getPixelInc())
+	{
+		dst[dest.getRedOffset()] = src[mSource.getRedOffset()];
+		dst[dest.getGreenOffset()] = src[mSource.getGreenOffset()];
+		dst[dest.getBlueOffset()] = src[mSource.getBlueOffset()];
+		if(dest.hasAlpha())
+			dst[dest.getAlphaOffset()] = mSource.hasAlpha() ? src[mSource.getAlphaOffset()] : 255;
+	}
+	return true;
+}
+
+PamReader::PamReader(const std::string& path)
+:	mFile(path.c_str(), std::ios::in | std::ios::binary)
+{
+	if(!mFile || !readPamHeader(mFile, mHeader))
+		mHeader = PamHeader();
+	mRow.resize(mHeader.rowBytes());
+}
+
+bool PamReader::readRow(int y, Surface& dest, int destY)
+{
+	if(!isOpen() || y < 0 || y >= mHeader.height || dest.getWidth() != mHeader.width)
+		return false;
+
+	mFile.seekg(mHeader.dataOffset + y * mHeader.rowBytes());
+	if(!mFile.read((char*)&mRow[0], mRow.size()))
+		return false;
+	unpackRow(&mRow[0], mHeader.depth, dest, destY);
+	return true;
+}
+
+PamWriter::PamWriter(const std::string& path, int width, int height, bool alpha)
+:	mFile(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+	mDepth(alpha ? 4 : 3)
+{
+	mFile << formatPamHeader(width, height, mDepth);
+	mRow.resize(width * mDepth);
+}
+
+bool PamWriter::writeRow(const Surface& src, int srcY)
+{
+	if((int)mRow.size() != src.getWidth() * mDepth)
+		return false;
+	packRow(src, srcY, &mRow[0], mDepth);
+	return (bool)mFile.write((const char*)&mRow[0], mRow.size());
+}
+
+//****** STREAMING ******
+
+bool pp::scaleStream(RowReader& source, ScaleMethod method, RowWriter& dest, size_t memoryLimit, ExecutionContext* context)
+{
+	int width = source.width();
+	int height = source.height();
+	if(width <= 0 || height <= 0)
+		return false;
+
+	int factor = scaleFactor(method);
+	int halo = scaleHalo(method);
+	//window row + scaled rows (+ the 2x temp of the chained 4x methods) per source row
+	size_t rowBytes = width * (source.hasAlpha() ? 4 : 3);
+	size_t perRow = rowBytes * (1 + factor * factor + (factor == 4 ? 4 : 0));
+	int band = std::max(1, (int)(memoryLimit / perRow) - 2 * halo);
+	//the cleanups of the HQ methods can reach across band borders
+	if(!scaleIsLocal(method))
+	{
+		band = height;
+		halo = 0;
+	}
+	band = std::min(band, height);
+
+	Surface window(width, band + 2 * halo, source.hasAlpha());
+	for(int y0 = 0; y0 < height; y0 += band)
+	{
+		int first = 0;
+		if(y0 > 0)
+		{
+			//the halo rows overlapping the previous band move to the top of the window
+			for(int i = 0; i < 2 * halo; i++)
+				memcpy(window.getData() + i * window.getRowBytes(), window.getData() + (band + i) * window.getRowBytes(), window.getRowBytes());
+			first = 2 * halo;
+		}
+		for(int i = first; i < window.getHeight(); i++)
+		{
+			//clamping rows at the image borders matches what Kernel does
+			int y = constrain(y0 - halo + i, 0, height - 1);
+			if(!source.readRow(y, window, i))
+				return false;
+		}
+
+		Surface scaled = pp::scale(window, method, context);
+		int rows = std::min(band, height - y0);
+		for(int y = halo * factor; y < (halo + rows) * factor; y++)
+			if(!dest.writeRow(scaled, y))
+				return false;
+	}
+	return true;
+}
+
+bool pp::scaleFile(const std::string& sourcePath, ScaleMethod method, const std::string& destPath, size_t memoryLimit, ExecutionContext* context)
+{
+	PamReader reader(sourcePath);
+	if(!reader.isOpen())
+		return false;
+
+	int factor = scaleFactor(method);
+	PamWriter writer(destPath, reader.width() * factor, reader.height() * factor, reader.hasAlpha());
+	if(!writer.isOpen())
+		return false;
+
+	return scaleStream(reader, method, writer, memoryLimit, context);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "PixelScale.h"
+#include <string>
+#include <fstream>
+
+namespace pp
+{
+	//Uncompressed PAM (P7) header, DEPTH 3 = RGB, DEPTH 4 = RGB_ALPHA, MAXVAL 255 only
+	struct PamHeader
+	{
+		PamHeader() : width(0), height(0), depth(0), dataOffset(0) {}
+		int width;
+		int height;
+		int depth;
+		size_t dataOffset; //bytes from the start of the file to the first pixel
+		size_t rowBytes() const { return (size_t)width * depth; }
+	};
+
+	bool readPamHeader(std::istream& in, PamHeader& header);
+	//pads the header with a comment so the pixel data starts at a multiple of alignment
+	std::string formatPamHeader(int width, int height, int depth, size_t alignment = 1);
+
+	//copy rows between tightly packed RGB(A) bytes and a Surface of any channel order
+	void unpackRow(const uint8_t* src, int depth, cinder::Surface& dest, int destY);
+	void packRow(const cinder::Surface& src, int srcY, uint8_t* dest, int depth);
+
+	class RowReader
+	{
+	public:
+		virtual ~RowReader() {}
+		virtual int width() const = 0;
+		virtual int height() const = 0;
+		virtual bool hasAlpha() const = 0;
+		virtual bool readRow(int y, cinder::Surface& dest, int destY) = 0;
+	};
+
+	class RowWriter
+	{
+	public:
+		virtual ~RowWriter() {}
+		virtual bool writeRow(const cinder::Surface& src, int srcY) = 0;
+	};
+
+	class SurfaceRowReader : public RowReader
+	{
+	public:
+		SurfaceRowReader(cinder::Surface& source) : mSource(source) {}
+		int width() const { return mSource.getWidth(); }
+		int height() const { return mSource.getHeight(); }
+		bool hasAlpha() const { return mSource.hasAlpha(); }
+		bool readRow(int y, cinder::Surface& dest, int destY);
+	private:
+		cinder::Surface mSource;
+	};
+
+	class PamReader : public RowReader
+	{
+	public:
+		PamReader(const std::string& path);
+		bool isOpen() const { return mHeader.width > 0; }
+		int width() const { return mHeader.width; }
+		int height() const { return mHeader.height; }
+		bool hasAlpha() const { return mHeader.depth == 4; }
+		bool readRow(int y, cinder::Surface& dest, int destY);
+	private:
+		std::ifstream mFile;
+		PamHeader mHeader;
+		std::vector<uint8_t> mRow;
+	};
+
+	class PamWriter : public RowWriter
+	{
+	public:
+		PamWriter(const std::string& path, int width, int height, bool alpha);
+		bool isOpen() const { return mFile.good(); }
+		bool writeRow(const cinder::Surface& src, int srcY);
+	private:
+		std::ofstream mFile;
+		int mDepth;
+		std::vector<uint8_t> mRow;
+	};
+
+	//Scales source in bands of full rows. Only the band, the halo rows the method needs
+	//and the scaled band are kept in memory, so peak usage stays around memoryLimit no
+	//matter how tall the image is. Scaled rows are passed to dest as soon as they exist.
+	//Methods that aren't scaleIsLocal are scaled as one band, memoryLimit doesn't hold for them.
+	bool scaleStream(RowReader& source, ScaleMethod method, RowWriter& dest, size_t memoryLimit = 64 << 20, ExecutionContext* context = NULL);
+	bool scaleFile(const std::string& sourcePath, ScaleMethod method, const std::string& destPath, size_t memoryLimit = 64 << 20, ExecutionContext* context = NULL);
+}
@@ -0,0 +1,74 @@
+#include "ImageView.h"
+#include <cassert>
+
+using namespace cinder;
+using namespace pp;
+
+int _channelOrder(PixelFormat format)
+{
+	switch(format)
+	{
+	case PF_RGB: return SurfaceChannelOrder::RGB;
+	case PF_BGR: return SurfaceChannelOrder::BGR;
+	case PF_RGBA: return SurfaceChannelOrder::RGBA;
+	case PF_BGRA: return SurfaceChannelOrder::BGRA;
+	case PF_ARGB: return SurfaceChannelOrder::ARGB;
+	case PF_ABGR: return SurfaceChannelOrder::ABGR;
+	case PF_RGBX: return SurfaceChannelOrder::RGBX;
+	case PF_BGRX: return SurfaceChannelOrder::BGRX;
+	case PF_XRGB: return SurfaceChannelOrder::XRGB;
+	case PF_XBGR: return SurfaceChannelOrder::XBGR;
+	}
+	return SurfaceChannelOrder::RGBA;
+}
+
+PixelFormat _pixelFormat(const SurfaceChannelOrder& order)
+{
+	switch(order.getCode())
+	{
+	case SurfaceChannelOrder::RGB: return PF_RGB;
+	case SurfaceChannelOrder::BGR: return PF_BGR;
+	case SurfaceChannelOrder::RGBA: return PF_RGBA;
+	case SurfaceChannelOrder::BGRA: return PF_BGRA;
+	case SurfaceChannelOrder::ARGB: return PF_ARGB;
+	case SurfaceChannelOrder::ABGR: return PF_ABGR;
+	case SurfaceChannelOrder::RGBX: return PF_RGBX;
+	case SurfaceChannelOrder::BGRX: return PF_BGRX;
+	case SurfaceChannelOrder::XRGB: return PF_XRGB;
+	case SurfaceChannelOrder::XBGR: return PF_XBGR;
+	}
+	assert(false);
+	return PF_RGBA;
+}
+
+ImageView::ImageView()
+:	data(NULL), width(0), height(0), stride(0), format(PF_RGBA)
+{
+}
+
+ImageView::ImageView(uint8_t* pixels, int w, int h, ptrdiff_t rowStride, PixelFormat pixelFormat)
+:	data(pixels), width(w), height(h), stride(rowStride), format(pixelFormat)
+{
+}
+
+ImageView::ImageView(Surface& surface)
+:	data(surface.getData()), width(surface.getWidth()), height(surface.getHeight()), stride(surface.getRowBytes()), format(_pixelFormat(surface.getChannelOrder()))
+{
+}
+
+int ImageView::pixelBytes() const
+{
+	return format == PF_RGB || format == PF_BGR ? 3 : 4;
+}
+
+bool ImageView::hasAlpha() const
+{
+	return format == PF_RGBA || format == PF_BGRA || format == PF_ARGB || format == PF_ABGR;
+}
+
+Surface ImageView::surface() const
+{
+	if(empty())
+		return Surface();
+	return Surface(data, width, height, stride, SurfaceChannelOrder(_channelOrder(format)));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+
+namespace pp
+{
+	//byte order of a pixel in memory, X is a padding byte
+	enum PixelFormat {
+		PF_RGB,
+		PF_BGR,
+		PF_RGBA,
+		PF_BGRA,
+		PF_ARGB,
+		PF_ABGR,
+		PF_RGBX,
+		PF_BGRX,
+		PF_XRGB,
+		PF_XBGR
+	};
+	typedef enum PixelFormat PixelFormat;
+
+	//Pixels owned by the caller, e.g. an engine frame, a mapped file or a pooled buffer.
+	//Copying a view doesn't copy pixels, the memory has to outlive all calls using it.
+	//Rows can be padded, stride is the distance between them in bytes.
+	struct ImageView
+	{
+		ImageView();
+		ImageView(uint8_t* pixels, int w, int h, ptrdiff_t rowStride, PixelFormat pixelFormat);
+		//refers to the pixels of surface, which has to stay alive
+		ImageView(cinder::Surface& surface);
+
+		int pixelBytes() const;
+		bool hasAlpha() const;
+		bool empty() const { return !data || width <= 0 || height <= 0; }
+		uint8_t* row(int y) const { return data + y * stride; }
+		//a Surface referring to the same pixels, e.g. to construct a sampler
+		cinder::Surface surface() const;
+
+		uint8_t* data;
+		int width;
+		int height;
+		ptrdiff_t stride;
+		PixelFormat format;
+	};
+}
@@ -0,0 +1,212 @@
+#include "IndexedImage.h"
+#include <algorithm>
+#include <utility>
+
+using namespace cinder;
+using namespace pp;
+
+bool IndexedImage::hasAlpha() const
+{
+	for(size_t i = 0; i < colors.size(); i++)
+		if((colors[i] >> 24) != 0xFF)
+			return true;
+	return false;
+}
+
+void pp::mergeDuplicates(IndexedImage& image)
+{
+	std::vector<uint32_t> colors;
+	std::vector<uint32_t> remap(image.colors.size());
+	bool merged = false;
+	for(size_t i = 0; i < image.colors.size(); i++)
+	{
+		std::vector<uint32_t>::iterator found = std::find(colors.begin(), colors.end(), image.colors[i]);
+		remap[i] = (uint32_t)(found - colors.begin());
+		if(found == colors.end())
+			colors.push_back(image.colors[i]);
+		else
+			merged = true;
+	}
+	if(!merged)
+		return;
+	//indices past the palette are left alone, expand treats them as black
+	for(size_t i = 0; i < image.indices.pixels.size(); i++)
+	{
+		uint32_t& index = image.indices.pixels[i];
+		if(index < remap.size())
+			index = remap[index];
+	}
+	image.colors.swap(colors);
+}
+
+bool pp::scalesIndices(ScaleMethod method)
+{
+	return method < SM_HQ2x;
+}
+
+bool pp::scale(const IndexedImage& source, ScaleMethod method, IndexedImage& result, bool untilStable, ExecutionContext* context)
+{
+	if(!scalesIndices(method))
+		return false;
+	//scaling colors ignores alpha, so entries differing only in it have to compare equal too.
+	//Each index is replaced by the first one with its RGB.
+	std::vector<uint32_t> first(source.colors.size());
+	bool classes = false;
+	for(size_t i = 0; i < source.colors.size(); i++)
+	{
+		first[i] = (uint32_t)i;
+		for(size_t j = 0; j < i; j++)
+			if(((source.colors[i] ^ source.colors[j]) & 0x00FFFFFF) == 0)
+			{
+				first[i] = (uint32_t)j;
+				classes = true;
+				break;
+			}
+	}
+	PixelPlane merged;
+	if(classes)
+	{
+		merged = source.indices;
+		for(size_t i = 0; i < merged.pixels.size(); i++)
+			if(merged.pixels[i] < first.size())
+				merged.pixels[i] = first[merged.pixels[i]];
+	}
+
+	//result may be the source
+	PixelPlane indices;
+	scale(classes ? merged : source.indices, method, indices, untilStable, context);
+	result.colors = source.colors;
+	result.indices = std::move(indices);
+	return true;
+}
+
+void pp::expand(const IndexedImage& source, Surface& result)
+{
+	if(!result.getData() || result.getWidth() != source.width() || result.getHeight() != source.height())
+		result = Surface(source.width(), source.height(), source.hasAlpha());
+	uint32_t colors[IndexedImage::MAX_COLORS] = {};
+	std::copy(source.colors.begin(), source.colors.begin() + std::min(source.colors.size(), IndexedImage::MAX_COLORS), colors);
+	int inc = result.getPixelInc();
+	int r = result.getRedOffset();
+	int g = result.getGreenOffset();
+	int b = result.getBlueOffset();
+	int a = result.hasAlpha() ? result.getAlphaOffset() : -1;
+	for(int y = 0; y < source.height(); y++)
+	{
+		uint8_t* line = result.getData() + y * result.getRowBytes();
+		const uint32_t* src = source.indices.row(y);
+		for(int x = 0; x < source.width(); x++, line += inc)
+		{
+			uint32_t color = src[x] < IndexedImage::MAX_COLORS ? colors[src[x]] : 0;
+			line[r] = 0xFF & (color >> 16);
+			line[g] = 0xFF & (color >> 8);
+			line[b] = 0xFF & color;
+			if(a >= 0)
+				line[a] = color >> 24;
+		}
+	}
+}
+
+//open addressing, twice as many slots as colors so probes stay short
+struct ColorTable
+{
+	static const int SLOTS = 2 * IndexedImage::MAX_COLORS;
+
+	ColorTable() : used(SLOTS, false), keys(SLOTS), values(SLOTS) {}
+
+	uint32_t* find(uint32_t color, bool& added)
+	{
+		uint32_t slot = (color * 2654435761u) >> 23; //top 9 bits
+		while(used[slot] && keys[slot] != color)
+			slot = (slot + 1) & (SLOTS - 1);
+		added = !used[slot];
+		used[slot] = true;
+		keys[slot] = color;
+		return &values[slot];
+	}
+
+	std::vector<bool> used;
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> values;
+};
+
+bool pp::index(const Surface& source, IndexedImage& result, size_t maxColors)
+{
+	maxColors = std::min(maxColors, IndexedImage::MAX_COLORS);
+	result.indices.resize(source.getWidth(), source.getHeight());
+	result.colors.clear();
+	ColorTable table;
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	int a = source.hasAlpha() ? source.getAlphaOffset() : -1;
+	//runs of one color are common in pixel art, they skip the table
+	uint32_t last = 0;
+	uint32_t lastIndex = 0;
+	bool haveLast = false;
+	for(int y = 0; y < result.height(); y++)
+	{
+		const uint8_t* line = source.getData() + y * source.getRowBytes();
+		uint32_t* dst = result.indices.row(y);
+		for(int x = 0; x < result.width(); x++, line += inc)
+		{
+			uint32_t color = ((a >= 0 ? line[a] : 0xFF) << 24) | (line[r] << 16) | (line[g] << 8) | line[b];
+			if(!haveLast || color != last)
+			{
+				bool added;
+				uint32_t* index = table.find(color, added);
+				if(added)
+				{
+					if(result.colors.size() == maxColors)
+					{
+						result.colors.clear();
+						result.indices.resize(0, 0);
+						return false;
+					}
+					*index = (uint32_t)result.colors.size();
+					result.colors.push_back(color);
+				}
+				last = color;
+				lastIndex = *index;
+				haveLast = true;
+			}
+			dst[x] = lastIndex;
+		}
+	}
+	return true;
+}
+
+void pp::getColors(const IndexedImage& source, Palette& result)
+{
+	//getColors walks columns, find where each index first shows up in that order with one
+	//pass over the rows
+	const size_t NONE = (size_t)-1;
+	std::vector<size_t> first(IndexedImage::MAX_COLORS, NONE);
+	int height = source.height();
+	for(int y = 0; y < height; y++)
+	{
+		const uint32_t* src = source.indices.row(y);
+		for(int x = 0; x < source.width(); x++)
+			if(src[x] < IndexedImage::MAX_COLORS)
+				first[src[x]] = std::min(first[src[x]], (size_t)x * height + y);
+	}
+	std::vector<std::pair<size_t, uint32_t> > order;
+	for(size_t i = 0; i < first.size(); i++)
+		if(first[i] != NONE)
+			order.push_back(std::make_pair(first[i], i < source.colors.size() ? source.colors[i] : 0));
+	std::sort(order.begin(), order.end());
+
+	//like getColors alpha is ignored, entries differing only in it are one color
+	result.clear();
+	for(size_t i = 0; i < order.size(); i++)
+	{
+		Color8u color(0xFF & (order[i].second >> 16), 0xFF & (order[i].second >> 8), 0xFF & order[i].second);
+		bool found = false;
+		for(Palette::iterator it = result.begin(); it != result.end(); it++)
+			if(*it == color)
+				found = true;
+		if(!found)
+			result.push_back(color);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "Plane.h"
+#include "PixelPunch.h"
+#include "PixelScale.h"
+#include <vector>
+
+namespace pp
+{
+	//A paletted image kept as palette indices and the colors they stand for, the way paletted
+	//PNGs store it. The equality based scalers run on the indices directly, so paletted sources
+	//are scaled and written without ever being expanded to colors.
+	struct IndexedImage
+	{
+		static const size_t MAX_COLORS = 256;
+
+		bool empty() const { return indices.pixels.empty(); }
+		int width() const { return indices.width; }
+		int height() const { return indices.height; }
+		bool hasAlpha() const; //some color isn't opaque
+		size_t bytes() const { return indices.pixels.size() * sizeof(uint32_t) + colors.size() * sizeof(uint32_t); }
+
+		PixelPlane indices;
+		std::vector<uint32_t> colors; //0xAARRGGBB, at most MAX_COLORS, no color twice
+	};
+
+	//merges entries with the same color so that equal indices mean equal colors, which the
+	//scalers rely on. Readers call it, unused entries are kept.
+	void mergeDuplicates(IndexedImage& image);
+
+	//the methods that only compare pixels for equality, the hqx methods mix colors
+	bool scalesIndices(ScaleMethod method);
+	//the same colors as scaling the expanded image, false if the method needs colors. Scaling
+	//colors ignores alpha, so entries differing only in alpha are one color here too and the
+	//result takes the first of them.
+	bool scale(const IndexedImage& source, ScaleMethod method, IndexedImage& result, bool untilStable = false, ExecutionContext* context = NULL);
+
+	//writes into result if it has the size, alpha only if result has an alpha channel
+	void expand(const IndexedImage& source, cinder::Surface& result);
+	//false if source has more than maxColors colors, alpha is taken into account if it has any
+	bool index(const cinder::Surface& source, IndexedImage& result, size_t maxColors = IndexedImage::MAX_COLORS);
+
+	//the colors in use in the same order getColors finds them in the expanded image
+	void getColors(const IndexedImage& source, Palette& result);
+}
@@ -0,0 +1,188 @@
+#include "MappedImage.h"
+#include <sstream>
+#include <cstring>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+using namespace cinder;
+using namespace pp;
+
+MappedImage::MappedImage()
+:	mView(NULL),
+	mSize(0),
+#if defined(_WIN32)
+	mFile(INVALID_HANDLE_VALUE),
+	mMapping(NULL)
+#else
+	mFile(-1)
+#endif
+{
+}
+
+MappedImage::~MappedImage()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+bool MappedImage::map(const std::string& path, size_t size, bool create)
+{
+	DWORD access = create ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+	mFile = CreateFileA(path.c_str(), access, FILE_SHARE_READ, NULL, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	if(!create)
+	{
+		LARGE_INTEGER fileSize;
+		if(!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+			return false;
+		size = (size_t)fileSize.QuadPart;
+	}
+	//creating the mapping grows a new file to size
+	unsigned long long size64 = size;
+	mMapping = CreateFileMappingA(mFile, NULL, create ? PAGE_READWRITE : PAGE_WRITECOPY, (DWORD)(size64 >> 32), (DWORD)(size64 & 0xFFFFFFFF), NULL);
+	if(!mMapping)
+		return false;
+	mView = MapViewOfFile(mMapping, create ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, size);
+	mSize = size;
+	return mView != NULL;
+}
+
+bool MappedImage::flush()
+{
+	return isOpen() && FlushViewOfFile(mView, mSize) != 0;
+}
+
+void MappedImage::close()
+{
+	if(mView)
+		UnmapViewOfFile(mView);
+	if(mMapping)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mView = NULL;
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+	mHeader = PamHeader();
+}
+
+#else
+
+bool MappedImage::map(const std::string& path, size_t size, bool create)
+{
+	mFile = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+	if(mFile < 0)
+		return false;
+
+	if(create)
+	{
+		if(ftruncate(mFile, (off_t)size) != 0)
+			return false;
+	}
+	else
+	{
+		struct stat info;
+		if(fstat(mFile, &info) != 0 || info.st_size == 0)
+			return false;
+		size = (size_t)info.st_size;
+	}
+	//sources are private so writes through surface() never reach the file
+	void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, create ? MAP_SHARED : MAP_PRIVATE, mFile, 0);
+	if(view == MAP_FAILED)
+		return false;
+	mView = view;
+	mSize = size;
+	return true;
+}
+
+bool MappedImage::flush()
+{
+	return isOpen() && msync(mView, mSize, MS_SYNC) == 0;
+}
+
+void MappedImage::close()
+{
+	if(mView)
+		munmap(mView, mSize);
+	if(mFile >= 0)
+		::close(mFile);
+	mView = NULL;
+	mFile = -1;
+	mSize = 0;
+	mHeader = PamHeader();
+}
+
+#endif
+
+bool MappedImage::open(const std::string& path)
+{
+	close();
+	if(!map(path, 0, false))
+	{
+		close();
+		return false;
+	}
+
+	//the header is text at the start of the mapping
+	std::istringstream in(std::string((const char*)mView, std::min<size_t>(mSize, 1 << 16)));
+	PamHeader header;
+	if(!readPamHeader(in, header) || header.dataOffset + header.rowBytes() * header.height > mSize)
+	{
+		close();
+		return false;
+	}
+	mHeader = header;
+	return true;
+}
+
+bool MappedImage::create(const std::string& path, int width, int height, bool alpha)
+{
+	close();
+	int depth = alpha ? 4 : 3;
+	std::string header = formatPamHeader(width, height, depth, PAGE_ALIGNMENT);
+	if(width <= 0 || height <= 0 || !map(path, header.size() + (size_t)width * height * depth, true))
+	{
+		close();
+		return false;
+	}
+
+	memcpy(mView, header.data(), header.size());
+	mHeader.width = width;
+	mHeader.height = height;
+	mHeader.depth = depth;
+	mHeader.dataOffset = header.size();
+	return true;
+}
+
+Surface MappedImage::surface()
+{
+	if(!isOpen())
+		return Surface();
+	SurfaceChannelOrder order = hasAlpha() ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB;
+	return Surface(data(), width(), height(), rowBytes(), order);
+}
+
+bool pp::writeMapped(const std::string& path, const Surface& image)
+{
+	MappedImage mapped;
+	if(!mapped.create(path, image.getWidth(), image.getHeight(), image.hasAlpha()))
+		return false;
+
+	for(int y = 0; y < image.getHeight(); y++)
+		packRow(image, y, mapped.data() + y * mapped.rowBytes(), image.hasAlpha() ? 4 : 3);
+	return mapped.flush();
+}
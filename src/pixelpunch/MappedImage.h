@@ -0,0 +1,55 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "ImageStream.h"
+#include <string>
+
+namespace pp
+{
+	//A PAM file mapped into memory. surface() aliases the mapped pixels, so samplers and
+	//scalers read from and write to the file pages directly without an intermediate copy.
+	//Sources are mapped copy-on-write: writing to them never touches the file.
+	class MappedImage
+	{
+	public:
+		static const size_t PAGE_ALIGNMENT = 4096;
+
+		MappedImage();
+		~MappedImage();
+
+		bool open(const std::string& path);
+		//creates a file with page aligned pixel data that is written through the mapping
+		bool create(const std::string& path, int width, int height, bool alpha);
+		bool flush();
+		void close();
+
+		bool isOpen() const { return mView != NULL; }
+		int width() const { return mHeader.width; }
+		int height() const { return mHeader.height; }
+		bool hasAlpha() const { return mHeader.depth == 4; }
+		size_t rowBytes() const { return mHeader.rowBytes(); }
+		uint8_t* data() { return isOpen() ? (uint8_t*)mView + mHeader.dataOffset : NULL; }
+
+		//only valid as long as the image stays mapped
+		cinder::Surface surface();
+
+	private:
+		MappedImage(const MappedImage&);
+		MappedImage& operator=(const MappedImage&);
+
+		bool map(const std::string& path, size_t size, bool create);
+
+		PamHeader mHeader;
+		void* mView;
+		size_t mSize;
+#if defined(_WIN32)
+		void* mFile;
+		void* mMapping;
+#else
+		int mFile;
+#endif
+	};
+
+	bool writeMapped(const std::string& path, const cinder::Surface& image);
+}
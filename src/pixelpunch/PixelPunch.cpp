@@ -1,16 +1,25 @@
 #include "PixelPunch.h"
 #include "Kernel.h"
+#include "ExecutionContext.h"
 #include <cassert>
 #include "CinderExtensions.h"
 
 using namespace cinder;
+using namespace pp;
 
-void pp::genDest(Surface& source, int scaleFactor, Surface& result)
+void pp::genDest(Surface& source, int scaleFactor, Surface& result, ExecutionContext*)
 {
 	int w = scaleFactor * source.getWidth();
 	int h = scaleFactor * source.getHeight();
-	bool alpha = source.hasAlpha();
-	result = Surface(w, h, alpha);
+	result = Surface(w, h, source.hasAlpha());
+}
+
+//keep storage provided by the caller if it has the right size
+void _fitResult(int width, int height, Surface& result)
+{
+	if(result.getData() && result.getWidth() == width && result.getHeight() == height)
+		return;
+	result = Surface(width, height, false);
 }
 
 void pp::getColors(cinder::Surface& source, Palette& result)
@@ -32,17 +41,12 @@ void pp::getColors(cinder::Surface& source, Palette& result)
 		}
 }
 
-Surface pp::compare(Surface& imageA, Surface& imageB)
+void _compare(Surface& imageA, Surface& imageB, Surface& result, const Area& area)
 {
-	//for each target pixel find one in source!
-	float width = std::min(imageA.getWidth(),imageB.getWidth());
-	float height = std::min(imageB.getHeight(),imageB.getHeight());
-	
 	float kernel[3][3] = {{0.0625,0.125,0.0625},{0.125,0.25,0.125},{0.0625,0.125,0.0625}};
-	Surface result(width, height, false);
 	ivec2 v(0,0);
-	for(v.x = 0; v.x < width; v.x++)
-		for(v.y = 0; v.y < height; v.y++)
+	for(v.x = area.x1; v.x < area.x2; v.x++)
+		for(v.y = area.y1; v.y < area.y2; v.y++)
 		{
 			float c[3] = {0.5,0.5,0.5};
 			for(int i = 0; i < 3; i++)
@@ -56,6 +60,42 @@ Surface pp::compare(Surface& imageA, Surface& imageB)
 				}
 				result.setPixel(v,Color8u(c[0]*255,c[1]*255,c[2]*255));
 		}
+}
+
+struct CompareBands
+{
+	CompareBands(Surface& a, Surface& b, Surface& dest, int bandHeight) : imageA(a), imageB(b), result(dest), rows(bandHeight) {}
+
+	void operator()(int band, Scratch&) const
+	{
+		_compare(imageA, imageB, result, Area(0, band * rows, result.getWidth(), std::min((band + 1) * rows, result.getHeight())));
+	}
+
+	Surface& imageA;
+	Surface& imageB;
+	Surface& result;
+	int rows;
+};
+
+Surface pp::compare(Surface& imageA, Surface& imageB, ExecutionContext* context)
+{
+	Surface result;
+	compare(imageA, imageB, result, context);
+	return result;
+}
+
+void pp::compare(Surface& imageA, Surface& imageB, Surface& result, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "compare");
+	//for each target pixel find one in source!
+	float width = std::min(imageA.getWidth(),imageB.getWidth());
+	float height = std::min(imageB.getHeight(),imageB.getHeight());
+	
+	_fitResult(width, height, result);
+	int rows = ctx.tileHeight();
+	ctx.parallelFor((result.getHeight() + rows - 1) / rows, CompareBands(imageA, imageB, result, rows));
+	stats.setPixels((size_t)result.getWidth() * result.getHeight());
 	/*
 	Surface result(width, height, false);
 	Vec2i v(0,0);
@@ -70,19 +110,29 @@ Surface pp::compare(Surface& imageA, Surface& imageB)
 			result.setPixel(v,Color8u(c[0]*127,c[1]*127,c[2]*127));
 		}
 	*/
-	return result;
 }
 
-Surface pp::choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold)
+void pp::compare(Surface& imageA, Surface& imageB, Surface& result, const Area& area)
+{
+	_compare(imageA, imageB, result, area);
+}
+
+bool pp::compare(const ImageView& imageA, const ImageView& imageB, const ImageView& result, ExecutionContext* context)
+{
+	if(result.empty() || result.width != std::min(imageA.width, imageB.width) || result.height != std::min(imageB.height, imageB.height))
+		return false;
+	Surface a = imageA.surface();
+	Surface b = imageB.surface();
+	Surface dest = result.surface();
+	compare(a, b, dest, context);
+	return true;
+}
+
+void _choose(Surface& imageA, Surface& imageB, Surface& errorA, Surface& secondWeight, float threshold, Surface& result, const Area& area)
 {
-	//for each target pixel find one in source!
-	float width = std::min(imageA.getWidth(),imageB.getWidth());
-	float height = std::min(imageB.getHeight(),imageB.getHeight());
-	
-	Surface result(width, height, false);
 	ivec2 v(0,0);
-	for(v.y = 0; v.y < height; v.y++)
-		for(v.x = 0; v.x < width; v.x++)
+	for(v.y = area.y1; v.y < area.y2; v.y++)
+		for(v.x = area.x1; v.x < area.x2; v.x++)
 		{
 			//is errorA a local maximum?
 			bool swap = true;
@@ -108,10 +158,66 @@ Surface pp::choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Sur
 			else
 				result.setPixel(v,imageA.getPixel(v));
 		}
+}
+
+struct ChooseBands
+{
+	ChooseBands(Surface& a, Surface& b, Surface& error, Surface& weight, float swapThreshold, Surface& dest, int bandHeight)
+	:	imageA(a), imageB(b), errorA(error), secondWeight(weight), threshold(swapThreshold), result(dest), rows(bandHeight) {}
+
+	void operator()(int band, Scratch&) const
+	{
+		_choose(imageA, imageB, errorA, secondWeight, threshold, result, Area(0, band * rows, result.getWidth(), std::min((band + 1) * rows, result.getHeight())));
+	}
 
+	Surface& imageA;
+	Surface& imageB;
+	Surface& errorA;
+	Surface& secondWeight;
+	float threshold;
+	Surface& result;
+	int rows;
+};
+
+Surface pp::choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, ExecutionContext* context)
+{
+	Surface result;
+	choose(imageA, imageB, errorA, secondWeight, threshold, result, context);
 	return result;
 }
 
+void pp::choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, cinder::Surface& result, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "choose");
+	//for each target pixel find one in source!
+	float width = std::min(imageA.getWidth(),imageB.getWidth());
+	float height = std::min(imageB.getHeight(),imageB.getHeight());
+	
+	_fitResult(width, height, result);
+	int rows = ctx.tileHeight();
+	ctx.parallelFor((result.getHeight() + rows - 1) / rows, ChooseBands(imageA, imageB, errorA, secondWeight, threshold, result, rows));
+	stats.setPixels((size_t)result.getWidth() * result.getHeight());
+}
+
+void pp::choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, cinder::Surface& result, const Area& area)
+{
+	_choose(imageA, imageB, errorA, secondWeight, threshold, result, area);
+}
+
+bool pp::choose(const ImageView& imageA, const ImageView& imageB, const ImageView& errorA, const ImageView& secondWeight, float threshold, const ImageView& result, ExecutionContext* context)
+{
+	if(result.empty() || result.width != std::min(imageA.width, imageB.width) || result.height != std::min(imageB.height, imageB.height))
+		return false;
+	Surface a = imageA.surface();
+	Surface b = imageB.surface();
+	Surface error = errorA.surface();
+	Surface weight = secondWeight.surface();
+	Surface dest = result.surface();
+	choose(a, b, error, weight, threshold, dest, context);
+	return true;
+}
+
 /*
 if(swap)
 {
@@ -2,6 +2,8 @@
 
 #include "cinder/Cinder.h"
 #include "cinder/Surface.h"
+#include "cinder/Area.h"
+#include "ImageView.h"
 #include <list>
 
 namespace pp
@@ -10,9 +12,21 @@ namespace pp
 
 	typedef std::list<cinder::Color8u> Palette;
 
+	class ExecutionContext;
 
-	void genDest(cinder::Surface& source, int scaleFactor, cinder::Surface& result);
+	void genDest(cinder::Surface& source, int scaleFactor, cinder::Surface& result, ExecutionContext* context = NULL);
 	void getColors(cinder::Surface& source, Palette& result);
-	cinder::Surface compare(cinder::Surface& imageA, cinder::Surface& imageB);
-	cinder::Surface choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold);
+	cinder::Surface compare(cinder::Surface& imageA, cinder::Surface& imageB, ExecutionContext* context = NULL);
+	void compare(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& result, ExecutionContext* context = NULL); //writes into result if it has the right size
+	cinder::Surface choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, ExecutionContext* context = NULL);
+	void choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, cinder::Surface& result, ExecutionContext* context = NULL);
+
+	//write into memory of the caller, return false if result doesn't have the size of the smaller image
+	bool compare(const ImageView& imageA, const ImageView& imageB, const ImageView& result, ExecutionContext* context = NULL);
+	bool choose(const ImageView& imageA, const ImageView& imageB, const ImageView& errorA, const ImageView& secondWeight, float threshold, const ImageView& result, ExecutionContext* context = NULL);
+
+	//only the pixels of area on the calling thread, result must have its size already. For
+	//pipelines that run them per tile as soon as the inputs around the tile are there.
+	void compare(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& result, const cinder::Area& area);
+	void choose(cinder::Surface& imageA, cinder::Surface& imageB, cinder::Surface& errorA, cinder::Surface& secondWeight, float threshold, cinder::Surface& result, const cinder::Area& area);
 }
@@ -1,359 +1,585 @@
 #include "PixelPunch.h"
-#include "Kernel.h"
 #include "PixelScale.h"
+#include "EqualityMask.h"
+#include "HqScale.h"
+#include "ScaleRules.h"
 #include <cassert>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PP_NEAREST_SSE2
+	#include <emmintrin.h>
+#endif
 
 using namespace cinder;
 using namespace pp;
+using namespace pp::rules;
+
+//****** NEAREST ******
 
-void _repeat(Surface& source, Surface& dest, int scaleFactor)
+void _replicate32(const uint32_t* src, uint32_t* dst, int width, int factor)
 {
-	Surface::ConstIter srcIt = source.getIter();
-	Surface::Iter destIt = dest.getIter();
-	while(srcIt.line())
+	int x = 0;
+#ifdef PP_NEAREST_SSE2
+	if(factor == 2)
+	{
+		for(; x + 4 <= width; x += 4, dst += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+			_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi32(v, v));
+		}
+	}
+	else if(factor == 4)
+	{
+		for(; x + 4 <= width; x += 4, dst += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+			_mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(v, 0x00));
+			_mm_storeu_si128((__m128i*)(dst + 4), _mm_shuffle_epi32(v, 0x55));
+			_mm_storeu_si128((__m128i*)(dst + 8), _mm_shuffle_epi32(v, 0xAA));
+			_mm_storeu_si128((__m128i*)(dst + 12), _mm_shuffle_epi32(v, 0xFF));
+		}
+	}
+	else if(factor > 4)
 	{
-		//back to the start of source line
-		Surface::ConstIter copy = srcIt;
-		for(int i = 0; i < scaleFactor; i++)
+		for(; x < width; x++, dst += factor)
 		{
-			destIt.line();
-			while(srcIt.pixel()) 
-			{
-				for(int j = 0; j < scaleFactor; j++)
-				{
-					destIt.pixel();
-					destIt.r() = srcIt.r(); 
-					destIt.g() = srcIt.g();
-					destIt.b() = srcIt.b();
-				}
-			}
-			//reset srcIt
-			srcIt = copy;
+			__m128i v = _mm_set1_epi32((int)src[x]);
+			int j = 0;
+			for(; j + 4 <= factor; j += 4)
+				_mm_storeu_si128((__m128i*)(dst + j), v);
+			for(; j < factor; j++)
+				dst[j] = src[x];
 		}
 	}
+#endif
+	for(; x < width; x++, dst += factor)
+		for(int j = 0; j < factor; j++)
+			dst[j] = src[x];
 }
 
-void _scale2x(Surface& source, Surface& dest)
+void _replicate(const uint8_t* src, uint8_t* dst, int width, int factor, int inc)
 {
-	Kernel kSrc(source, 3, 3, 1, 1);
-	Kernel kDst(dest, 2, 2);
-	uint32_t** src = kSrc.pixels;
-	uint32_t** dst = kDst.pixels;
-	do
+	for(int x = 0; x < width; x++, src += inc)
+		for(int j = 0; j < factor; j++, dst += inc)
+			memcpy(dst, src, inc);
+}
+
+//differing layouts go channel by channel
+void _replicateChannels(const Surface& source, const uint8_t* src, Surface& dest, uint8_t* dst, int factor)
+{
+	int srcInc = source.getPixelInc();
+	int dstInc = dest.getPixelInc();
+	int channels = (source.hasAlpha() && dest.hasAlpha()) ? 4 : 3;
+	int srcOffsets[4] = { source.getRedOffset(), source.getGreenOffset(), source.getBlueOffset(), source.getAlphaOffset() };
+	int dstOffsets[4] = { dest.getRedOffset(), dest.getGreenOffset(), dest.getBlueOffset(), dest.getAlphaOffset() };
+	for(int x = 0; x < source.getWidth(); x++, src += srcInc)
+		for(int j = 0; j < factor; j++, dst += dstInc)
+			for(int c = 0; c < channels; c++)
+				dst[dstOffsets[c]] = src[srcOffsets[c]];
+}
+
+void _nearest(const Surface& source, Surface& dest, int factorX, int factorY)
+{
+	int width = source.getWidth();
+	int inc = source.getPixelInc();
+	bool sameLayout = inc == dest.getPixelInc() && source.getChannelOrder().getCode() == dest.getChannelOrder().getCode();
+	size_t lineBytes = (size_t)width * factorX * dest.getPixelInc();
+	for(int y = 0; y < source.getHeight(); y++)
 	{
-		/*
-		A B C
-		D E F -> E0 E1 -> 00 10
-		G H I    E2 E3    01 11
-
-		if (B != H && D != F)
-			E0 = D == B ? D : E;
-			E1 = B == F ? F : E;
-			E2 = D == H ? D : E;
-			E3 = H == F ? F : E;
-		*/
-		kSrc.read();
-		bool prereq = (src[1][0] != src[1][2]) && (src[0][1] != src[2][1]);
-		dst[0][0] = prereq && (src[0][1] == src[1][0]) ? src[0][1] : src[1][1];
-		dst[1][0] = prereq && (src[1][0] == src[2][1]) ? src[2][1] : src[1][1];
-		dst[0][1] = prereq && (src[0][1] == src[1][2]) ? src[0][1] : src[1][1];
-		dst[1][1] = prereq && (src[1][2] == src[2][1]) ? src[2][1] : src[1][1];
-			
+		const uint8_t* src = source.getData() + y * source.getRowBytes();
+		uint8_t* first = dest.getData() + (size_t)y * factorY * dest.getRowBytes();
+		//expand the first row, the others are plain copies
+		if(sameLayout && inc == 4)
+			_replicate32((const uint32_t*)src, (uint32_t*)first, width, factorX);
+		else if(sameLayout)
+			_replicate(src, first, width, factorX, inc);
+		else
+			_replicateChannels(source, src, dest, first, factorX);
+		for(int i = 1; i < factorY; i++)
+			memcpy(first + i * dest.getRowBytes(), first, lineBytes);
 	}
-	while(kDst.write(2));
 }
 
-void _scale3x(Surface& source, Surface& dest)
+//****** PATTERN TABLES ******
+
+//Scale2xRules are shared with RotSprite and live in ScaleRules.h
+
+//all six relations between B, D, F and H
+struct Scale2xIndex
 {
-	Kernel kSrc(source, 3, 3, 1, 1);
-	Kernel kDst(dest, 3, 3, 0, 0);
-	uint32_t** src = kSrc.pixels;
-	uint32_t** dst = kDst.pixels;
-	do
+	enum { BITS = 6 };
+	static int index(const uint16_t*, const uint16_t* m1, const uint16_t*, int x, int, int) { return m1[x] >> 8; }
+	static void pair(int bit, int& a, int& b)
 	{
-	/*
-		A B C    E0 E1 E2     00 10 20
-		D E F -> E3 E4 E5 ->  01 11 21
-		G H I    E6 E7 E8     02 12 22
-
-		if (B != H && D != F) {
-			E0 = D == B										? D : E;
-			E1 = (D == B && E != C) || (B == F && E != A)	? B : E;
-			E2 = B == F										? F : E;
-				
-			E3 = (D == B && E != G) || (D == H && E != A)	? D : E;
-			E4 = E;
-			E5 = (B == F && E != I) || (H == F && E != C)	? F : E;
-				
-			E6 = D == H										? D : E;
-			E7 = (D == H && E != I) || (H == F && E != G)	? H : E;
-			E8 = H == F										? F : E;
-	*/
-		kSrc.read();
-		bool prereq = (src[1][0] != src[1][2]) && (src[0][1] != src[2][1]);
-		bool D_is_B = (src[0][1] == src[1][0]);
-		bool B_is_F = (src[1][0] == src[2][1]);
-		bool D_is_H = (src[0][1] == src[1][2]);
-		bool H_is_F = (src[1][2] == src[2][1]);
-		bool E_not_C = (src[1][1] != src[2][0]);
-		bool E_not_G = (src[1][1] != src[0][2]);
-		bool E_not_I = (src[1][1] != src[2][2]);
-		bool E_not_A = (src[1][1] != src[0][0]);
-			
-		dst[0][0] = prereq && D_is_B										? src[0][1] : src[1][1];
-		dst[1][0] = prereq && ((D_is_B && E_not_C) || (B_is_F && E_not_A))	? src[1][0] : src[1][1];
-		dst[2][0] = prereq && B_is_F										? src[2][1] : src[1][1];
+		static const int pairs[BITS][2] = { {B,D}, {B,F}, {D,H}, {F,H}, {B,H}, {D,F} };
+		a = pairs[bit][0];
+		b = pairs[bit][1];
+	}
+};
+
+/*
+	A B C    E0 E1 E2     00 10 20
+	D E F -> E3 E4 E5 ->  01 11 21
+	G H I    E6 E7 E8     02 12 22
+
+	if (B != H && D != F) {
+		E0 = D == B										? D : E;
+		E1 = (D == B && E != C) || (B == F && E != A)	? B : E;
+		E2 = B == F										? F : E;
 			
-		dst[0][1] = prereq && ((D_is_B && E_not_G) || (D_is_H && E_not_A))	? src[0][1] : src[1][1];
-		dst[1][1] = src[1][1];
-		dst[2][1] = prereq && ((B_is_F && E_not_I) || (H_is_F && E_not_C))	? src[2][1] : src[1][1];
+		E3 = (D == B && E != G) || (D == H && E != A)	? D : E;
+		E4 = E;
+		E5 = (B == F && E != I) || (H == F && E != C)	? F : E;
 			
-		dst[0][2] = prereq && D_is_H										? src[0][1] : src[1][1];
-		dst[1][2] = prereq && ((D_is_H && E_not_I) || (H_is_F && E_not_G))	? src[1][2] : src[1][1];
-		dst[2][2] = prereq && H_is_F										? src[2][1] : src[1][1];
+		E6 = D == H										? D : E;
+		E7 = (D == H && E != I) || (H == F && E != G)	? H : E;
+		E8 = H == F										? F : E;
+*/
+typedef Scale2xPrereq Scale3xPrereq;
+typedef Block3<
+	Pick<And<Scale3xPrereq, Eq<D,B> >, D>,
+	Pick<And<Scale3xPrereq, Or<And<Eq<D,B>, Neq<E,C> >, And<Eq<B,F>, Neq<E,A> > > >, B>,
+	Pick<And<Scale3xPrereq, Eq<B,F> >, F>,
+
+	Pick<And<Scale3xPrereq, Or<And<Eq<D,B>, Neq<E,G> >, And<Eq<D,H>, Neq<E,A> > > >, D>,
+	Center,
+	Pick<And<Scale3xPrereq, Or<And<Eq<B,F>, Neq<E,I> >, And<Eq<H,F>, Neq<E,C> > > >, F>,
+
+	Pick<And<Scale3xPrereq, Eq<D,H> >, D>,
+	Pick<And<Scale3xPrereq, Or<And<Eq<D,H>, Neq<E,I> >, And<Eq<H,F>, Neq<E,G> > > >, H>,
+	Pick<And<Scale3xPrereq, Eq<H,F> >, F>
+> Scale3xRules;
+
+//Scale2x relations plus E against the corners
+struct Scale3xIndex
+{
+	enum { BITS = 10 };
+	static int index(const uint16_t*, const uint16_t* m1, const uint16_t*, int x, int, int)
+	{
+		uint16_t m = m1[x];
+		return (m >> 8) | ((m & EQ_A) << 6) | ((m & EQ_C) << 5) | ((m & EQ_G) << 3) | ((m & EQ_I) << 2);
 	}
-	while(kDst.write(3));
-}
+	static void pair(int bit, int& a, int& b)
+	{
+		static const int pairs[BITS][2] = { {B,D}, {B,F}, {D,H}, {F,H}, {B,H}, {D,F}, {E,A}, {E,C}, {E,G}, {E,I} };
+		a = pairs[bit][0];
+		b = pairs[bit][1];
+	}
+};
+
+/*
+	first:        |Then 
+	. . . --\ CC  |A B C		S T U  --\ 1 2
+	. C . --/ CC  |D E F		V C W  --/ 3 4
+	. . .         |G H I		X Y Z
+				  | IF V==S==T => 1=S
+				  | IF T==U==W => 2=U
+				  | IF V==X==Y => 3=X
+				  | IF W==Z==Y => 4=Z
+*/
+typedef Block2<
+	Pick<And<Eq<D,A>, Eq<B,A> >, A>,	Pick<And<Eq<B,C>, Eq<F,C> >, C>,
+	Pick<And<Eq<D,G>, Eq<H,G> >, G>,	Pick<And<Eq<F,I>, Eq<H,I> >, I>
+> Eagle2xRules;
 
-void _eagle2x(Surface& source, Surface& dest)
+//the corners against their edge neighbours, found in the masks of the edge neighbours
+struct Eagle2xIndex
 {
-	Kernel kSrc(source, 3, 3, 1, 1);
-	Kernel kDst(dest, 2, 2);
-	uint32_t** src = kSrc.pixels;
-	uint32_t** dst = kDst.pixels;
-	do
+	enum { BITS = 8 };
+	static int index(const uint16_t* m0, const uint16_t* m1, const uint16_t* m2, int x, int xl, int xr)
 	{
-		/*
-		first:        |Then 
-		. . . --\ CC  |00 10 20		S T U  --\ 1 2
-		. C . --/ CC  |01 11 21		V C W  --/ 3 4
-		. . .         |02 12 22		X Y Z
-					  | IF V==S==T => 1=S
-					  | IF T==U==W => 2=U
-					  | IF V==X==Y => 3=X
-					  | IF W==Z==Y => 4=Z
-		*/
-		kSrc.read();
-		dst[0][0] = (src[0][1] == src[0][0] && src[1][0] == src[0][0]) ? src[0][0] : src[1][1];
-		dst[1][0] = (src[1][0] == src[2][0] && src[2][1] == src[2][0]) ? src[2][0] : src[1][1];
-		dst[0][1] = (src[0][1] == src[0][2] && src[1][2] == src[0][2]) ? src[0][2] : src[1][1];
-		dst[1][1] = (src[2][1] == src[2][2] && src[1][2] == src[2][2]) ? src[2][2] : src[1][1];
-			
+		return ((m1[xl] & EQ_B) >> 1) | ((m0[x] & EQ_D) >> 2) | ((m0[x] & EQ_F) >> 2) | ((m1[xr] & EQ_B) << 2) |
+			((m1[xl] & EQ_H) >> 2) | ((m2[x] & EQ_D) << 2) | ((m1[xr] & EQ_H)) | ((m2[x] & EQ_F) << 3);
 	}
-	while(kDst.write(2));
-}
+	static void pair(int bit, int& a, int& b)
+	{
+		static const int pairs[BITS][2] = { {D,A}, {B,A}, {B,C}, {F,C}, {D,G}, {H,G}, {F,I}, {H,I} };
+		a = pairs[bit][0];
+		b = pairs[bit][1];
+	}
+};
 
+/* 
+The artefact we want to remove consists of a cluster of 3 pixels sourrounded by pixels of the same other color.
+Fill the artefact witht he sourrounding color.
 
-void _fillFissure(Surface& surf)
+	B a B	B a B	B B .	B B . 
+	a a B	B a a	B a a	a a B
+	B B .	. B B	B a B	B a B
+
+Only one of the four orientations can match a pixel.
+*/
+typedef Pass<3, 3, 1, 1, Sequence<
+	Rewrite<And<Neq<E,A>, Eq<D,E>, Eq<B,E>, Eq<F,A>, Eq<H,A>, And<Eq<C,A>, Eq<G,A> > >, Fill<A, E, D, B> >,
+	Rewrite<And<Neq<E,C>, Eq<F,E>, Eq<B,E>, Eq<D,C>, Eq<H,C>, And<Eq<A,C>, Eq<I,C> > >, Fill<C, E, F, B> >,
+	Rewrite<And<Neq<E,G>, Eq<D,E>, Eq<H,E>, Eq<F,G>, Eq<B,G>, And<Eq<I,G>, Eq<A,G> > >, Fill<G, E, D, H> >,
+	Rewrite<And<Neq<E,I>, Eq<F,E>, Eq<H,E>, Eq<D,I>, Eq<B,I>, And<Eq<G,I>, Eq<C,I> > >, Fill<I, E, F, H> >
+> > FillFissurePass;
+
+struct FillFissureCandidate
 {
-	/* 
-	The artefact we want to remove consists of a cluster of 3 pixels sourrounded by pixels of the same other color.
-	Fill the artefact witht he sourrounding color.
+	static bool eval(uint16_t m)
+	{
+		const int edges = EQ_B | EQ_D | EQ_F | EQ_H;
+		return (m & (edges | EQ_FH)) == (EQ_B | EQ_D | EQ_FH) || (m & (edges | EQ_DH)) == (EQ_B | EQ_F | EQ_DH) ||
+			(m & (edges | EQ_BF)) == (EQ_D | EQ_H | EQ_BF) || (m & (edges | EQ_BD)) == (EQ_F | EQ_H | EQ_BD);
+	}
+};
+
+/* 
+The artefact we want to remove consists of a single pixel flanked by pixels of the same other color.
+Fill the artefact witht he sourrounding color.
 
-		B a B	B a B	B B .	B B . 
-		a a B	B a a	B a a	a a B
-		B B .	. B B	B a B	B a B
-	*/
+	. x .
+	x A x
+	. x .
+*/
+typedef Pass<3, 3, 1, 1,
+	Rewrite<And<Neq<E,D>, Eq<D,B>, Eq<D,F>, Eq<D,H> >, Fill<D, E> >
+> FillSinglePass;
 
-	Kernel k(surf, 3, 3, 1, 1);
-	uint32_t** p = k.pixels;
-	do
+struct FillSingleCandidate
+{
+	static bool eval(uint16_t m)
 	{
-		k.read(0);
-		uint32_t cA = p[1][1];
-		for(int i = -1; i < 2; i += 2)
-			for(int j = -1; j < 2; j += 2)
-			{
-				uint32_t cB = p[1+j][1+i];
-				if(cA == cB)
-					continue;
-				//crease exists?
-				if((p[1+j][1] != cA) || (p[1][1+i] != cA))
-					continue;
-				//sourrounded? (edge)
-				if((p[1-j][1] != cB) || (p[1][1-i] != cB))
-					continue;
-				//sourrounded? (corners)
-				if((p[1-j][1+i] != cB) || (p[1+j][1-i] != cB))
-					continue;
-
-				p[1][1] = p[1+j][1] = p[1][1+i] = cB;
-			}
+		const int required = EQ_BD | EQ_DF | EQ_DH;
+		return (m & (EQ_B | EQ_D | EQ_F | EQ_H | required)) == required;
 	}
-	while(k.write(1));
-}
+};
+
+/* 
+We want to buff two individual pixels of the same color touching corners.
+	. . . x		x . . .
+	. x	A .		. A x .
+	. A	x .		. x A .
+	x . . .		. . . x
+
+Cells of the 4x4 window are named after their column and row.
+*/
+enum Cell4 { 
+	P00, P10, P20, P30,
+	P01, P11, P21, P31,
+	P02, P12, P22, P32,
+	P03, P13, P23, P33
+};
+typedef Pass<4, 4, 1, 1, Sequence<
+	Rewrite<And<Eq<P21,P12>, Neq<P21,P03>, Neq<P21,P30>, Neq<P21,P11>, Neq<P21,P22> >, Fill<P21, P11, P22> >,
+	Rewrite<And<Eq<P11,P22>, Neq<P11,P00>, Neq<P11,P33>, Neq<P11,P21>, Neq<P11,P12> >, Fill<P11, P21, P12> >
+> > BuffDoublePass;
 
-void _fillSingle(Surface& surf)
+//relative to the current pixel P11 = E, P21 = F, P12 = H and P22 = I
+struct BuffDoubleCandidate
 {
-	/* 
-	The artefact we want to remove consists of a single pixel flanked by pixels of the same other color.
-	Fill the artefact witht he sourrounding color.
+	static bool eval(uint16_t m)
+	{
+		return (m & (EQ_F | EQ_FH)) == EQ_FH || (m & (EQ_F | EQ_H | EQ_I)) == EQ_I;
+	}
+};
+
+/* 
+We want to connect individual pixels to larger clusters
 
-		. x .
-		x A x
-		. x .
-	*/
-	Kernel k(surf, 3, 3, 1, 1);
-	uint32_t** p = k.pixels;
-	do
+	A x .	. x A 
+	x A x	x A x 
+	. x A	A x .
+*/
+typedef Pass<3, 3, 1, 1, Sequence<
+	Rewrite<And<Eq<A,E>, Eq<A,I>, Neq<A,D>, Neq<A,H>, Neq<A,B>, Neq<A,F> >, Fill<A, D, H, B, F> >,
+	Rewrite<And<Eq<C,E>, Eq<C,G>, Neq<C,D>, Neq<C,H>, Neq<C,B>, Neq<C,F> >, Fill<C, D, H, B, F> >
+> > BuffTripleStrictPass;
+
+struct BuffTripleStrictCandidate
+{
+	static bool eval(uint16_t m)
 	{
-		k.read(0);
-		uint32_t cA = p[1][1];
-		uint32_t ref = p[0][1];
-		if(cA != ref && ref == p[1][0] && ref == p[2][1] && ref == p[1][2])
-			p[1][1] = ref;
+		const int edges = EQ_B | EQ_D | EQ_F | EQ_H;
+		return (m & (edges | EQ_A | EQ_I)) == (EQ_A | EQ_I) || (m & (edges | EQ_C | EQ_G)) == (EQ_C | EQ_G);
 	}
-	while(k.write(1));
-}
+};
+
+/* 
+We want to connect individual pixels to larger clusters. X and Y will be judged
+sperately.
 
-void _buffDouble(Surface& surf)
-{
-	/* 
-	We want to buff two individual pixels of the same color touching corners.
-		. . . x		x . . .
-		. x	A .		. A x .
-		. A	x .		. x A .
-		x . . .		. . . x
-	*/
-	Kernel k(surf, 4, 4, 1, 1);
-	uint32_t** p = k.pixels;
-	do
+	A x .	. y A 
+	x A y	x A y 
+	. y A	A x .
+*/
+typedef Pass<3, 3, 1, 1, Sequence<
+	Rewrite<And<Eq<A,E>, Eq<A,I>, Neq<A,D>, Neq<A,B> >, Fill<A, D, B> >,
+	Rewrite<And<Eq<A,E>, Eq<A,I>, Neq<A,H>, Neq<A,F> >, Fill<A, H, F> >,
+	Rewrite<And<Eq<C,E>, Eq<C,G>, Neq<C,D>, Neq<C,H> >, Fill<C, D, H> >,
+	Rewrite<And<Eq<C,E>, Eq<C,G>, Neq<C,B>, Neq<C,F> >, Fill<C, B, F> >
+> > BuffTripleLoosePass;
+
+struct BuffTripleLooseCandidate
+{
+	static bool eval(uint16_t m)
 	{
-		k.read(0);
-		uint32_t ref = p[2][1];
-		if(ref == p[1][2] && ref != p[0][3] && ref != p[3][0] && ref != p[1][1] && ref != p[2][2])
-			p[1][1] = p[2][2] = ref;
-
-		ref = p[1][1];
-		if(ref == p[2][2] && ref != p[0][0] && ref != p[3][3] && ref != p[2][1] && ref != p[1][2])
-			p[2][1] = p[1][2] = ref;
+		return (m & (EQ_A | EQ_I | EQ_D | EQ_B)) == (EQ_A | EQ_I) || (m & (EQ_A | EQ_I | EQ_H | EQ_F)) == (EQ_A | EQ_I) ||
+			(m & (EQ_C | EQ_G | EQ_D | EQ_H)) == (EQ_C | EQ_G) || (m & (EQ_C | EQ_G | EQ_B | EQ_F)) == (EQ_C | EQ_G);
 	}
-	while(k.write(1));
+};
+
+//built once at start up
+static const BlockTable<Scale2xRules, Scale2xIndex> sScale2xTable;
+static const BlockTable<Scale3xRules, Scale3xIndex> sScale3xTable;
+static const BlockTable<Eagle2xRules, Eagle2xIndex> sEagle2xTable;
+
+//****** PASSES ******
+
+void _scale2x(const PixelPlane& source, const MaskPlane& mask, PixelPlane& dest, ExecutionContext& context)
+{
+	rules::scale(source, mask, sScale2xTable, dest, context);
 }
 
-void _buffTripleStrict(Surface& surf)
+void _scale3x(const PixelPlane& source, const MaskPlane& mask, PixelPlane& dest, ExecutionContext& context)
 {
-	/* 
-	We want to connect individual pixels to larger clusters
-	
-		A x .	. x A 
-		x A x	x A x 
-		. x A	A x .
-	*/
+	rules::scale(source, mask, sScale3xTable, dest, context);
+}
 
-	Kernel k(surf, 3, 3, 1, 1);
-	uint32_t** p = k.pixels;
-	do
-	{
-		k.read(0);
-		uint32_t ref = p[0][0];
-		if( ref == p[1][1] && ref == p[2][2] && //line exists
-			ref != p[0][1] && ref != p[1][2] && ref != p[1][0] && ref != p[2][1]) //neighbours differ
-				p[0][1] = p[1][2] = p[1][0] = p[2][1] = ref;
-
-		ref = p[2][0];
-		if( ref == p[1][1] && ref == p[0][2] && //line exists
-			ref != p[0][1] && ref != p[1][2] && ref != p[1][0] && ref != p[2][1]) //neighbours differ
-				p[0][1] = p[1][2] = p[1][0] = p[2][1] = ref;
-	}
-	while(k.write(1));
+void _eagle2x(const PixelPlane& source, const MaskPlane& mask, PixelPlane& dest, ExecutionContext& context)
+{
+	rules::scale(source, mask, sEagle2xTable, dest, context);
 }
 
+//only edge pixels can match a cleanup pattern
+template<class P, class Candidate>
+void _cleanup(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
+{
+	if(untilStable)
+		rules::rewriteUntilStable<P, Candidate>(surf, mask, edges);
+	else
+		rules::rewrite<P, Candidate>(surf, mask, edges);
+}
 
-void _buffTripleLoose(Surface& surf)
+void _fillFissure(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
 {
-	/* 
-	We want to connect individual pixels to larger clusters. X and Y will be judged
-	sperately.
-	
-		A x .	. y A 
-		x A y	x A y 
-		. y A	A x .
-	*/
+	_cleanup<FillFissurePass, FillFissureCandidate>(surf, mask, edges, untilStable);
+}
 
-	Kernel k(surf, 3, 3, 1, 1);
-	uint32_t** p = k.pixels;
-	do
-	{
-		k.read(0);
-		uint32_t ref = p[0][0];
-		if( ref == p[1][1] && ref == p[2][2]) //line exists
-		{
-			if(ref != p[0][1] && ref != p[1][0]) 
-				p[0][1] = p[1][0] = ref;
-			if(ref != p[1][2] && ref != p[2][1]) //neighbours differ
-				p[1][2] = p[2][1] = ref;
-		}
-		ref = p[2][0];
-		if( ref == p[1][1] && ref == p[0][2]) //line exists
-		{
-			if(ref != p[0][1] && ref != p[1][2] ) //neighbours differ
-				p[0][1] = p[1][2] = ref;
-			if(ref != p[1][0] && ref != p[2][1]) //neighbours differ
-				p[1][0] = p[2][1] = ref;
-		}
-	}
-	while(k.write(1));
+void _fillSingle(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
+{
+	_cleanup<FillSinglePass, FillSingleCandidate>(surf, mask, edges, untilStable);
 }
 
-void genDest(Surface& source, int scaleFactor, Surface& result)
+void _buffDouble(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
 {
-	int w = scaleFactor * source.getWidth();
-	int h = scaleFactor * source.getHeight();
-	bool alpha = source.hasAlpha();
-	result = Surface(w, h, alpha);
+	_cleanup<BuffDoublePass, BuffDoubleCandidate>(surf, mask, edges, untilStable);
 }
 
-Surface pp::scale(Surface& source, ScaleMethod method)
+void _buffTripleStrict(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
 {
-	Surface result;
-	Surface temp;
+	_cleanup<BuffTripleStrictPass, BuffTripleStrictCandidate>(surf, mask, edges, untilStable);
+}
+
+void _buffTripleLoose(PixelPlane& surf, MaskPlane& mask, const PixelList& edges, bool untilStable)
+{
+	_cleanup<BuffTripleLoosePass, BuffTripleLooseCandidate>(surf, mask, edges, untilStable);
+}
+
+void _fitDest(Surface& source, int factorX, int factorY, Surface& result)
+{
+	//keep storage provided by the caller (e.g. a mapped file) if it has the right size
+	int w = factorX * source.getWidth();
+	int h = factorY * source.getHeight();
+	if(result.getData() && result.getWidth() == w && result.getHeight() == h)
+		return;
+	result = Surface(w, h, source.hasAlpha());
+}
+
+void _scale(const PixelPlane& source, ScaleMethod method, PixelPlane& result, bool untilStable, ExecutionContext& context)
+{
+	PixelPlane temp;
+	MaskPlane srcMask;
+	MaskPlane mask;
+	PixelList edges;
+	//the mask of the source is derived for the scaled image and kept up to date by the cleanups
+	if(method < SM_HQ2x)
+		equalityMask(source, srcMask);
 	//migrate data
 	switch(method)
 	{
 	case SM_NONE:
-		genDest(source, 1, result);
-		_repeat(source, result, 1);
+		result = source;
 		break;
 	case SM_SCALE2x:
-		genDest(source, 2, result);
-		_scale2x(source, result);
+		_scale2x(source, srcMask, result, context);
 		break;
 	case SM_SCALE3x:
-		genDest(source, 3, result);
-		_scale3x(source, result);
+		_scale3x(source, srcMask, result, context);
 		break;
 	case SM_SCALE4x:
-		genDest(source, 2, temp);
-		_scale2x(source, temp);
-		genDest(temp, 2, result);
-		_scale2x(temp, result);
+		_scale2x(source, srcMask, temp, context);
+		deriveMask(srcMask, 2, temp, mask);
+		_scale2x(temp, mask, result, context);
 		break;
 	case SM_EAGLE2x:
-		genDest(source, 2, result);
-		_eagle2x(source, result);
+		_eagle2x(source, srcMask, result, context);
 		break;
 	case SM_SCALE2x_HQ:
-		genDest(source, 2, result);
-		_scale2x(source, result);
-		_fillSingle(result);
-		_buffDouble(result);
+		_scale2x(source, srcMask, result, context);
+		deriveMask(srcMask, 2, result, mask, &edges);
+		_fillSingle(result, mask, edges, untilStable);
+		edgePixels(mask, edges);
+		_buffDouble(result, mask, edges, untilStable);
 		break;
 	case SM_SCALE3x_HQ:
-		genDest(source, 3, result);
-		_scale3x(source, result);
-		_fillFissure(result);
-		_buffTripleStrict(result);
+		_scale3x(source, srcMask, result, context);
+		deriveMask(srcMask, 3, result, mask, &edges);
+		_fillFissure(result, mask, edges, untilStable);
+		edgePixels(mask, edges);
+		_buffTripleStrict(result, mask, edges, untilStable);
 		break;
 	case SM_SCALE4x_HQ:
-		genDest(source, 2, temp);
-		_scale2x(source, temp);
-		_fillSingle(temp);
-		_buffDouble(temp);
-		genDest(temp, 2, result);
-		_eagle2x(temp, result);
+		_scale2x(source, srcMask, temp, context);
+		deriveMask(srcMask, 2, temp, mask, &edges);
+		_fillSingle(temp, mask, edges, untilStable);
+		edgePixels(mask, edges);
+		_buffDouble(temp, mask, edges, untilStable);
+		_eagle2x(temp, mask, result, context);
 	break;
+	case SM_HQ2x:
+	case SM_HQ3x:
+	case SM_HQ4x:
+		hqScale(source, result, scaleFactor(method), &context);
+		break;
+	default:
+		break;
+	}
+}
 
+Surface pp::scale(Surface& source, ScaleMethod method, ExecutionContext* context, bool untilStable, bool ownsPixels)
+{
+	Surface result;
+	scale(source, method, result, context, untilStable, ownsPixels);
+	return result;
+}
+
+void pp::scale(Surface& source, ScaleMethod method, Surface& result, ExecutionContext* context, bool untilStable, bool ownsPixels)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "scale");
+	if(method == SM_NONE)
+	{
+		//a copy only if the pixels may go away before the result (e.g. an unmapped file) or
+		//the caller passed storage of its own
+		bool storage = result.getData() && result.getSize() == source.getSize();
+		if(ownsPixels && !storage)
+			result = source;
+		else
+		{
+			_fitDest(source, 1, 1, result);
+			_nearest(source, result, 1, 1);
+		}
+		stats.setPixels((size_t)result.getWidth() * result.getHeight());
+		return;
 	}
+
+	PixelPlane src;
+	PixelPlane dst;
+	pack(source, src);
+	_scale(src, method, dst, untilStable, ctx);
+	_fitDest(source, scaleFactor(method), scaleFactor(method), result);
+	unpack(dst, result);
+	stats.setPixels(dst.pixels.size());
+}
+
+bool pp::scale(const ImageView& source, ScaleMethod method, const ImageView& result, ExecutionContext* context, bool untilStable)
+{
+	int factor = scaleFactor(method);
+	if(source.empty() || result.empty() || result.width != factor * source.width || result.height != factor * source.height)
+		return false;
+	Surface src = source.surface();
+	Surface dst = result.surface();
+	scale(src, method, dst, context, untilStable);
+	return true;
+}
+
+void pp::scale(const PixelPlane& source, ScaleMethod method, PixelPlane& result, bool untilStable, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "scale");
+	_scale(source, method, result, untilStable, ctx);
+	stats.setPixels(result.pixels.size());
+}
+
+Surface pp::scaleNearest(Surface& source, int factorX, int factorY, ExecutionContext* context)
+{
+	Surface result;
+	scaleNearest(source, factorX, factorY, result, context);
 	return result;
 }
+
+void pp::scaleNearest(Surface& source, int factorX, int factorY, Surface& result, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "scaleNearest");
+	factorX = std::max(factorX, 1);
+	factorY = std::max(factorY, 1);
+	_fitDest(source, factorX, factorY, result);
+	_nearest(source, result, factorX, factorY);
+	stats.setPixels((size_t)result.getWidth() * result.getHeight());
+}
+
+bool pp::scaleNearest(const ImageView& source, int factorX, int factorY, const ImageView& result, ExecutionContext* context)
+{
+	if(source.empty() || result.empty() || result.width != std::max(factorX, 1) * source.width || result.height != std::max(factorY, 1) * source.height)
+		return false;
+	Surface src = source.surface();
+	Surface dst = result.surface();
+	scaleNearest(src, factorX, factorY, dst, context);
+	return true;
+}
+
+int pp::scaleFactor(ScaleMethod method)
+{
+	switch(method)
+	{
+	case SM_SCALE2x:
+	case SM_EAGLE2x:
+	case SM_SCALE2x_HQ:
+	case SM_HQ2x:
+		return 2;
+	case SM_SCALE3x:
+	case SM_SCALE3x_HQ:
+	case SM_HQ3x:
+		return 3;
+	case SM_SCALE4x:
+	case SM_SCALE4x_HQ:
+	case SM_HQ4x:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+bool pp::scaleIsLocal(ScaleMethod method)
+{
+	return method < SM_SCALE2x_HQ || method > SM_SCALE4x_HQ;
+}
+
+int pp::scaleHalo(ScaleMethod method)
+{
+	switch(method)
+	{
+	case SM_SCALE2x:
+	case SM_SCALE3x:
+	case SM_EAGLE2x:
+	case SM_HQ2x:
+	case SM_HQ3x:
+	case SM_HQ4x:
+		return 1;
+	case SM_SCALE4x:
+	case SM_SCALE3x_HQ:
+		return 2;
+	case SM_SCALE2x_HQ:
+		return 3;
+	case SM_SCALE4x_HQ:
+		return 4;
+	default:
+		return 0;
+	}
+}
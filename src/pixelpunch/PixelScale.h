@@ -2,6 +2,9 @@
 
 #include "cinder/Cinder.h"
 #include "cinder/Surface.h"
+#include "Plane.h"
+#include "ExecutionContext.h"
+#include "ImageView.h"
 
 namespace pp 
 {
@@ -16,9 +19,35 @@ namespace pp
 
 		SM_SCALE2x_HQ,
 		SM_SCALE3x_HQ,
-		SM_SCALE4x_HQ
+		SM_SCALE4x_HQ,
+
+		SM_HQ2x,
+		SM_HQ3x,
+		SM_HQ4x
 	};
 	typedef enum ScaleMethod ScaleMethod;
 
-	cinder::Surface scale(cinder::Surface& source, ScaleMethod method);
-}
\ No newline at end of file
+	//untilStable repeats the cleanups of the HQ methods until they don't change the image anymore.
+	//SM_NONE returns the source itself, the result shares its pixels and keeps them alive. Cinder
+	//can't tell whether a Surface owns its pixels, so sources that don't (MappedImage::surface(),
+	//ImageView::surface(), memory of the caller) pass ownsPixels false and get a copy instead.
+	cinder::Surface scale(cinder::Surface& source, ScaleMethod method, ExecutionContext* context = NULL, bool untilStable = false, bool ownsPixels = true);
+	void scale(cinder::Surface& source, ScaleMethod method, cinder::Surface& result, ExecutionContext* context = NULL, bool untilStable = false, bool ownsPixels = true); //writes into result if it has the scaled size
+	//writes into memory of the caller, returns false if result doesn't have the scaled size
+	bool scale(const ImageView& source, ScaleMethod method, const ImageView& result, ExecutionContext* context = NULL, bool untilStable = false);
+
+	//same on packed planes, pixels are compared as a whole so anything packed into the upper
+	//byte (e.g. alpha) takes part in the patterns
+	void scale(const PixelPlane& source, ScaleMethod method, PixelPlane& result, bool untilStable = false, ExecutionContext* context = NULL);
+
+	//integer nearest neighbour, copies all channels
+	cinder::Surface scaleNearest(cinder::Surface& source, int factorX, int factorY, ExecutionContext* context = NULL);
+	void scaleNearest(cinder::Surface& source, int factorX, int factorY, cinder::Surface& result, ExecutionContext* context = NULL);
+	bool scaleNearest(const ImageView& source, int factorX, int factorY, const ImageView& result, ExecutionContext* context = NULL);
+
+	int scaleFactor(ScaleMethod method);
+	//false for the HQ methods with cleanups, those rewrite the scaled image in place in scan order
+	//so a change can be carried along arbitrarily far and only a whole image scale is exact
+	bool scaleIsLocal(ScaleMethod method);
+	int scaleHalo(ScaleMethod method); //source pixels around a pixel that can affect its scaled block, if scaleIsLocal
+}
@@ -1,10 +1,26 @@
 #include "PixelPunch.h"
 #include "PixelTransform.h"
 #include "Kernel.h"
+#include "RotSprite.h"
+#include "UniformBlocks.h"
+#include "TiledImage.h"
+#include "VirtualScaledImage.h"
+#include "TileGraph.h"
+#include "SurfacePool.h"
+#include "ExecutionContext.h"
 #include "cinder/Matrix.h"
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
 #include "CinderExtensions.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PP_DOMINANCE_SSE2
+	#include <emmintrin.h>
+#endif
+
 using namespace cinder;
 using namespace pp;
 
@@ -101,8 +117,353 @@ mat3 _mapUnitSquareToQuad(ci::vec2* quad)
 
 }
 
+//****** TILES ******
+
+//Tiles are handed out one at a time so threads that get cheap tiles (e.g. outside of the
+//quad) take more of them. The default 64 pixels of 3 or 4 bytes are whole cache lines, so
+//threads working on neighbouring tiles don't write to the same lines.
+template<class Tiles>
+struct TileGrid
+{
+	TileGrid(const Tiles& t, int w, int h, int tw, int th)
+	:	tiles(t), width(w), height(h), tileWidth(tw), tileHeight(th), columns((w + tw - 1) / tw), rows((h + th - 1) / th) {}
+
+	void operator()(int index, Scratch& scratch) const
+	{
+		int x0 = (index % columns) * tileWidth;
+		int y0 = (index / columns) * tileHeight;
+		tiles(x0, y0, std::min(x0 + tileWidth, width), std::min(y0 + tileHeight, height), scratch);
+	}
+
+	const Tiles& tiles;
+	int width;
+	int height;
+	int tileWidth;
+	int tileHeight;
+	int columns;
+	int rows;
+};
+
+//calls tiles(x0, y0, x1, y1, scratch) for all tiles of a width x height target
+template<class Tiles>
+void _forEachTile(ExecutionContext& context, const Tiles& tiles, int width, int height)
+{
+	TileGrid<Tiles> grid(tiles, width, height, context.tileWidth(), context.tileHeight());
+	context.parallelFor(grid.columns * grid.rows, grid);
+}
+
+inline void _put(uint8_t* pxl, const ColorA8u& c, const Surface& dest)
+{
+	pxl[dest.getRedOffset()] = c.r;
+	pxl[dest.getGreenOffset()] = c.g;
+	pxl[dest.getBlueOffset()] = c.b;
+	if(dest.hasAlpha())
+		pxl[dest.getAlphaOffset()] = c.a;
+}
+
+//like setPixel with a Color8u, alpha is left untouched
+inline void _putBlank(uint8_t* pxl, const Surface& dest)
+{
+	pxl[dest.getRedOffset()] = 0;
+	pxl[dest.getGreenOffset()] = 0;
+	pxl[dest.getBlueOffset()] = 0;
+}
+
+inline uint32_t _packColor(const ColorA8u& c)
+{
+	return ((uint32_t)c.a << 24) | ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+}
+
+inline ColorA8u _unpackColor(uint32_t c)
+{
+	return ColorA8u((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+}
+
+//source pixel of a sampler clamped like getPixel, packed 0xAARRGGBB
+inline uint32_t _packedPixel(const Surface& source, int x, int y)
+{
+	x = std::min(std::max(x, 0), source.getWidth() - 1);
+	y = std::min(std::max(y, 0), source.getHeight() - 1);
+	const uint8_t* p = source.getData() + y * source.getRowBytes() + x * source.getPixelInc();
+	uint32_t alpha = source.hasAlpha() ? p[source.getAlphaOffset()] : 255;
+	return (alpha << 24) | ((uint32_t)p[source.getRedOffset()] << 16) | ((uint32_t)p[source.getGreenOffset()] << 8) | p[source.getBlueOffset()];
+}
+
+//width x height source pixels of a sampler from x, y in rows, from the virtual scaled image
+//or the tiled copy if it has one
+template<class Sampler>
+inline void _window(const Sampler& sampler, int x, int y, int width, int height, uint32_t* result)
+{
+	if(sampler.scaled)
+	{
+		sampler.scaled->window(x, y, width, height, result);
+		return;
+	}
+	for(int j = 0; j < height; j++)
+		for(int i = 0; i < width; i++)
+			*result++ = sampler.tiles ? sampler.tiles->at(x + i, y + j) : _packedPixel(sampler.source, x + i, y + j);
+}
+
+template<class Sampler>
+inline ColorA8u _pixel(const Sampler& sampler, int x, int y)
+{
+	uint32_t color;
+	_window(sampler, x, y, 1, 1, &color);
+	return _unpackColor(color);
+}
+
+//****** FLAT AREAS ******
+
+//color a sampler gives where all pixels it reads are the same, false if it has to sample
+template<class Sampler>
+inline bool _flat(const Sampler&, float, float, ColorA8u&)
+{
+	return false;
+}
+
+//pixels from floor - before to floor + after are read in both directions
+inline bool _flatColor(const Surface& source, const UniformBlocks* blocks, float x, float y, int before, int after, uint32_t& color)
+{
+	if(!blocks)
+		return false;
+	assert(blocks->width() == source.getWidth() && blocks->height() == source.getHeight());
+	int fx = (int)floor(x);
+	int fy = (int)floor(y);
+	return blocks->uniform(fx - before, fy - before, fx + after, fy + after, color);
+}
+
+inline bool _flat(const BicubicSampler& sampler, float x, float y, ColorA8u& color)
+{
+	uint32_t c;
+	if(!_flatColor(sampler.source, sampler.blocks, x, y, 1, 2, c))
+		return false;
+	//interpolating a constant gives the constant, the conversions are the ones of the sampler
+	ColorAf f = _unpackColor(c);
+	color = ColorA8u(0,0,0,1);
+	color.r = 255*(double)f.r;
+	color.g = 255*(double)f.g;
+	color.b = 255*(double)f.b;
+	return true;
+}
+
+inline bool _flat(const BilinearDominanceSampler& sampler, float x, float y, ColorA8u& color)
+{
+	uint32_t c;
+	if(!_flatColor(sampler.source, sampler.blocks, x, y, 0, 1, c))
+		return false;
+	color = _unpackColor(c);
+	return true;
+}
+
+inline bool _flat(const BicubicBestFitSampler& sampler, float x, float y, ColorA8u& color)
+{
+	//the interpolated color only picks among the candidates, they are all the same here
+	uint32_t c;
+	int before = sampler.mode == BicubicBestFitSampler::LOCAL_4x4 ? 1 : 0;
+	if(sampler.mode == BicubicBestFitSampler::PALETTE || !_flatColor(sampler.source, sampler.blocks, x, y, before, before + 1, c))
+		return false;
+	ColorAf f = _unpackColor(c);
+	color = ColorA8u(0,0,0,1);
+	color.r = f.r * 255;
+	color.g = f.g * 255;
+	color.b = f.b * 255;
+	return true;
+}
+
+inline bool _flat(const WeightSampler& sampler, float x, float y, ColorA8u& color)
+{
+	uint32_t c;
+	if(!_flatColor(sampler.source, sampler.blocks, x, y, 0, 1, c))
+		return false;
+	color = sampler.order == 0 ? ColorA8u(255,0,0) : ColorA8u(0,0,0);
+	return true;
+}
+
+inline bool _flat(const RotSpriteSampler& sampler, float x, float y, ColorA8u& color)
+{
+	//Scale2x keeps flat areas flat, three steps reach 2 source pixels around the nearest one
+	uint32_t c;
+	if(!_flatColor(sampler.source, sampler.blocks, x, y, 2, 3, c))
+		return false;
+	color = _unpackColor(c);
+	return true;
+}
+
+template<class Sampler>
+inline ColorA8u _sampled(const Sampler& sampler, float sx, float sy)
+{
+	ColorA8u color;
+	return _flat(sampler, sx, sy, color) ? color : sampler(sx, sy);
+}
+
+template<class Sampler>
+inline void _sample(const Sampler& sampler, float sx, float sy, uint8_t* pxl, const Surface& dest)
+{
+	if(sx >= 0 && sy >= 0 && sx < sampler.source.getWidth() && sy < sampler.source.getHeight())
+		_put(pxl, _sampled(sampler, sx, sy), dest);
+	else
+		_putBlank(pxl, dest);
+}
+
+//****** FAST PATHS ******
+
+enum MappingClass { MC_PROJECTIVE, MC_AFFINE, MC_AXIS_ALIGNED, MC_TRANSPOSED };
+
+//Fast paths are only taken when the homogeneous row is exactly (0, 0, 1). Then the
+//perspective divide is a no op and skipping it keeps results bit exact.
+MappingClass _classify(const mat3& m)
+{
+	if(m[0][2] != 0 || m[1][2] != 0 || m[2][2] != 1)
+		return MC_PROJECTIVE;
+	if(m[1][0] == 0 && m[0][1] == 0)
+		return MC_AXIS_ALIGNED;
+	if(m[0][0] == 0 && m[1][1] == 0)
+		return MC_TRANSPOSED;
+	return MC_AFFINE;
+}
+
+template<class Sampler>
+struct AffineTiles
+{
+	AffineTiles(const Sampler& s, const mat3& targetToSource, Surface& d) : sampler(s), m(targetToSource), dest(d) {}
+
+	void operator()(int x0, int y0, int x1, int y1, Scratch&) const
+	{
+		int inc = dest.getPixelInc();
+		for(int y = y0; y < y1; y++)
+		{
+			uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+			//same terms in the same order as the matrix product
+			float rowX = m[1][0] * y;
+			float rowY = m[1][1] * y;
+			for(int x = x0; x < x1; x++, line += inc)
+				_sample(sampler, m[0][0] * x + rowX + m[2][0], m[0][1] * x + rowY + m[2][1], line, dest);
+		}
+	}
+
+	const Sampler& sampler;
+	mat3 m;
+	Surface& dest;
+};
+
+//source coordinate depending on the target column and the one depending on the row
+template<bool Transposed>
+void _separableCoords(const mat3& m, int width, int height, std::vector<float>& byColumn, std::vector<float>& byRow)
+{
+	byColumn.resize(width);
+	byRow.resize(height);
+	for(int x = 0; x < width; x++)
+		byColumn[x] = Transposed ? m[0][1] * x + m[2][1] : m[0][0] * x + m[2][0];
+	for(int y = 0; y < height; y++)
+		byRow[y] = Transposed ? m[1][0] * y + m[2][0] : m[1][1] * y + m[2][1];
+}
+
+//index of the nearest source pixel or -1 outside of the source
+inline int _nearestIndex(float coord, int size)
+{
+	return (coord >= 0 && coord < size) ? std::min((int)(coord + 0.5), size - 1) : -1;
+}
+
+//pixel copies for the nearest sampler, false if it has to go through the sampler
+template<bool Transposed, class Sampler>
+bool _copyNearest(const Sampler&, const float*, const float*, Surface&, int, int, int, int, Scratch&)
+{
+	return false;
+}
+
+template<bool Transposed>
+bool _copyNearest(const NearestNeighbourSampler& sampler, const float* byColumn, const float* byRow, Surface& dest, int x0, int y0, int x1, int y1, Scratch& scratch)
+{
+	const Surface& source = sampler.source;
+	if(sampler.scaled || source.getPixelInc() != dest.getPixelInc() || source.getChannelOrder().getCode() != dest.getChannelOrder().getCode())
+		return false;
+
+	int columnSize = Transposed ? source.getHeight() : source.getWidth();
+	int rowSize = Transposed ? source.getWidth() : source.getHeight();
+	int* columns = scratch.get<int>(x1 - x0);
+	for(int x = x0; x < x1; x++)
+		columns[x - x0] = _nearestIndex(byColumn[x], columnSize);
+
+	//a tile is small enough to keep the source lines a transposed copy reads in cache
+	int inc = dest.getPixelInc();
+	for(int y = y0; y < y1; y++)
+	{
+		int row = _nearestIndex(byRow[y], rowSize);
+		uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+		for(int x = x0; x < x1; x++, line += inc)
+		{
+			int sx = Transposed ? row : columns[x - x0];
+			int sy = Transposed ? columns[x - x0] : row;
+			if(sx < 0 || sy < 0)
+				_putBlank(line, dest);
+			else
+				memcpy(line, source.getData() + sy * source.getRowBytes() + sx * inc, inc);
+		}
+	}
+	return true;
+}
+
+template<bool Transposed, class Sampler>
+struct SeparableTiles
+{
+	SeparableTiles(const Sampler& s, const mat3& targetToSource, Surface& d) : sampler(s), dest(d)
+	{
+		_separableCoords<Transposed>(targetToSource, dest.getWidth(), dest.getHeight(), byColumn, byRow);
+	}
+
+	void operator()(int x0, int y0, int x1, int y1, Scratch& scratch) const
+	{
+		if(_copyNearest<Transposed>(sampler, &byColumn[0], &byRow[0], dest, x0, y0, x1, y1, scratch))
+			return;
+
+		int inc = dest.getPixelInc();
+		for(int y = y0; y < y1; y++)
+		{
+			uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+			for(int x = x0; x < x1; x++, line += inc)
+			{
+				float sx = Transposed ? byRow[y] : byColumn[x];
+				float sy = Transposed ? byColumn[x] : byRow[y];
+				_sample(sampler, sx, sy, line, dest);
+			}
+		}
+	}
+
+	const Sampler& sampler;
+	Surface& dest;
+	std::vector<float> byColumn;
+	std::vector<float> byRow;
+};
+
 template<class Sampler>
-void _drawProjective(Sampler& sampler, TransformMapping& srcMapping, Surface& dest, TransformMapping& destMapping)
+struct ProjectiveTiles
+{
+	ProjectiveTiles(const Sampler& s, const mat3& targetToSource, Surface& d) : sampler(s), m(targetToSource), dest(d) {}
+
+	void operator()(int x0, int y0, int x1, int y1, Scratch&) const
+	{
+		//for each target pixel find one in source!
+		VecExt<float> vecExt;
+		int inc = dest.getPixelInc();
+		for(int y = y0; y < y1; y++)
+		{
+			uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+			for(int x = x0; x < x1; x++, line += inc)
+			{
+				vec3 vSrc = vecExt.transformVec(m, vec3(x,y,1));
+				vSrc /= vSrc.z;
+				_sample(sampler, vSrc.x, vSrc.y, line, dest);
+			}
+		}
+	}
+
+	const Sampler& sampler;
+	mat3 m;
+	Surface& dest;
+};
+
+template<class Sampler>
+void _drawProjective(const Sampler& sampler, TransformMapping& srcMapping, Surface& dest, TransformMapping& destMapping, ExecutionContext& context)
 {
 	//calculate matrix mapping each pixel in target to a coordinate in source
 	mat3 uvToTarget = _mapUnitSquareToQuad(destMapping.localQuad);
@@ -110,25 +471,24 @@ void _drawProjective(Sampler& sampler, TransformMapping& srcMapping, Surface& de
 	mat3 uvToSource = _mapUnitSquareToQuad(srcMapping.localQuad);
 	mat3 targetToSource = uvToSource * targetToUV;
 
-	//for each target pixel find one in source!
-	float srcWidth = sampler.source.getWidth();
-	float srcHeight = sampler.source.getHeight();
-	Color8u blank = Color8u();
-	for(int x = 0; x < dest.getWidth(); x++)
-		for(int y = 0; y < dest.getHeight(); y++)
-		{
-            VecExt<float> vecExt;
-			vec3 vSrc = vecExt.transformVec(targetToSource, vec3(x,y,1));
- 
-            vSrc /= vSrc.z;
-			if(vSrc.x >= 0 && vSrc.y >= 0 && vSrc.x < srcWidth && vSrc.y < srcHeight)
-				dest.setPixel(ivec2(x,y), sampler(vSrc.x, vSrc.y) );
-			else
-				dest.setPixel(ivec2(x,y), blank);
-		}
+	switch(_classify(targetToSource))
+	{
+	case MC_AXIS_ALIGNED:
+		_forEachTile(context, SeparableTiles<false, Sampler>(sampler, targetToSource, dest), dest.getWidth(), dest.getHeight());
+		break;
+	case MC_TRANSPOSED:
+		_forEachTile(context, SeparableTiles<true, Sampler>(sampler, targetToSource, dest), dest.getWidth(), dest.getHeight());
+		break;
+	case MC_AFFINE:
+		_forEachTile(context, AffineTiles<Sampler>(sampler, targetToSource, dest), dest.getWidth(), dest.getHeight());
+		break;
+	default:
+		_forEachTile(context, ProjectiveTiles<Sampler>(sampler, targetToSource, dest), dest.getWidth(), dest.getHeight());
+		break;
+	}
 }
 
-vec2 _transformInvBilinear(vec2 p, vec2* q)
+vec2 _transformInvBilinear(vec2 p, const vec2* q)
 {	
 	//non-inverse is easy: 
 	//p = (1-u)*(1-v)*q[0] + (1-u)*v*q[3] + u*(1-v)*q[1] + u*v*q[2]
@@ -166,105 +526,752 @@ vec2 _transformInvBilinear(vec2 p, vec2* q)
 }
 
 template<class Sampler>
-void _drawBilinear(Sampler& sampler, TransformMapping& srcMapping, Surface& dest, TransformMapping& destMapping)
+struct BilinearTiles
 {
-	mat3 uvToSource = _mapUnitSquareToQuad(srcMapping.localQuad);
+	BilinearTiles(const Sampler& s, const mat3& uvToSource, const vec2* targetQuad, Surface& d) : sampler(s), m(uvToSource), dest(d)
+	{
+		for(int i = 0; i < 4; i++)
+			quad[i] = targetQuad[i];
+	}
 
-	//for each target pixel find one in source!
-	float srcWidth = sampler.source.getWidth();
-	float srcHeight = sampler.source.getHeight();
-	Color8u blank = Color8u();
-	for(int x = 0; x < dest.getWidth(); x++)
-		for(int y = 0; y < dest.getHeight(); y++)
+	void operator()(int x0, int y0, int x1, int y1, Scratch&) const
+	{
+		//for each target pixel find one in source!
+		VecExt<float> vecExt;
+		int inc = dest.getPixelInc();
+		for(int y = y0; y < y1; y++)
 		{
-			float u = (x+0.5) / (float)dest.getWidth();
-			float v = (y+0.5) / (float)dest.getHeight();
-			vec2 uv = _transformInvBilinear(vec2(x,y), destMapping.localQuad);
-			if(u >= 0 && u <= 1 && v >= 0 && v <= 1)
+			uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+			for(int x = x0; x < x1; x++, line += inc)
 			{
-                VecExt<float> vecExt;
-				vec3 vSrc = vecExt.transformVec(uvToSource, vec3(uv.x,uv.y,1));
+				vec2 uv = _transformInvBilinear(vec2(x,y), quad);
+				vec3 vSrc = vecExt.transformVec(m, vec3(uv.x,uv.y,1));
 				vSrc /= vSrc.z;
-				if(vSrc.x >= 0 && vSrc.y >= 0 && vSrc.x < srcWidth && vSrc.y < srcHeight)
-					dest.setPixel(ivec2(x,y), sampler(vSrc.x, vSrc.y) );
-				else
-					dest.setPixel(ivec2(x,y), blank);
-			};
-		}	
+				_sample(sampler, vSrc.x, vSrc.y, line, dest);
+			}
+		}
+	}
+
+	const Sampler& sampler;
+	mat3 m;
+	vec2 quad[4];
+	Surface& dest;
+};
+
+template<class Sampler>
+void _drawBilinear(const Sampler& sampler, TransformMapping& srcMapping, Surface& dest, TransformMapping& destMapping, ExecutionContext& context)
+{
+	mat3 uvToSource = _mapUnitSquareToQuad(srcMapping.localQuad);
+	_forEachTile(context, BilinearTiles<Sampler>(sampler, uvToSource, destMapping.localQuad, dest), dest.getWidth(), dest.getHeight());
+}
+
+//****** COORDINATE MAP ******
+
+//source coordinates of one target row, same terms in the same order as the draw functions
+void _projectiveRow(const mat3& m, MappingClass mc, int y, int width, float* xs, float* ys)
+{
+	if(mc != MC_PROJECTIVE)
+	{
+		float rowX = m[1][0] * y;
+		float rowY = m[1][1] * y;
+		for(int x = 0; x < width; x++)
+		{
+			xs[x] = m[0][0] * x + rowX + m[2][0];
+			ys[x] = m[0][1] * x + rowY + m[2][1];
+		}
+		return;
+	}
+	VecExt<float> vecExt;
+	for(int x = 0; x < width; x++)
+	{
+		vec3 vSrc = vecExt.transformVec(m, vec3(x,y,1));
+		vSrc /= vSrc.z;
+		xs[x] = vSrc.x;
+		ys[x] = vSrc.y;
+	}
+}
+
+void _bilinearRow(const mat3& uvToSource, const vec2* quad, int y, int width, float* xs, float* ys)
+{
+	VecExt<float> vecExt;
+	for(int x = 0; x < width; x++)
+	{
+		vec2 uv = _transformInvBilinear(vec2(x,y), quad);
+		vec3 vSrc = vecExt.transformVec(uvToSource, vec3(uv.x,uv.y,1));
+		vSrc /= vSrc.z;
+		xs[x] = vSrc.x;
+		ys[x] = vSrc.y;
+	}
+}
+
+const float CoordinateMap::OUTSIDE = -1.0f;
+
+CoordinateMap::CoordinateMap() : width(0), height(0), sourceWidth(0), sourceHeight(0), mMethod(TM_IDENTITY)
+{
+}
+
+CoordinateMap::CoordinateMap(TransformMapping& targetMapping, TransformMethod method, int sourceWidth, int sourceHeight)
+{
+	build(targetMapping, method, sourceWidth, sourceHeight);
+}
+
+void CoordinateMap::build(TransformMapping& targetMapping, TransformMethod method, int srcWidth, int srcHeight)
+{
+	for(int i = 0; i < 4; i++)
+		mQuad[i] = targetMapping.localQuad[i];
+	mBounds = targetMapping.bounds;
+	mMethod = method;
+	sourceWidth = srcWidth;
+	sourceHeight = srcHeight;
+	if(method == TM_IDENTITY)
+	{
+		width = srcWidth;
+		height = srcHeight;
+	}
+	else
+	{
+		width = (int)targetMapping.bounds.getWidth();
+		height = (int)targetMapping.bounds.getHeight();
+	}
+	spans.resize(height);
+	coords.clear();
+
+	TransformMapping srcMapping(Rectf(0, 0, (float)srcWidth, (float)srcHeight));
+	mat3 uvToSource = _mapUnitSquareToQuad(srcMapping.localQuad);
+	mat3 targetToSource;
+	if(method == TM_PROJECTIVE)
+		targetToSource = uvToSource * inverse(_mapUnitSquareToQuad(targetMapping.localQuad));
+	MappingClass mc = (method == TM_IDENTITY) ? MC_AXIS_ALIGNED : _classify(targetToSource);
+
+	std::vector<float> xs(width + 1);
+	std::vector<float> ys(width + 1);
+	for(int y = 0; y < height; y++)
+	{
+		if(method == TM_BILINEAR)
+			_bilinearRow(uvToSource, targetMapping.localQuad, y, width, &xs[0], &ys[0]);
+		else
+			_projectiveRow(targetToSource, mc, y, width, &xs[0], &ys[0]);
+
+		Span& span = spans[y];
+		span.begin = 0;
+		span.end = 0;
+		span.offset = coords.size();
+		for(int x = 0; x < width; x++)
+			if(xs[x] >= 0 && ys[x] >= 0 && xs[x] < srcWidth && ys[x] < srcHeight)
+			{
+				if(span.end == 0)
+					span.begin = x;
+				span.end = x + 1;
+			}
+		for(int x = span.begin; x < span.end; x++)
+		{
+			bool inside = xs[x] >= 0 && ys[x] >= 0 && xs[x] < srcWidth && ys[x] < srcHeight;
+			coords.push_back(inside ? xs[x] : OUTSIDE);
+			coords.push_back(inside ? ys[x] : 0);
+		}
+	}
+}
+
+bool CoordinateMap::matches(TransformMapping& targetMapping, TransformMethod method, int srcWidth, int srcHeight) const
+{
+	if(method != mMethod || srcWidth != sourceWidth || srcHeight != sourceHeight || spans.size() != (size_t)height)
+		return false;
+	if(method == TM_IDENTITY)
+		return true;
+	for(int i = 0; i < 4; i++)
+		if(targetMapping.localQuad[i] != mQuad[i])
+			return false;
+	return targetMapping.bounds.getWidth() == mBounds.getWidth() && targetMapping.bounds.getHeight() == mBounds.getHeight();
 }
 
+//pixels of one mapped row, false if it has to go through the sampler
 template<class Sampler>
-Surface pp::transform(Sampler& sampler, TransformMapping& targetMapping, TransformMethod method)
+bool _copyMapped(const Sampler&, const float*, int, uint8_t*, const Surface&)
+{
+	return false;
+}
+
+bool _copyMapped(const NearestNeighbourSampler& sampler, const float* coords, int count, uint8_t* line, const Surface& dest)
+{
+	//a map can rotate, then the tiled copy is faster to read than source rows
+	const Surface& source = sampler.source;
+	if(sampler.tiles || sampler.scaled || source.getPixelInc() != dest.getPixelInc() || source.getChannelOrder().getCode() != dest.getChannelOrder().getCode())
+		return false;
+
+	//same rounding as the sampler, the map is never off the source
+	int maxX = source.getWidth() - 1;
+	int maxY = source.getHeight() - 1;
+	int inc = dest.getPixelInc();
+	for(int i = 0; i < count; i++, coords += 2, line += inc)
+	{
+		if(coords[0] == CoordinateMap::OUTSIDE)
+		{
+			_putBlank(line, dest);
+			continue;
+		}
+		int sx = std::min((int)(coords[0] + 0.5), maxX);
+		int sy = std::min((int)(coords[1] + 0.5), maxY);
+		memcpy(line, source.getData() + sy * source.getRowBytes() + sx * inc, inc);
+	}
+	return true;
+}
+
+template<class Sampler>
+struct MappedTiles
+{
+	MappedTiles(const Sampler& s, const CoordinateMap& coordinates, Surface& d) : sampler(s), map(coordinates), dest(d) {}
+
+	void operator()(int x0, int y0, int x1, int y1, Scratch&) const
+	{
+		int inc = dest.getPixelInc();
+		for(int y = y0; y < y1; y++)
+		{
+			const CoordinateMap::Span& span = map.spans[y];
+			int begin = std::min(std::max(span.begin, x0), x1);
+			int end = std::max(std::min(span.end, x1), begin);
+			uint8_t* line = dest.getData() + y * dest.getRowBytes() + x0 * inc;
+			for(int x = x0; x < begin; x++, line += inc)
+				_putBlank(line, dest);
+
+			const float* coords = end > begin ? &map.coords[span.offset + 2 * (begin - span.begin)] : NULL;
+			if(coords && !_copyMapped(sampler, coords, end - begin, line, dest))
+				for(int x = begin; x < end; x++, coords += 2)
+				{
+					uint8_t* pxl = line + (x - begin) * inc;
+					if(coords[0] == CoordinateMap::OUTSIDE)
+						_putBlank(pxl, dest);
+					else
+						_put(pxl, _sampled(sampler, coords[0], coords[1]), dest);
+				}
+			line += (end - begin) * inc;
+
+			for(int x = end; x < x1; x++, line += inc)
+				_putBlank(line, dest);
+		}
+	}
+
+	const Sampler& sampler;
+	const CoordinateMap& map;
+	Surface& dest;
+};
+
+template<class Sampler>
+Surface pp::transform(Sampler& sampler, const CoordinateMap& map, ExecutionContext* context)
+{
+	Surface result(map.width, map.height, sampler.source.hasAlpha());
+	transform(sampler, map, result, context);
+	return result;
+}
+
+template<class Sampler>
+void pp::transform(Sampler& sampler, const CoordinateMap& map, Surface& result, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "transform");
+	assert(sampler.source.getWidth() == map.sourceWidth && sampler.source.getHeight() == map.sourceHeight);
+	if(!result.getData() || result.getWidth() != map.width || result.getHeight() != map.height)
+		result = Surface(map.width, map.height, sampler.source.hasAlpha());
+	_forEachTile(ctx, MappedTiles<Sampler>(sampler, map, result), map.width, map.height);
+	stats.setPixels((size_t)map.width * map.height);
+}
+
+template<class Sampler>
+Surface pp::transform(Sampler& sampler, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context)
 {
 	if(method == TM_IDENTITY)
 		return sampler.source;
 
-	Surface result(targetMapping.bounds.getWidth(), targetMapping.bounds.getHeight(), sampler.source.hasAlpha());
+	Surface result((int)targetMapping.bounds.getWidth(), (int)targetMapping.bounds.getHeight(), sampler.source.hasAlpha());
+	transform(sampler, targetMapping, method, result, context);
+	return result;
+}
+
+template<class Sampler>
+void pp::transform(Sampler& sampler, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context)
+{
+	if(method == TM_IDENTITY)
+	{
+		if(result.getData() && result.getSize() == sampler.source.getSize())
+			result.copyFrom(sampler.source, sampler.source.getBounds());
+		else
+			result = sampler.source;
+		return;
+	}
+
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "transform");
+	//keep storage provided by the caller (e.g. a mapped file) if it has the right size
+	int width = (int)targetMapping.bounds.getWidth();
+	int height = (int)targetMapping.bounds.getHeight();
+	if(!result.getData() || result.getWidth() != width || result.getHeight() != height)
+		result = Surface(width, height, sampler.source.hasAlpha());
 	TransformMapping srcMapping(sampler.source.getBounds());
 	switch(method)
 	{
 	case TM_PROJECTIVE:
-		_drawProjective(sampler, srcMapping, result, targetMapping);
+		_drawProjective(sampler, srcMapping, result, targetMapping, ctx);
 		break;
 	case TM_BILINEAR:
-		_drawBilinear(sampler, srcMapping, result, targetMapping);
+		_drawBilinear(sampler, srcMapping, result, targetMapping, ctx);
 		break;
     default:
         break;
     }
-	return result;
+	stats.setPixels((size_t)width * height);
+}
+
+template<class Sampler>
+bool pp::transform(Sampler& sampler, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context)
+{
+	int width = method == TM_IDENTITY ? sampler.source.getWidth() : (int)targetMapping.bounds.getWidth();
+	int height = method == TM_IDENTITY ? sampler.source.getHeight() : (int)targetMapping.bounds.getHeight();
+	if(result.empty() || result.width != width || result.height != height)
+		return false;
+	Surface dest = result.surface();
+	transform(sampler, targetMapping, method, dest, context);
+	return true;
+}
+
+template<class Sampler>
+bool pp::transform(Sampler& sampler, const CoordinateMap& map, const ImageView& result, ExecutionContext* context)
+{
+	if(result.empty() || result.width != map.width || result.height != map.height)
+		return false;
+	Surface dest = result.surface();
+	transform(sampler, map, dest, context);
+	return true;
+}
+
+//****** DOMINANCE ******
+
+//Weight of every corner color summed over the corners showing it, -1 for corners repeating
+//a color seen before. A corner D joining an earlier color adds the weight of C, that's how
+//the dominance samplers have always counted it. Branch free so rows can be vectorised.
+inline void _dominanceWeights(const uint32_t corners[4], float subx, float suby, float weights[4])
+{
+	uint32_t a = corners[0] & 0x00FFFFFF;
+	uint32_t b = corners[1] & 0x00FFFFFF;
+	uint32_t c = corners[2] & 0x00FFFFFF;
+	uint32_t d = corners[3] & 0x00FFFFFF;
+	float wA = (1-subx) * (1-suby);
+	float wB = subx * (1-suby);
+	float wC = (1-subx) * suby;
+	float wD = subx * suby;
+	weights[0] = wA + (b == a ? wB : 0.0f) + (c == a ? wC : 0.0f) + (d == a ? wC : 0.0f);
+	weights[1] = b == a ? -1.0f : wB + (c == b ? wC : 0.0f) + (d == b ? wC : 0.0f);
+	weights[2] = (c == a || c == b) ? -1.0f : wC + (d == c ? wC : 0.0f);
+	weights[3] = (d == a || d == b || d == c) ? -1.0f : wD;
+}
+
+void _dominance(const uint32_t corners[4], float subx, float suby, Dominance2x2& result)
+{
+	float weights[4];
+	_dominanceWeights(corners, subx, suby, weights);
+	int first = 0;
+	for(int s = 1; s < 4; s++)
+		first = weights[s] > weights[first] ? s : first;
+	//the samplers used to move A to where the first color was, so it wins ties there
+	int second = 0;
+	float best = -2.0f;
+	int bestKey = 4;
+	for(int s = 0; s < 4; s++)
+	{
+		float w = s == first ? -2.0f : weights[s];
+		int key = s == 0 ? first : s;
+		bool better = w > best || (w == best && key < bestKey);
+		second = better ? s : second;
+		best = better ? w : best;
+		bestKey = better ? key : bestKey;
+	}
+	result.colors = 1 + (weights[1] >= 0) + (weights[2] >= 0) + (weights[3] >= 0);
+	bool several = result.colors > 1;
+	result.first = corners[first];
+	result.second = corners[several ? second : first];
+	result.firstWeight = several ? weights[first] : 1.0f;
+	result.secondWeight = several ? best : 0.0f;
+}
+
+#ifdef PP_DOMINANCE_SSE2
+inline __m128 _select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128i _select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//same as _dominance for 4 pixels
+void _dominance4(const uint32_t* a, const uint32_t* b, const uint32_t* c, const uint32_t* d, const float* subX, const float* subY, Dominance2x2* result)
+{
+	const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128i colors[4];
+	colors[0] = _mm_loadu_si128((const __m128i*)a);
+	colors[1] = _mm_loadu_si128((const __m128i*)b);
+	colors[2] = _mm_loadu_si128((const __m128i*)c);
+	colors[3] = _mm_loadu_si128((const __m128i*)d);
+	__m128i ra = _mm_and_si128(colors[0], rgb);
+	__m128i rb = _mm_and_si128(colors[1], rgb);
+	__m128i rc = _mm_and_si128(colors[2], rgb);
+	__m128i rd = _mm_and_si128(colors[3], rgb);
+	__m128 ab = _mm_castsi128_ps(_mm_cmpeq_epi32(ra, rb));
+	__m128 ac = _mm_castsi128_ps(_mm_cmpeq_epi32(ra, rc));
+	__m128 ad = _mm_castsi128_ps(_mm_cmpeq_epi32(ra, rd));
+	__m128 bc = _mm_castsi128_ps(_mm_cmpeq_epi32(rb, rc));
+	__m128 bd = _mm_castsi128_ps(_mm_cmpeq_epi32(rb, rd));
+	__m128 cd = _mm_castsi128_ps(_mm_cmpeq_epi32(rc, rd));
+
+	__m128 subx = _mm_loadu_ps(subX);
+	__m128 suby = _mm_loadu_ps(subY);
+	__m128 wA = _mm_mul_ps(_mm_sub_ps(one, subx), _mm_sub_ps(one, suby));
+	__m128 wB = _mm_mul_ps(subx, _mm_sub_ps(one, suby));
+	__m128 wC = _mm_mul_ps(_mm_sub_ps(one, subx), suby);
+	__m128 wD = _mm_mul_ps(subx, suby);
+	__m128 none = _mm_set1_ps(-1.0f);
+	__m128 weights[4];
+	weights[0] = _mm_add_ps(_mm_add_ps(_mm_add_ps(wA, _mm_and_ps(ab, wB)), _mm_and_ps(ac, wC)), _mm_and_ps(ad, wC));
+	weights[1] = _select(ab, none, _mm_add_ps(_mm_add_ps(wB, _mm_and_ps(bc, wC)), _mm_and_ps(bd, wC)));
+	weights[2] = _select(_mm_or_ps(ac, bc), none, _mm_add_ps(wC, _mm_and_ps(cd, wC)));
+	weights[3] = _select(_mm_or_ps(_mm_or_ps(ad, bd), cd), none, wD);
+
+	__m128 firstWeight = weights[0];
+	__m128i first = _mm_setzero_si128();
+	__m128i firstColor = colors[0];
+	for(int s = 1; s < 4; s++)
+	{
+		__m128 better = _mm_cmpgt_ps(weights[s], firstWeight);
+		firstWeight = _select(better, weights[s], firstWeight);
+		first = _select(_mm_castps_si128(better), _mm_set1_epi32(s), first);
+		firstColor = _select(_mm_castps_si128(better), colors[s], firstColor);
+	}
+
+	__m128 secondWeight = _mm_set1_ps(-2.0f);
+	__m128i bestKey = _mm_set1_epi32(4);
+	__m128i secondColor = colors[0];
+	for(int s = 0; s < 4; s++)
+	{
+		__m128i index = _mm_set1_epi32(s);
+		__m128 w = _select(_mm_castsi128_ps(_mm_cmpeq_epi32(first, index)), _mm_set1_ps(-2.0f), weights[s]);
+		__m128i key = s == 0 ? first : index;
+		__m128 better = _mm_or_ps(_mm_cmpgt_ps(w, secondWeight), _mm_and_ps(_mm_cmpeq_ps(w, secondWeight), _mm_castsi128_ps(_mm_cmplt_epi32(key, bestKey))));
+		secondWeight = _select(better, w, secondWeight);
+		bestKey = _select(_mm_castps_si128(better), key, bestKey);
+		secondColor = _select(_mm_castps_si128(better), colors[s], secondColor);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	__m128i seen1 = _mm_castps_si128(_mm_cmpge_ps(weights[1], zero));
+	__m128i seen2 = _mm_castps_si128(_mm_cmpge_ps(weights[2], zero));
+	__m128i seen3 = _mm_castps_si128(_mm_cmpge_ps(weights[3], zero));
+	__m128i count = _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(_mm_set1_epi32(1), seen1), seen2), seen3);
+	__m128i several = _mm_or_si128(_mm_or_si128(seen1, seen2), seen3);
+	secondColor = _select(several, secondColor, firstColor);
+	firstWeight = _select(_mm_castsi128_ps(several), firstWeight, one);
+	secondWeight = _mm_and_ps(_mm_castsi128_ps(several), secondWeight);
+
+	uint32_t firsts[4];
+	uint32_t seconds[4];
+	float firstWeights[4];
+	float secondWeights[4];
+	int counts[4];
+	_mm_storeu_si128((__m128i*)firsts, firstColor);
+	_mm_storeu_si128((__m128i*)seconds, secondColor);
+	_mm_storeu_ps(firstWeights, firstWeight);
+	_mm_storeu_ps(secondWeights, secondWeight);
+	_mm_storeu_si128((__m128i*)counts, count);
+	for(int i = 0; i < 4; i++)
+	{
+		result[i].first = firsts[i];
+		result[i].second = seconds[i];
+		result[i].firstWeight = firstWeights[i];
+		result[i].secondWeight = secondWeights[i];
+		result[i].colors = counts[i];
+	}
+}
+#endif
+
+void pp::dominance2x2(const uint32_t* a, const uint32_t* b, const uint32_t* c, const uint32_t* d, const float* subX, const float* subY, int count, Dominance2x2* result)
+{
+	int i = 0;
+#ifdef PP_DOMINANCE_SSE2
+	for(; i + 4 <= count; i += 4)
+		_dominance4(a + i, b + i, c + i, d + i, subX + i, subY + i, result + i);
+#endif
+	for(; i < count; i++)
+	{
+		uint32_t corners[4] = {a[i], b[i], c[i], d[i]};
+		_dominance(corners, subX[i], subY[i], result[i]);
+	}
+}
+
+//slot of the color of an order dominance2x2 doesn't return, -1 if there are fewer colors
+int _dominantSlot(const float weights[4], int order, float& weight)
+{
+	int slots[4];
+	float w[4];
+	int n = 0;
+	for(int s = 0; s < 4; s++)
+		if(weights[s] >= 0)
+		{
+			slots[n] = s;
+			w[n++] = weights[s];
+		}
+	if(order >= n)
+		return -1;
+	for(int a = 0; ; a++)
+	{
+		int max = a;
+		for(int k = max + 1; k < n; k++)
+			if(w[k] > w[max])
+				max = k;
+		if(a == order)
+		{
+			weight = w[max];
+			return slots[max];
+		}
+		w[max] = w[a];
+		slots[max] = slots[a];
+	}
+}
+
+//corners a b / c d around x, y like the bilinear sampler picks them, the right and bottom
+//ones are the left and top ones again where x or y is whole
+template<class Sampler>
+inline void _corners(const Sampler& sampler, float x, float y, uint32_t corners[4], float& subx, float& suby)
+{
+	int x1 = floor(x);
+	int y1 = floor(y);
+	int right = (int)ceil(x) - x1;
+	int bottom = 2 * ((int)ceil(y) - y1);
+	subx = x - x1;
+	suby = y - y1;
+	uint32_t window[4];
+	_window(sampler, x1, y1, 2, 2, window);
+	corners[0] = window[0];
+	corners[1] = window[right];
+	corners[2] = window[bottom];
+	corners[3] = window[bottom + right];
+}
+
+struct DominanceTiles
+{
+	DominanceTiles(const BilinearDominanceSampler& s, const CoordinateMap& coordinates, Surface& f, Surface& sec, Surface& w)
+	:	sampler(s), map(coordinates), first(f), second(sec), firstWeight(w) {}
+
+	void operator()(int x0, int y0, int x1, int y1, Scratch& scratch) const
+	{
+		int count = x1 - x0;
+		uint8_t* memory = scratch.get<uint8_t>(count * (4 * sizeof(uint32_t) + 2 * sizeof(float) + sizeof(Dominance2x2)));
+		Dominance2x2* result = reinterpret_cast<Dominance2x2*>(memory);
+		uint32_t* a = reinterpret_cast<uint32_t*>(result + count);
+		uint32_t* b = a + count;
+		uint32_t* c = b + count;
+		uint32_t* d = c + count;
+		float* subX = reinterpret_cast<float*>(d + count);
+		float* subY = subX + count;
+
+		for(int y = y0; y < y1; y++)
+		{
+			const CoordinateMap::Span& span = map.spans[y];
+			int begin = std::min(std::max(span.begin, x0), x1);
+			int end = std::max(std::min(span.end, x1), begin);
+			for(int x = begin; x < end; x++)
+			{
+				const float* coords = &map.coords[span.offset + 2 * (x - span.begin)];
+				int i = x - begin;
+				if(coords[0] == CoordinateMap::OUTSIDE)
+				{
+					a[i] = b[i] = c[i] = d[i] = 0;
+					subX[i] = subY[i] = 0;
+					continue;
+				}
+				float sx = coords[0];
+				float sy = coords[1];
+				uint32_t flat;
+				if(sampler.blocks && sampler.blocks->uniform((int)floor(sx), (int)floor(sy), (int)ceil(sx), (int)ceil(sy), flat))
+				{
+					a[i] = b[i] = c[i] = d[i] = flat;
+					subX[i] = subY[i] = 0;
+					continue;
+				}
+				uint32_t corners[4];
+				_corners(sampler, sx, sy, corners, subX[i], subY[i]);
+				a[i] = corners[0];
+				b[i] = corners[1];
+				c[i] = corners[2];
+				d[i] = corners[3];
+			}
+			dominance2x2(a, b, c, d, subX, subY, end - begin, result);
+
+			for(int x = x0; x < x1; x++)
+			{
+				uint8_t* f = first.getData() + y * first.getRowBytes() + x * first.getPixelInc();
+				uint8_t* s = second.getData() + y * second.getRowBytes() + x * second.getPixelInc();
+				uint8_t* w = firstWeight.getData() + y * firstWeight.getRowBytes() + x * firstWeight.getPixelInc();
+				if(x < begin || x >= end || map.coords[span.offset + 2 * (x - span.begin)] == CoordinateMap::OUTSIDE)
+				{
+					_putBlank(f, first);
+					_putBlank(s, second);
+					_putBlank(w, firstWeight);
+					continue;
+				}
+				const Dominance2x2& r = result[x - begin];
+				_put(f, _unpackColor(r.first), first);
+				_put(s, _unpackColor(r.second), second);
+				_put(w, ColorA8u(r.firstWeight * 255, 0, 0), firstWeight);
+			}
+		}
+	}
+
+	const BilinearDominanceSampler& sampler;
+	const CoordinateMap& map;
+	Surface& first;
+	Surface& second;
+	Surface& firstWeight;
+};
+
+//keep storage provided by the caller if it has the size of the map
+void _fitMapped(const CoordinateMap& map, bool alpha, Surface& result)
+{
+	if(result.getData() && result.getWidth() == map.width && result.getHeight() == map.height)
+		return;
+	result = Surface(map.width, map.height, alpha);
+}
+
+void pp::transformDominance(const BilinearDominanceSampler& source, const CoordinateMap& map, Surface& first, Surface& second, Surface& firstWeight, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "transformDominance");
+	const Surface& shape = source.source;
+	assert(shape.getWidth() == map.sourceWidth && shape.getHeight() == map.sourceHeight);
+	assert(!source.blocks || (source.blocks->width() == shape.getWidth() && source.blocks->height() == shape.getHeight()));
+	_fitMapped(map, shape.hasAlpha(), first);
+	_fitMapped(map, shape.hasAlpha(), second);
+	_fitMapped(map, shape.hasAlpha(), firstWeight);
+	_forEachTile(ctx, DominanceTiles(source, map, first, second, firstWeight), map.width, map.height);
+	stats.setPixels((size_t)map.width * map.height);
+}
+
+//sampling, compare and choose are the stages, the latter two read 3x3 around each pixel
+struct MinimizeErrorStages
+{
+	MinimizeErrorStages(const BicubicSampler& smooth, const BilinearDominanceSampler& dominance, const CoordinateMap& map, float swapThreshold, Surface& b, Surface& f, Surface& s, Surface& w, Surface& e, Surface& r)
+	:	bicubicTiles(smooth, map, b), dominanceTiles(dominance, map, f, s, w), bicubic(b), first(f), second(s), secondWeight(w), error(e), result(r), threshold(swapThreshold) {}
+
+	void operator()(int stage, int x0, int y0, int x1, int y1, Scratch& scratch) const
+	{
+		switch(stage)
+		{
+		case 0:
+			bicubicTiles(x0, y0, x1, y1, scratch);
+			dominanceTiles(x0, y0, x1, y1, scratch);
+			break;
+		case 1:
+			compare(bicubic, first, error, Area(x0, y0, x1, y1));
+			break;
+		default:
+			choose(first, second, error, secondWeight, threshold, result, Area(x0, y0, x1, y1));
+			break;
+		}
+	}
+
+	MappedTiles<BicubicSampler> bicubicTiles;
+	DominanceTiles dominanceTiles;
+	Surface& bicubic;
+	Surface& first;
+	Surface& second;
+	Surface& secondWeight;
+	Surface& error;
+	Surface& result;
+	float threshold;
+};
+
+void pp::transformMinimizeError(const BicubicSampler& smooth, const BilinearDominanceSampler& dominance, const CoordinateMap& map, float threshold, Surface& result, ExecutionContext* context)
+{
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	StatsScope stats(ctx, "transformMinimizeError");
+	assert(smooth.source.getWidth() == map.sourceWidth && smooth.source.getHeight() == map.sourceHeight);
+	assert(dominance.source.getWidth() == map.sourceWidth && dominance.source.getHeight() == map.sourceHeight);
+	//intermediates from the pool, they don't outlive the call
+	SurfaceRef bicubic = ctx.acquire(map.width, map.height, smooth.source.hasAlpha());
+	SurfaceRef first = ctx.acquire(map.width, map.height, dominance.source.hasAlpha());
+	SurfaceRef second = ctx.acquire(map.width, map.height, dominance.source.hasAlpha());
+	SurfaceRef secondWeight = ctx.acquire(map.width, map.height, dominance.source.hasAlpha());
+	SurfaceRef error = ctx.acquire(map.width, map.height, false);
+	_fitMapped(map, false, result);
+
+	TileGraph graph(ctx, map.width, map.height, 3);
+	graph.run(MinimizeErrorStages(smooth, dominance, map, threshold, *bicubic, *first, *second, *secondWeight, *error, result));
+
+	stats.setPixels((size_t)map.width * map.height);
 }
 
 //****** SAMPLER ******
 
 //NEAREST NEIGHBOUR
-template Surface pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<NearestNeighbourSampler>(NearestNeighbourSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
 NearestNeighbourSampler::NearestNeighbourSampler(Surface& src)
+:	tiles(NULL), scaled(NULL)
 {
 	source = src;
 }
 
-ColorA8u NearestNeighbourSampler::operator()(float x, float y)
+ColorA8u NearestNeighbourSampler::operator()(float x, float y) const
 {
 	ivec2 srcPxl;
 	srcPxl.x = (int)(x + 0.5);
 	srcPxl.y = (int)(y + 0.5);
-	return source.getPixel(srcPxl);
+	return _pixel(*this, srcPxl.x, srcPxl.y);
 }
 
 //BILINEAR
 
-template Surface pp::transform<BilinearSampler>(BilinearSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<BilinearSampler>(BilinearSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<BilinearSampler>(BilinearSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<BilinearSampler>(BilinearSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<BilinearSampler>(BilinearSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<BilinearSampler>(BilinearSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<BilinearSampler>(BilinearSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
 BilinearSampler::BilinearSampler(cinder::Surface& src)
+:	tiles(NULL), scaled(NULL)
 {
 	source = src;
 }
 
-ColorA8u BilinearSampler::operator()(float x, float y)
+ColorA8u BilinearSampler::operator()(float x, float y) const
 {
 	/*
 		a b
 		c d
 	*/
-	int x1 = floor(x);
-	int y1 = floor(y);
-	int x2 = ceil(x);
-	int y2 = ceil(y);
-	ColorAf a = source.getPixel(ivec2(x1, y1));
-	ColorAf b = source.getPixel(ivec2(x2, y1));
-	ColorAf c = source.getPixel(ivec2(x1, y2));
-	ColorAf d = source.getPixel(ivec2(x2, y2));
-	float subx = x - x1;
-	float suby = y - y1;
+	uint32_t corners[4];
+	float subx, suby;
+	_corners(*this, x, y, corners, subx, suby);
+	ColorAf a = _unpackColor(corners[0]);
+	ColorAf b = _unpackColor(corners[1]);
+	ColorAf c = _unpackColor(corners[2]);
+	ColorAf d = _unpackColor(corners[3]);
 	return a*( (1-subx)	* (1-suby) )
 		 + b*( subx		* (1-suby) )
 		 + c*( (1-subx)	* suby )
 		 + d*( subx		* suby );
 }
 
-template Surface pp::transform<BicubicSampler>(BicubicSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<BicubicSampler>(BicubicSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<BicubicSampler>(BicubicSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<BicubicSampler>(BicubicSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<BicubicSampler>(BicubicSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<BicubicSampler>(BicubicSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<BicubicSampler>(BicubicSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
 double _cubicInterpolate (double p[4], double x) 
 {
@@ -282,22 +1289,25 @@ double _bicubicInterpolate (double p[4][4], double x, double y)
 }
 
 BicubicSampler::BicubicSampler(cinder::Surface& src)
+:	blocks(NULL), tiles(NULL), scaled(NULL)
 {
 	source = src;
 }
 
-ci::ColorA8u BicubicSampler::operator()(float x, float y)
+ci::ColorA8u BicubicSampler::operator()(float x, float y) const
 {
 	/*
 		4x4		
 	*/
 	int x1 = floor(x)-1;
 	int y1 = floor(y)-1;
+	uint32_t window[16];
+	_window(*this, x1, y1, 4, 4, window);
 	double p[3][4][4];
 	for(int ox = 0; ox < 4; ox++)
 		for(int oy = 0; oy < 4; oy++)
 		{
-			ColorAf c = source.getPixel(ivec2(x1+ox, y1+oy));
+			ColorAf c = _unpackColor(window[oy*4 + ox]);
 			p[0][ox][oy] = c.r;
 			p[1][ox][oy] = c.g;
 			p[2][ox][oy] = c.b;
@@ -312,139 +1322,75 @@ ci::ColorA8u BicubicSampler::operator()(float x, float y)
 	return result;
 }
 
-template Surface pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<BilinearDominanceSampler>(BilinearDominanceSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
 BilinearDominanceSampler::BilinearDominanceSampler(cinder::Surface& src, int sampleOrder)
+:	blocks(NULL), tiles(NULL), scaled(NULL)
 {
 	source = src;
 	order = sampleOrder;
 }
 
-ColorA8u BilinearDominanceSampler::operator()(float x, float y)
+ColorA8u BilinearDominanceSampler::operator()(float x, float y) const
 {
 	/*
 		a b
 		c d
 	*/
-	int i = 0;
-	int k = 0;
-	ColorA8u colors[4];
-	float weights[4];
-	int x1 = floor(x);
-	int y1 = floor(y);
-	int x2 = ceil(x);
-	int y2 = ceil(y);
-	float subx = x - x1;
-	float suby = y - y1;
-	//A
-	colors[i] = source.getPixel(ivec2(x1, y1));
-	weights[i] =  (1-subx)	* (1-suby);
-	i++;
-	//B
-	ColorA8u c = source.getPixel(ivec2(x2, y1));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += subx * (1-suby);
-			break;
-		}
-	if(k == i)
-	{
-		colors[i] = c;
-		weights[i] = subx * (1-suby);
-		i++;
-	}
-	//C
-	c = source.getPixel(ivec2(x1, y2));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += (1-subx) * suby;
-			break;
-		}
-	if(k == i)
+	uint32_t corners[4];
+	float subx, suby;
+	_corners(*this, x, y, corners, subx, suby);
+	if(order > 1)
 	{
-		colors[i] = c;
-		weights[i] = (1-subx) * suby;
-		i++;
-	}
-	//D
-	c = source.getPixel(ivec2(x2, y2));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += (1-subx) * suby;
-			break;
-		}
-	if(k == i)
-	{
-		colors[i] = c;
-		weights[i] = subx * suby;
-		i++;
-	}
-	/**
-	int best = 0;
-	for(k = 0; k < i; k++)
-	{
-		if(weights[k] >= weights[best])
-			best = k;
-	}
-	return colors[best];
-	**/
-	if(i == 1)
-		return colors[0];
-
-	//make sure that 
-	int max = 0;
-	int a = -1;
-	while(true)
-	{
-		//assume [a] is max
-		int max = ++a;
-		//find the real max
-		for(k = max + 1; k < i; k++)
-			if(weights[k] > weights[max])
-				max = k; //new max
-		
-		if(a == order)
-			return colors[max];
-		//if we're not done and colors[a] is not max it might still be our result 
-		//so we replace colors[max] (which we don't care for) with colors[a]
-		if(max != a)
-		{
-			weights[max] = weights[a];
-			colors[max] = colors[a];
-		}
+		float weights[4];
+		float weight;
+		_dominanceWeights(corners, subx, suby, weights);
+		int slot = _dominantSlot(weights, order, weight);
+		return _unpackColor(corners[slot < 0 ? 0 : slot]);
 	}
-	return colors[max];
+	Dominance2x2 result;
+	_dominance(corners, subx, suby, result);
+	return _unpackColor(order == 0 ? result.first : result.second);
 }
 
-template Surface pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<BicubicBestFitSampler>(BicubicBestFitSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
-BicubicBestFitSampler::BicubicBestFitSampler(cinder::Surface& src, bool allowOuterPixels) : palette(NULL)
+BicubicBestFitSampler::BicubicBestFitSampler(cinder::Surface& src, bool allowOuterPixels) : palette(NULL), blocks(NULL), tiles(NULL), scaled(NULL)
 {
 	source = src;
 	mode = allowOuterPixels ? LOCAL_4x4 : LOCAL_2x2;
 }
 
-BicubicBestFitSampler::BicubicBestFitSampler(cinder::Surface& src, Palette& colors) : palette(&colors)
+BicubicBestFitSampler::BicubicBestFitSampler(cinder::Surface& src, Palette& colors) : palette(&colors), blocks(NULL), tiles(NULL), scaled(NULL)
 {
 	source = src;
 	mode = PALETTE;
 }
 
-ci::ColorA8u BicubicBestFitSampler::operator()(float x, float y)
+ci::ColorA8u BicubicBestFitSampler::operator()(float x, float y) const
 {
 	/*
 		4x4		
 	*/
 	int x1 = floor(x)-1;
 	int y1 = floor(y)-1;
+	uint32_t window[16];
+	_window(*this, x1, y1, 4, 4, window);
 	double p[3][4][4];
 	for(int ox = 0; ox < 4; ox++)
 		for(int oy = 0; oy < 4; oy++)
 		{
-			ColorAf c = source.getPixel(ivec2(x1+ox, y1+oy));
+			ColorAf c = _unpackColor(window[oy*4 + ox]);
 			p[0][ox][oy] = c.r;
 			p[1][ox][oy] = c.g;
 			p[2][ox][oy] = c.b;
@@ -497,106 +1443,54 @@ ci::ColorA8u BicubicBestFitSampler::operator()(float x, float y)
 	return result;
 }
 
+//ROTSPRITE
+
+template Surface pp::transform<RotSpriteSampler>(RotSpriteSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<RotSpriteSampler>(RotSpriteSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<RotSpriteSampler>(RotSpriteSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<RotSpriteSampler>(RotSpriteSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<RotSpriteSampler>(RotSpriteSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<RotSpriteSampler>(RotSpriteSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
+
 //***
 //***
 //***
 
-template Surface pp::transform<WeightSampler>(WeightSampler& source, TransformMapping& targetMapping, TransformMethod method);
+template Surface pp::transform<WeightSampler>(WeightSampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context);
+template void pp::transform<WeightSampler>(WeightSampler& source, TransformMapping& targetMapping, TransformMethod method, Surface& result, ExecutionContext* context);
+template Surface pp::transform<WeightSampler>(WeightSampler& source, const CoordinateMap& map, ExecutionContext* context);
+template void pp::transform<WeightSampler>(WeightSampler& source, const CoordinateMap& map, Surface& result, ExecutionContext* context);
+template bool pp::transform<WeightSampler>(WeightSampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context);
+template bool pp::transform<WeightSampler>(WeightSampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context);
 
 WeightSampler::WeightSampler(cinder::Surface& src, int sampleOrder)
+:	blocks(NULL), tiles(NULL), scaled(NULL)
 {
 	source = src;
 	order = sampleOrder;
 }
 
-ColorA8u WeightSampler::operator()(float x, float y)
+ColorA8u WeightSampler::operator()(float x, float y) const
 {
 	/*
 		a b
 		c d
 	*/
-	int i = 0;
-	int k = 0;
-	ColorA8u colors[4];
-	float weights[4];
-	int x1 = floor(x);
-	int y1 = floor(y);
-	int x2 = ceil(x);
-	int y2 = ceil(y);
-	float subx = x - x1;
-	float suby = y - y1;
-	//A
-	colors[i] = source.getPixel(ivec2(x1, y1));
-	weights[i] =  (1-subx)	* (1-suby);
-	i++;
-	//B
-	ColorA8u c = source.getPixel(ivec2(x2, y1));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += subx * (1-suby);
-			break;
-		}
-	if(k == i)
-	{
-		colors[i] = c;
-		weights[i] = subx * (1-suby);
-		i++;
-	}
-	//C
-	c = source.getPixel(ivec2(x1, y2));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += (1-subx) * suby;
-			break;
-		}
-	if(k == i)
+	uint32_t corners[4];
+	float subx, suby;
+	_corners(*this, x, y, corners, subx, suby);
+	if(order > 1)
 	{
-		colors[i] = c;
-		weights[i] = (1-subx) * suby;
-		i++;
+		float weights[4];
+		float weight;
+		_dominanceWeights(corners, subx, suby, weights);
+		if(_dominantSlot(weights, order, weight) < 0)//order doesn't exists
+			return ColorA8u(0,0,0);
+		return ColorA8u(weight*255,0,0);
 	}
-	//D
-	c = source.getPixel(ivec2(x2, y2));
-	for(k = 0; k < i; k++)
-		if(colors[k].r == c.r && colors[k].g == c.g && colors[k].b == c.b)
-		{
-			weights[k] += (1-subx) * suby;
-			break;
-		}
-	if(k == i)
-	{
-		colors[i] = c;
-		weights[i] = subx * suby;
-		i++;
-	}
-
-	if(i < (order+1))//order doesn't exists
+	Dominance2x2 result;
+	_dominance(corners, subx, suby, result);
+	if(result.colors < (order+1))//order doesn't exists
 		return ColorA8u(0,0,0);
-
-	if(i == 1 && order == 0)//only one value
-		return ColorA8u(255,0,0);
-
-
-	//make sure that
-    int max = 0;
-	int a = -1;
-	while(true)
-	{
-		//assume [a] is max
-        int max = ++a;
-		//find the real max
-		for(k = max + 1; k < i; k++)
-			if(weights[k] > weights[max])
-				max = k; //new max
-		
-		if(a == order)
-			return ColorA8u(weights[max]*255,0,0);
-		//if we're not done and colors[a] is not max it might still be our result 
-		//so we replace colors[max] (which we don't care for) with colors[a]
-		if(max != a)
-			weights[max] = weights[a];
-	}
-	return ColorA8u(0,255,0);
+	return ColorA8u((order == 0 ? result.firstWeight : result.secondWeight)*255,0,0);
 }
@@ -3,6 +3,12 @@
 #include "cinder/Cinder.h"
 #include "cinder/Surface.h"
 #include "cinder/Rect.h"
+#include "ExecutionContext.h"
+#include "ImageView.h"
+#include "UniformBlocks.h"
+#include "TiledImage.h"
+#include "VirtualScaledImage.h"
+#include <vector>
 
 namespace pp 
 {
@@ -32,29 +38,43 @@ namespace pp
 		SAMPLE_BEST_FIT_ANY,
 		SAMPLE_FIRST_WEIGHT,
 		SAMPLE_SECOND_WEIGHT,
-		SAMPLE_MINIMIZE_ERROR
+		SAMPLE_MINIMIZE_ERROR,
+		SAMPLE_ROTSPRITE
 	};
 	typedef enum SamplingMethod SamplingMethod;
 
+	//Where all pixels a sampler would read have the same color, transforms put the color it
+	//gives for that flat area without calling it, if the sampler has blocks set. Bilinear
+	//interpolation rounds flat areas differently depending on the position, it always samples.
+	//Samplers with tiles set read the tiled copy instead of source, worth it for rotations and
+	//warps of large sources. Samplers with scaled set read that and only use the size of
+	//source, which can then be VirtualScaledImage::shape().
 	struct NearestNeighbourSampler
 	{
 		NearestNeighbourSampler(cinder::Surface& src);
 		ci::Surface source;
-		ci::ColorA8u operator()(float x, float y);
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 
 	struct BilinearSampler
 	{
 		BilinearSampler(cinder::Surface& src);
 		ci::Surface source;
-		ci::ColorA8u operator()(float x, float y);
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 
 	struct BicubicSampler
 	{
 		BicubicSampler(cinder::Surface& src);
 		ci::Surface source;
-		ci::ColorA8u operator()(float x, float y);
+		const UniformBlocks* blocks; //of source, may be NULL
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 	
 	struct BilinearDominanceSampler
@@ -62,7 +82,10 @@ namespace pp
 		BilinearDominanceSampler(cinder::Surface& src, int sampleOrder);
 		ci::Surface source;
 		int order; //0 = most dominant, 1 = 2nd most dominant...
-		ci::ColorA8u operator()(float x, float y);
+		const UniformBlocks* blocks; //of source, may be NULL
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 
 	struct BicubicBestFitSampler
@@ -74,7 +97,10 @@ namespace pp
 		ci::Surface source;
 		ColorSelectMode mode;
 		Palette* palette;
-		ci::ColorA8u operator()(float x, float y);
+		const UniformBlocks* blocks; //of source, may be NULL
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 
 	struct WeightSampler
@@ -82,12 +108,94 @@ namespace pp
 		WeightSampler(cinder::Surface& src, int sampleOrder);
 		ci::Surface source;
 		int order; //0 = most dominant, 1 = 2nd most dominant...
-		ci::ColorA8u operator()(float x, float y);
+		const UniformBlocks* blocks; //of source, may be NULL
+		const TiledImage* tiles; //copy of source to sample from, may be NULL
+		const VirtualScaledImage* scaled; //read instead of source if set, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
 	};
 
+	//Colors of the 2x2 neighbourhood the dominance samplers look at, ordered by the weight of
+	//the corners showing them. Colors are packed 0xAARRGGBB and compared without alpha.
+	struct Dominance2x2
+	{
+		uint32_t first;
+		uint32_t second; //first again if all corners have the same color
+		float firstWeight; //1 if all corners have the same color
+		float secondWeight;
+		int colors; //different colors among the corners
+	};
+
+	//corners a b / c d of count pixels, subX and subY are the positions between them
+	void dominance2x2(const uint32_t* a, const uint32_t* b, const uint32_t* c, const uint32_t* d, const float* subX, const float* subY, int count, Dominance2x2* result);
+
+
+	//The target is drawn in tiles on the threads of the context, so samplers are called from
+	//several threads at once and have to be reentrant.
+	template<class Sampler>
+	cinder::Surface transform(Sampler& source, TransformMapping& targetMapping, TransformMethod method, ExecutionContext* context = NULL);
+
+	//writes into result if it already has the size of targetMapping.bounds
+	template<class Sampler>
+	void transform(Sampler& source, TransformMapping& targetMapping, TransformMethod method, cinder::Surface& result, ExecutionContext* context = NULL);
+	//writes into memory of the caller, returns false if result doesn't have that size
+	template<class Sampler>
+	bool transform(Sampler& source, TransformMapping& targetMapping, TransformMethod method, const ImageView& result, ExecutionContext* context = NULL);
+
+	//Source coordinate of every target pixel of a mapping. Build it once and hand it to any
+	//number of samplers, it stays valid as long as the mapping and the source size don't
+	//change, e.g. for all frames of an animation drawn into the same quad.
+	//Coordinates are the ones the direct transform computes, so every sampler gives the same
+	//pixels either way, and sources of any size can be mapped. Only pixels between the first
+	//and last one inside the source are stored per row.
+	struct CoordinateMap
+	{
+		static const float OUTSIDE; //x of pixels inside a span that miss the source, < 0
+
+		struct Span
+		{
+			int begin;
+			int end;
+			size_t offset; //of the x, y pair of begin in coords
+		};
+
+		CoordinateMap();
+		CoordinateMap(TransformMapping& targetMapping, TransformMethod method, int sourceWidth, int sourceHeight);
+
+		void build(TransformMapping& targetMapping, TransformMethod method, int sourceWidth, int sourceHeight);
+		bool matches(TransformMapping& targetMapping, TransformMethod method, int sourceWidth, int sourceHeight) const;
+
+		int width;
+		int height;
+		int sourceWidth;
+		int sourceHeight;
+		std::vector<Span> spans; //one per row
+		std::vector<float> coords; //x, y pairs
+
+	private:
+		ci::vec2 mQuad[4];
+		ci::Rectf mBounds;
+		TransformMethod mMethod;
+	};
 
 	template<class Sampler>
-	cinder::Surface transform(Sampler& source, TransformMapping& targetMapping, TransformMethod method);
+	cinder::Surface transform(Sampler& source, const CoordinateMap& map, ExecutionContext* context = NULL);
+
+	//writes into result if it already has the size of the map
+	template<class Sampler>
+	void transform(Sampler& source, const CoordinateMap& map, cinder::Surface& result, ExecutionContext* context = NULL);
+	template<class Sampler>
+	bool transform(Sampler& source, const CoordinateMap& map, const ImageView& result, ExecutionContext* context = NULL);
+
+	//Orders 0 and 1 of BilinearDominanceSampler and order 0 of WeightSampler in one pass, every
+	//neighbourhood is only looked at once. Reads what the sampler reads, its order is ignored.
+	//Writes into results that have the size of the map.
+	void transformDominance(const BilinearDominanceSampler& source, const CoordinateMap& map, cinder::Surface& first, cinder::Surface& second, cinder::Surface& firstWeight, ExecutionContext* context = NULL);
+
+	//SAMPLE_MINIMIZE_ERROR: bicubic and dominance sampling, compare and choose as one tile graph,
+	//so a tile is compared and chosen as soon as the tiles around it are sampled instead of
+	//after the whole image. Same result as the separate calls, the weight transformDominance
+	//gives is the one choose takes. Writes into result if it has the size of the map.
+	void transformMinimizeError(const BicubicSampler& smooth, const BilinearDominanceSampler& dominance, const CoordinateMap& map, float threshold, cinder::Surface& result, ExecutionContext* context = NULL);
 
 
 }
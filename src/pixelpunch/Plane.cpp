@@ -0,0 +1,41 @@
+#include "Plane.h"
+
+using namespace cinder;
+using namespace pp;
+
+void pp::pack(const Surface& source, PixelPlane& result)
+{
+	result.resize(source.getWidth(), source.getHeight());
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	for(int y = 0; y < result.height; y++)
+	{
+		const uint8_t* line = source.getData() + y * source.getRowBytes();
+		uint32_t* dst = result.row(y);
+		for(int x = 0; x < result.width; x++, line += inc)
+			dst[x] = (line[r] << 16) | (line[g] << 8) | line[b];
+	}
+}
+
+void pp::unpack(const PixelPlane& source, Surface& result)
+{
+	int inc = result.getPixelInc();
+	int r = result.getRedOffset();
+	int g = result.getGreenOffset();
+	int b = result.getBlueOffset();
+	int width = std::min(source.width, result.getWidth());
+	int height = std::min(source.height, result.getHeight());
+	for(int y = 0; y < height; y++)
+	{
+		uint8_t* line = result.getData() + y * result.getRowBytes();
+		const uint32_t* src = source.row(y);
+		for(int x = 0; x < width; x++, line += inc)
+		{
+			line[r] = 0xFF & (src[x] >> 16);
+			line[g] = 0xFF & (src[x] >> 8);
+			line[b] = 0xFF & src[x];
+		}
+	}
+}
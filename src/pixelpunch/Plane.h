@@ -0,0 +1,39 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <vector>
+
+namespace pp
+{
+	//Tightly packed single channel image. Colors are packed 0x00RRGGBB just like Kernel
+	//does, indexed images store palette indices.
+	template<typename T>
+	struct Plane
+	{
+		Plane() : width(0), height(0) {}
+		Plane(int w, int h) : width(w), height(h), pixels((size_t)w * h) {}
+
+		void resize(int w, int h)
+		{
+			width = w;
+			height = h;
+			pixels.resize((size_t)w * h);
+		}
+		T* row(int y) { return &pixels[(size_t)y * width]; }
+		const T* row(int y) const { return &pixels[(size_t)y * width]; }
+		T& at(int x, int y) { return pixels[(size_t)y * width + x]; }
+		const T& at(int x, int y) const { return pixels[(size_t)y * width + x]; }
+		//same border handling as Kernel
+		const T& clamped(int x, int y) const { return at(std::min(std::max(x, 0), width - 1), std::min(std::max(y, 0), height - 1)); }
+
+		int width;
+		int height;
+		std::vector<T> pixels;
+	};
+	typedef Plane<uint32_t> PixelPlane;
+
+	void pack(const cinder::Surface& source, PixelPlane& result);
+	//writes RGB only, alpha is left untouched like Kernel::write does
+	void unpack(const PixelPlane& source, cinder::Surface& result);
+}
@@ -0,0 +1,370 @@
+#include "Render.h"
+#include "RotSprite.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace cinder;
+using namespace pp;
+
+RenderSettings::RenderSettings()
+:	scale(SM_NONE), transform(TM_IDENTITY), sampling(SAMPLE_NEAREST), mixThreshold(0.5f)
+{
+	for(int i = 0; i < 4; i++)
+		quad[i] = vec2(0, 0);
+}
+
+//****** NAMES ******
+
+static const char* sScaleNames[] = { "none", "scale2x", "scale3x", "scale4x", "eagle2x", "scale2xhq", "scale3xhq", "scale4xhq", "hq2x", "hq3x", "hq4x" };
+static const char* sTransformNames[] = { "identity", "projective", "bilinear" };
+static const char* sSamplingNames[] = { "nearest", "bilinear", "bicubic", "firstbilinear", "secondbilinear", "bestfitnarrow", "bestfitwide", "bestfitany", "firstweight", "secondweight", "minimizeerror", "rotsprite" };
+
+template<typename Method, int Count>
+bool _parse(const char* (&names)[Count], const std::string& name, Method& method)
+{
+	for(int i = 0; i < Count; i++)
+		if(name == names[i])
+		{
+			method = (Method)i;
+			return true;
+		}
+	return false;
+}
+
+const char* pp::scaleMethodName(ScaleMethod method) { return sScaleNames[method]; }
+const char* pp::transformMethodName(TransformMethod method) { return sTransformNames[method]; }
+const char* pp::samplingMethodName(SamplingMethod method) { return sSamplingNames[method]; }
+bool pp::parseScaleMethod(const std::string& name, ScaleMethod& method) { return _parse(sScaleNames, name, method); }
+bool pp::parseTransformMethod(const std::string& name, TransformMethod& method) { return _parse(sTransformNames, name, method); }
+bool pp::parseSamplingMethod(const std::string& name, SamplingMethod& method) { return _parse(sSamplingNames, name, method); }
+
+//****** SOURCE ******
+
+std::shared_ptr<RenderSource::Scaled> _scaleAll(Surface& source, ScaleMethod method, ExecutionContext* context)
+{
+	//not from the pool of the context, the cache keeps it for longer than a call
+	std::shared_ptr<RenderSource::Scaled> result(new RenderSource::Scaled());
+	int factor = scaleFactor(method);
+	if(method == SM_NONE)
+		result->image = source;
+	else
+	{
+		result->image = Surface(factor * source.getWidth(), factor * source.getHeight(), source.hasAlpha());
+		scale(source, method, result->image, context);
+	}
+	result->blocks.build(result->image);
+	result->tiles.build(result->image);
+	return result;
+}
+
+RenderSource::RenderSource(const Surface& source, bool ownsPixels)
+:	mSource(source), mOwnsPixels(ownsPixels)
+{
+}
+
+RenderSource::RenderSource(const Surface& source, const Palette& palette, bool ownsPixels)
+:	mSource(source), mOwnsPixels(ownsPixels), mPalette(new Palette(palette))
+{
+}
+
+std::shared_ptr<const RenderSource::Scaled> RenderSource::scaled(ScaleMethod method, ExecutionContext* context)
+{
+	//renders of other sources go on while this one scales, renders of this one wait for it
+	std::lock_guard<std::mutex> lock(mLock);
+	std::map<ScaleMethod, std::shared_ptr<const Scaled> >::iterator found = mScaled.find(method);
+	if(found != mScaled.end())
+		return found->second;
+
+	std::shared_ptr<const Scaled> result = _scaleAll(mSource, method, context);
+	mScaled[method] = result;
+	return result;
+}
+
+//scales area of source again into image, reading the halo of the method around it
+void _rescale(const Surface& source, ScaleMethod method, const Area& area, Surface& image, ExecutionContext* context)
+{
+	int halo = scaleHalo(method);
+	int factor = scaleFactor(method);
+	//changed pixels affect the scaled pixels up to a halo away, which read another halo
+	int x0 = std::max(area.x1 - halo, 0);
+	int y0 = std::max(area.y1 - halo, 0);
+	int x1 = std::min(area.x2 + halo, source.getWidth());
+	int y1 = std::min(area.y2 + halo, source.getHeight());
+	PixelPlane crop(x1 - x0 + 2 * halo, y1 - y0 + 2 * halo);
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	for(int y = 0; y < crop.height; y++)
+	{
+		//clamped at the image border just like Kernel reads there
+		int sy = std::min(std::max(y0 - halo + y, 0), source.getHeight() - 1);
+		const uint8_t* line = source.getData() + sy * source.getRowBytes();
+		uint32_t* dst = crop.row(y);
+		for(int x = 0; x < crop.width; x++)
+		{
+			const uint8_t* s = line + std::min(std::max(x0 - halo + x, 0), source.getWidth() - 1) * inc;
+			dst[x] = (s[r] << 16) | (s[g] << 8) | s[b];
+		}
+	}
+	PixelPlane scaled;
+	scale(crop, method, scaled, false, context);
+
+	//RGB only, like unpack
+	inc = image.getPixelInc();
+	r = image.getRedOffset();
+	g = image.getGreenOffset();
+	b = image.getBlueOffset();
+	for(int y = y0 * factor; y < y1 * factor; y++)
+	{
+		uint8_t* line = image.getData() + y * image.getRowBytes() + x0 * factor * inc;
+		const uint32_t* src = scaled.row(y - (y0 - halo) * factor) + halo * factor;
+		for(int x = 0; x < (x1 - x0) * factor; x++, line += inc)
+		{
+			line[r] = 0xFF & (src[x] >> 16);
+			line[g] = 0xFF & (src[x] >> 8);
+			line[b] = 0xFF & src[x];
+		}
+	}
+}
+
+//runs of changed blocks in each row of blocks, in pixels
+size_t _changedAreas(const Surface& before, const Surface& after, std::vector<Area>& areas)
+{
+	const int size = RenderSource::UPDATE_BLOCK;
+	int width = after.getWidth();
+	int height = after.getHeight();
+	int inc = after.getPixelInc();
+	int columns = (width + size - 1) / size;
+	std::vector<bool> changed(columns);
+	size_t count = 0;
+	for(int y0 = 0; y0 < height; y0 += size)
+	{
+		int y1 = std::min(y0 + size, height);
+		std::fill(changed.begin(), changed.end(), false);
+		for(int y = y0; y < y1; y++)
+		{
+			const uint8_t* a = before.getData() + y * before.getRowBytes();
+			const uint8_t* b = after.getData() + y * after.getRowBytes();
+			for(int i = 0; i < columns; i++)
+				if(!changed[i])
+				{
+					int x0 = i * size;
+					changed[i] = memcmp(a + x0 * inc, b + x0 * inc, (std::min(x0 + size, width) - x0) * inc) != 0;
+				}
+		}
+		for(int i = 0; i < columns; )
+		{
+			if(!changed[i])
+			{
+				i++;
+				continue;
+			}
+			int first = i;
+			while(i < columns && changed[i])
+				i++;
+			areas.push_back(Area(first * size, y0, std::min(i * size, width), y1));
+			count += i - first;
+		}
+	}
+	return count;
+}
+
+size_t RenderSource::update(const Surface& source, const Palette* palette, ExecutionContext* context)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	Surface before = mSource;
+	mSource = source;
+	const int size = UPDATE_BLOCK;
+	size_t blocks = (size_t)((source.getWidth() + size - 1) / size) * ((source.getHeight() + size - 1) / size);
+	bool sameLayout = before.getWidth() == source.getWidth() && before.getHeight() == source.getHeight() &&
+		before.getPixelInc() == source.getPixelInc() && before.getChannelOrder().getCode() == source.getChannelOrder().getCode();
+	std::vector<Area> areas;
+	size_t changed = sameLayout ? _changedAreas(before, source, areas) : blocks;
+	if(palette)
+		mPalette.reset(new Palette(*palette));
+	else if(changed > 0)
+		mPalette.reset();
+	if(changed == 0)
+		return 0;
+
+	for(std::map<ScaleMethod, std::shared_ptr<const Scaled> >::iterator it = mScaled.begin(); it != mScaled.end(); ++it)
+	{
+		ScaleMethod method = it->first;
+		if(!sameLayout || method == SM_NONE || !scaleIsLocal(method))
+		{
+			it->second = _scaleAll(mSource, method, context);
+			continue;
+		}
+		//results of identity renders share the old image
+		std::shared_ptr<Scaled> result(new Scaled());
+		result->image = it->second->image.clone();
+		for(size_t i = 0; i < areas.size(); i++)
+			_rescale(mSource, method, areas[i], result->image, context);
+		result->blocks.build(result->image);
+		result->tiles.build(result->image);
+		it->second = result;
+	}
+	return changed;
+}
+
+const Palette& RenderSource::palette()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	if(!mPalette)
+	{
+		mPalette.reset(new Palette());
+		getColors(mSource, *mPalette);
+	}
+	return *mPalette;
+}
+
+size_t RenderSource::bytes() const
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	size_t result = mSource.getRowBytes() * mSource.getHeight();
+	for(std::map<ScaleMethod, std::shared_ptr<const Scaled> >::const_iterator it = mScaled.begin(); it != mScaled.end(); ++it)
+	{
+		const Surface& image = it->second->image;
+		//SM_NONE refers to the source pixels, the tiled copy counts anyway
+		if(image.getData() != mSource.getData())
+			result += image.getRowBytes() * image.getHeight();
+		result += (size_t)image.getWidth() * image.getHeight() * 4;
+	}
+	return result;
+}
+
+//****** MAPS ******
+
+MapCache::MapCache(size_t capacity)
+:	mCapacity(std::max<size_t>(capacity, 1))
+{
+}
+
+std::shared_ptr<const CoordinateMap> MapCache::get(TransformMapping& mapping, TransformMethod method, int sourceWidth, int sourceHeight)
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for(MapList::iterator it = mMaps.begin(); it != mMaps.end(); ++it)
+			if((*it)->matches(mapping, method, sourceWidth, sourceHeight))
+			{
+				mMaps.splice(mMaps.begin(), mMaps, it);
+				return mMaps.front();
+			}
+	}
+
+	//built without the lock, two threads missing the same map build it twice
+	std::shared_ptr<CoordinateMap> result(new CoordinateMap(mapping, method, sourceWidth, sourceHeight));
+	std::lock_guard<std::mutex> lock(mLock);
+	mMaps.push_front(result);
+	if(mMaps.size() > mCapacity)
+		mMaps.pop_back();
+	return result;
+}
+
+//****** RENDER ******
+
+void pp::rotatedQuad(float width, float height, float degrees, vec2 quad[4])
+{
+	float angle = degrees * 3.14159265f / 180;
+	vec2 corners[4] = { vec2(0, 0), vec2(width, 0), vec2(width, height), vec2(0, height) };
+	for(int i = 0; i < 4; i++)
+	{
+		vec2 d = corners[i] - vec2(width / 2, height / 2);
+		quad[i] = vec2(d.x * cos(angle) - d.y * sin(angle), d.x * sin(angle) + d.y * cos(angle));
+	}
+}
+
+template<class Sampler>
+void _prepare(Sampler& sampler, const RenderSource::Scaled& scaled)
+{
+	sampler.blocks = &scaled.blocks;
+	sampler.tiles = &scaled.tiles;
+}
+
+void _prepare(NearestNeighbourSampler& sampler, const RenderSource::Scaled& scaled)
+{
+	sampler.tiles = &scaled.tiles;
+}
+
+void _prepare(BilinearSampler& sampler, const RenderSource::Scaled& scaled)
+{
+	sampler.tiles = &scaled.tiles;
+}
+
+template<class Sampler>
+Surface _render(Sampler sampler, const RenderSource::Scaled& scaled, const CoordinateMap& map, ExecutionContext* context)
+{
+	_prepare(sampler, scaled);
+	return transform(sampler, map, context);
+}
+
+Surface pp::render(RenderSource& source, const RenderSettings& settings, MapCache* maps, ExecutionContext* context)
+{
+	std::shared_ptr<const RenderSource::Scaled> scaled = source.scaled(settings.scale, context);
+	Surface image = scaled->image;
+	//unscaled images are the source itself, copied if it's memory of the caller
+	if(settings.transform == TM_IDENTITY)
+		return settings.scale == SM_NONE ? scale(image, SM_NONE, context, false, source.ownsPixels()) : image;
+
+	vec2 quad[4];
+	memcpy(quad, settings.quad, sizeof(quad));
+	if(quad[0] == quad[1] && quad[1] == quad[2] && quad[2] == quad[3])
+	{
+		quad[1] = vec2(image.getWidth(), 0);
+		quad[2] = vec2(image.getWidth(), image.getHeight());
+		quad[3] = vec2(0, image.getHeight());
+	}
+	TransformMapping mapping(quad);
+	std::shared_ptr<const CoordinateMap> map;
+	if(maps)
+		map = maps->get(mapping, settings.transform, image.getWidth(), image.getHeight());
+	else
+		map.reset(new CoordinateMap(mapping, settings.transform, image.getWidth(), image.getHeight()));
+
+	switch(settings.sampling)
+	{
+	case SAMPLE_NEAREST:
+		return _render(NearestNeighbourSampler(image), *scaled, *map, context);
+	case SAMPLE_BILINEAR:
+		return _render(BilinearSampler(image), *scaled, *map, context);
+	case SAMPLE_BICUBIC:
+		return _render(BicubicSampler(image), *scaled, *map, context);
+	case SAMPLE_FIRST_BILINEAR:
+		return _render(BilinearDominanceSampler(image, 0), *scaled, *map, context);
+	case SAMPLE_SECOND_BILINEAR:
+		return _render(BilinearDominanceSampler(image, 1), *scaled, *map, context);
+	case SAMPLE_BEST_FIT_NARROW:
+		return _render(BicubicBestFitSampler(image, false), *scaled, *map, context);
+	case SAMPLE_BEST_FIT_WIDE:
+		return _render(BicubicBestFitSampler(image, true), *scaled, *map, context);
+	case SAMPLE_BEST_FIT_ANY:
+	{
+		//the sampler only reads the palette
+		BicubicBestFitSampler sampler(image, const_cast<Palette&>(source.palette()));
+		sampler.tiles = &scaled->tiles;
+		return transform(sampler, *map, context);
+	}
+	case SAMPLE_FIRST_WEIGHT:
+		return _render(WeightSampler(image, 0), *scaled, *map, context);
+	case SAMPLE_SECOND_WEIGHT:
+		return _render(WeightSampler(image, 1), *scaled, *map, context);
+	case SAMPLE_ROTSPRITE:
+	{
+		RotSpriteSampler sampler(image);
+		sampler.blocks = &scaled->blocks;
+		return transform(sampler, *map, context);
+	}
+	default:
+	{
+		BicubicSampler smooth(image);
+		BilinearDominanceSampler dominance(image, 0);
+		_prepare(smooth, *scaled);
+		_prepare(dominance, *scaled);
+		Surface result;
+		transformMinimizeError(smooth, dominance, *map, settings.mixThreshold * settings.mixThreshold, result, context);
+		return result;
+	}
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "PixelPunch.h"
+#include "PixelScale.h"
+#include "PixelTransform.h"
+#include "UniformBlocks.h"
+#include "TiledImage.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pp
+{
+	//What decides a result of the app's pipeline: upscale the source, then draw it into a
+	//quad with a sampler.
+	struct RenderSettings
+	{
+		RenderSettings();
+		ScaleMethod scale;
+		TransformMethod transform;
+		SamplingMethod sampling;
+		ci::vec2 quad[4]; //target corners starting with TOPLEFT clockwise, all 0 = the scaled source
+		float mixThreshold; //of SAMPLE_MINIMIZE_ERROR, squared before it is passed to choose like the app does
+	};
+
+	//names used on command lines and in job descriptions, e.g. "scale2x", "projective", "bicubic"
+	const char* scaleMethodName(ScaleMethod method);
+	const char* transformMethodName(TransformMethod method);
+	const char* samplingMethodName(SamplingMethod method);
+	bool parseScaleMethod(const std::string& name, ScaleMethod& method);
+	bool parseTransformMethod(const std::string& name, TransformMethod& method);
+	bool parseSamplingMethod(const std::string& name, SamplingMethod& method);
+
+	//A decoded source and what renders of it share: scaled images with their block summaries
+	//and tiled copies, and the palette. Each is made by the first render that needs it. Safe to
+	//render from several threads at once.
+	class RenderSource
+	{
+	public:
+		struct Scaled
+		{
+			cinder::Surface image;
+			UniformBlocks blocks;
+			TiledImage tiles;
+		};
+
+		//source is used as it is, if it doesn't own its pixels (e.g. a mapped file) they have
+		//to stay valid for as long as the RenderSource and ownsPixels is false
+		RenderSource(const cinder::Surface& source, bool ownsPixels = true);
+		//palette of a paletted file, saves looking for the colors of the source
+		RenderSource(const cinder::Surface& source, const Palette& palette, bool ownsPixels = true);
+
+		//blocks update compares the source in
+		static const int UPDATE_BLOCK = 16;
+
+		const cinder::Surface& source() const { return mSource; }
+		bool ownsPixels() const { return mOwnsPixels; }
+		std::shared_ptr<const Scaled> scaled(ScaleMethod method, ExecutionContext* context = NULL);
+		const Palette& palette();
+		size_t bytes() const; //of the source and everything made so far
+
+		//Takes over a new version of the source, e.g. after its file was saved again. Scaled
+		//images keep their pixels where the source didn't change, only the changed blocks and
+		//the halo the method reads around them are scaled again. The HQ cleanups reach further
+		//than the halo and scale everything again, so do sources of another size or layout.
+		//Not while renders of this source are running. palette may be NULL and is found again
+		//if needed. The new source owns its pixels if the old one did. Returns the number of
+		//changed blocks, 0 if the pixels are the same.
+		size_t update(const cinder::Surface& source, const Palette* palette = NULL, ExecutionContext* context = NULL);
+
+	private:
+		RenderSource(const RenderSource&);
+		RenderSource& operator=(const RenderSource&);
+
+		cinder::Surface mSource;
+		bool mOwnsPixels;
+		mutable std::mutex mLock;
+		std::map<ScaleMethod, std::shared_ptr<const Scaled> > mScaled;
+		std::unique_ptr<Palette> mPalette;
+	};
+
+	//Coordinate maps of the most recent targets, shared by renders of all sources of a size.
+	//Safe to use from several threads at once.
+	class MapCache
+	{
+	public:
+		MapCache(size_t capacity = 16);
+		std::shared_ptr<const CoordinateMap> get(TransformMapping& mapping, TransformMethod method, int sourceWidth, int sourceHeight);
+
+	private:
+		typedef std::list<std::shared_ptr<CoordinateMap> > MapList;
+		std::mutex mLock;
+		MapList mMaps; //most recently used first
+		size_t mCapacity;
+	};
+
+	//corners of a width x height rectangle turned around its center, for RenderSettings::quad
+	void rotatedQuad(float width, float height, float degrees, ci::vec2 quad[4]);
+
+	//The result may share the pixels of the scaled image in the source for TM_IDENTITY, don't
+	//write to it. It refers to the pixels of the source itself only if the source owns them.
+	//maps may be NULL.
+	cinder::Surface render(RenderSource& source, const RenderSettings& settings, MapCache* maps = NULL, ExecutionContext* context = NULL);
+}
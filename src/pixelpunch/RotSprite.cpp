@@ -0,0 +1,135 @@
+#include "RotSprite.h"
+#include "PixelScale.h"
+#include "ScaleRules.h"
+#include <atomic>
+#include <cmath>
+
+using namespace cinder;
+using namespace pp;
+using namespace pp::rules;
+
+RotSpriteSampler::RotSpriteSampler(Surface& src, int tileSize, size_t cacheTiles)
+:	blocks(NULL)
+{
+	source = src;
+	mTileSize = std::max(tileSize, 1);
+	mCapacity = std::max<size_t>(cacheTiles, 1);
+	mCache.reset(new Cache());
+
+	//pack with alpha so it takes part in the patterns
+	mPixels.resize(source.getWidth(), source.getHeight());
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	int a = source.getAlphaOffset();
+	bool alpha = source.hasAlpha();
+	for(int y = 0; y < mPixels.height; y++)
+	{
+		const uint8_t* line = source.getData() + y * source.getRowBytes();
+		uint32_t* dst = mPixels.row(y);
+		for(int x = 0; x < mPixels.width; x++, line += inc)
+			dst[x] = ((alpha ? line[a] : 0xFF) << 24) | (line[r] << 16) | (line[g] << 8) | line[b];
+	}
+}
+
+static std::atomic<uint64_t> sNextCache(1);
+
+RotSpriteSampler::Cache::Cache()
+:	id(sNextCache++)
+{
+}
+
+const RotSpriteSampler::Tile& RotSpriteSampler::tile(int x4, int y4) const
+{
+	int span = 4 * mTileSize;
+	int tilesX = (mPixels.width + mTileSize - 1) / mTileSize;
+	int tx = x4 / span;
+	int ty = y4 / span;
+	int key = ty * tilesX + tx;
+
+	static thread_local LastTile last;
+	if(last.cache != mCache->id || last.key != key)
+	{
+		last.tile = load(key, tx, ty);
+		last.cache = mCache->id;
+		last.key = key;
+	}
+	return *last.tile;
+}
+
+RotSpriteSampler::TileRef RotSpriteSampler::load(int key, int tx, int ty) const
+{
+	{
+		std::lock_guard<std::mutex> guard(mCache->lock);
+		std::map<int, TileList::iterator>::iterator found = mCache->index.find(key);
+		if(found != mCache->index.end())
+		{
+			mCache->tiles.splice(mCache->tiles.begin(), mCache->tiles, found->second);
+			return mCache->tiles.front();
+		}
+	}
+
+	//expanded without holding the lock so threads missing different tiles don't wait
+	std::shared_ptr<Tile> t(new Tile());
+	t->key = key;
+	//a halo of 2 source pixels makes the 4x block and its 1 pixel border exact
+	int x0 = std::max(tx * mTileSize - 2, 0);
+	int y0 = std::max(ty * mTileSize - 2, 0);
+	int x1 = std::min((tx + 1) * mTileSize + 2, mPixels.width);
+	int y1 = std::min((ty + 1) * mTileSize + 2, mPixels.height);
+	PixelPlane crop(x1 - x0, y1 - y0);
+	for(int y = y0; y < y1; y++)
+		std::copy(mPixels.row(y) + x0, mPixels.row(y) + x1, crop.row(y - y0));
+	PixelPlane twice;
+	scale(crop, SM_SCALE2x, twice);
+	scale(twice, SM_SCALE2x, t->pixels);
+	t->originX = 4 * x0;
+	t->originY = 4 * y0;
+
+	std::lock_guard<std::mutex> guard(mCache->lock);
+	//another thread may have been faster
+	std::map<int, TileList::iterator>::iterator found = mCache->index.find(key);
+	if(found != mCache->index.end())
+		return *found->second;
+	if(mCache->tiles.size() >= mCapacity)
+	{
+		mCache->index.erase(mCache->tiles.back()->key);
+		mCache->tiles.pop_back();
+	}
+	mCache->tiles.push_front(t);
+	mCache->index[key] = mCache->tiles.begin();
+	return t;
+}
+
+ColorA8u RotSpriteSampler::operator()(float x, float y) const
+{
+	if(mPixels.width == 0 || mPixels.height == 0)
+		return ColorA8u(0, 0, 0, 0);
+
+	//nearest pixel of the 8x image, source pixel centers are at integer coordinates
+	int w8 = 8 * mPixels.width;
+	int h8 = 8 * mPixels.height;
+	int x8 = std::min(std::max((int)floor((x + 0.5f) * 8), 0), w8 - 1);
+	int y8 = std::min(std::max((int)floor((y + 0.5f) * 8), 0), h8 - 1);
+
+	//last Scale2x step on the clamped 3x3 neighbourhood of the 4x parent
+	int x4 = x8 >> 1;
+	int y4 = y8 >> 1;
+	const Tile& t = tile(x4, y4);
+	int w4 = 4 * mPixels.width;
+	int h4 = 4 * mPixels.height;
+	uint32_t n[9];
+	for(int dy = -1; dy <= 1; dy++)
+		for(int dx = -1; dx <= 1; dx++)
+		{
+			int px = std::min(std::max(x4 + dx, 0), w4 - 1) - t.originX;
+			int py = std::min(std::max(y4 + dy, 0), h4 - 1) - t.originY;
+			n[(dy + 1) * 3 + dx + 1] = t.pixels.at(px, py);
+		}
+	uint32_t block[4];
+	uint32_t* rows[2] = { block, block + 2 };
+	Scale2xRules::eval(n, rows, 0);
+	uint32_t c = block[(y8 & 1) * 2 + (x8 & 1)];
+	return ColorA8u((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+}
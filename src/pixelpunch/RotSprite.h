@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "Plane.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace pp
+{
+	class UniformBlocks;
+
+	//RotSprite style sampler: nearest sampling of the source upscaled 8x by Scale2x three times.
+	//The 8x image is never materialised. Source tiles are expanded 4x (Scale2x twice) on demand
+	//and kept in a small LRU cache, the last Scale2x step is evaluated per sample. Colors are
+	//compared including alpha so transparent areas keep their outlines.
+	struct RotSpriteSampler
+	{
+		RotSpriteSampler(cinder::Surface& src, int tileSize = 16, size_t cacheTiles = 64);
+		ci::Surface source;
+		const UniformBlocks* blocks; //of source, may be NULL
+		ci::ColorA8u operator()(float x, float y) const;
+
+	private:
+		struct Tile
+		{
+			int key;
+			int originX; //of pixels in 4x coordinates
+			int originY;
+			PixelPlane pixels;
+		};
+		typedef std::shared_ptr<const Tile> TileRef;
+		typedef std::list<TileRef> TileList;
+
+		//the cache is shared by all threads sampling at once, evicted tiles stay alive
+		//until the last sample using them is done
+		struct Cache
+		{
+			Cache();
+			uint64_t id; //never reused, tells tiles of this cache from those of one freed before
+			std::mutex lock;
+			TileList tiles; //most recently used first
+			std::map<int, TileList::iterator> index;
+		};
+		//the tile a thread sampled last, most samples hit it again without locking the cache
+		struct LastTile
+		{
+			LastTile() : cache(0), key(-1) {}
+			uint64_t cache;
+			int key;
+			TileRef tile;
+		};
+
+		//valid until the thread asks for another tile
+		const Tile& tile(int x4, int y4) const;
+		TileRef load(int key, int tx, int ty) const;
+
+		int mTileSize;
+		size_t mCapacity;
+		PixelPlane mPixels; //0xAARRGGBB
+		std::shared_ptr<Cache> mCache;
+	};
+}
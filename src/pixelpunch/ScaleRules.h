@@ -0,0 +1,525 @@
+#pragma once
+
+#include "Plane.h"
+#include "EqualityMask.h"
+#include "ExecutionContext.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+//Declarative pattern scalers. An algorithm is written down as a table of neighbourhood
+//equality predicates and the cell each output pixel copies when they hold. The templates
+//below expand such a table into an unrolled, branch free kernel for any pixel type
+//(packed colors or palette indices) that runs in parallel bands.
+//
+//In place cleanup passes are written as rewrite rules that assign cells of a window and
+//are evaluated in scan order with the same write back semantics as Kernel.
+//
+//Packed color planes can also be driven by an equality mask (see EqualityMask.h): blocks
+//are expanded into lookup tables indexed by the mask bits they depend on and rewrites only
+//look at pixels whose mask can match.
+
+namespace pp
+{
+	namespace rules
+	{
+		//3x3 neighbourhood, index = y * 3 + x
+		//	A B C
+		//	D E F
+		//	G H I
+		enum Cell3 { A, B, C, D, E, F, G, H, I };
+
+		//****** PREDICATES ******
+
+		struct Always
+		{
+			template<typename T> static bool eval(const T*) { return true; }
+		};
+
+		struct Never
+		{
+			template<typename T> static bool eval(const T*) { return false; }
+		};
+
+		template<int X, int Y>
+		struct Eq
+		{
+			template<typename T> static bool eval(const T* n) { return n[X] == n[Y]; }
+		};
+
+		template<int X, int Y>
+		struct Neq
+		{
+			template<typename T> static bool eval(const T* n) { return n[X] != n[Y]; }
+		};
+
+		template<class P>
+		struct Not
+		{
+			template<typename T> static bool eval(const T* n) { return !P::eval(n); }
+		};
+
+		//non short circuit operators keep the expanded kernels free of branches
+		template<class P0, class P1, class P2 = Always, class P3 = Always, class P4 = Always, class P5 = Always>
+		struct And
+		{
+			template<typename T> static bool eval(const T* n)
+			{
+				return (P0::eval(n) & P1::eval(n) & P2::eval(n) & P3::eval(n) & P4::eval(n) & P5::eval(n)) != 0;
+			}
+		};
+
+		template<class P0, class P1, class P2 = Never, class P3 = Never>
+		struct Or
+		{
+			template<typename T> static bool eval(const T* n)
+			{
+				return (P0::eval(n) | P1::eval(n) | P2::eval(n) | P3::eval(n)) != 0;
+			}
+		};
+
+		//****** OUTPUT SELECTION ******
+
+		//output pixel is n[Cell] if Pred holds, n[Else] otherwise
+		template<class Pred, int Cell, int Else = E>
+		struct Pick
+		{
+			template<typename T> static T eval(const T* n)
+			{
+				T mask = (T)0 - (T)Pred::eval(n);
+				return (n[Cell] & mask) | (n[Else] & ~mask);
+			}
+			template<typename T> static int cell(const T* n) { return Pred::eval(n) ? Cell : Else; }
+		};
+
+		typedef Pick<Always, E> Center;
+
+		//output blocks list their pixels row by row
+		template<class O00, class O10, class O01, class O11>
+		struct Block2
+		{
+			enum { FACTOR = 2 };
+			template<typename T> static void eval(const T* n, T** out, int x)
+			{
+				T* r0 = out[0] + 2 * x;
+				T* r1 = out[1] + 2 * x;
+				r0[0] = O00::eval(n); r0[1] = O10::eval(n);
+				r1[0] = O01::eval(n); r1[1] = O11::eval(n);
+			}
+			template<typename T> static void cells(const T* n, uint8_t* out)
+			{
+				out[0] = O00::cell(n); out[1] = O10::cell(n);
+				out[2] = O01::cell(n); out[3] = O11::cell(n);
+			}
+		};
+
+		template<class O00, class O10, class O20, class O01, class O11, class O21, class O02, class O12, class O22>
+		struct Block3
+		{
+			enum { FACTOR = 3 };
+			template<typename T> static void eval(const T* n, T** out, int x)
+			{
+				T* r0 = out[0] + 3 * x;
+				T* r1 = out[1] + 3 * x;
+				T* r2 = out[2] + 3 * x;
+				r0[0] = O00::eval(n); r0[1] = O10::eval(n); r0[2] = O20::eval(n);
+				r1[0] = O01::eval(n); r1[1] = O11::eval(n); r1[2] = O21::eval(n);
+				r2[0] = O02::eval(n); r2[1] = O12::eval(n); r2[2] = O22::eval(n);
+			}
+			template<typename T> static void cells(const T* n, uint8_t* out)
+			{
+				out[0] = O00::cell(n); out[1] = O10::cell(n); out[2] = O20::cell(n);
+				out[3] = O01::cell(n); out[4] = O11::cell(n); out[5] = O21::cell(n);
+				out[6] = O02::cell(n); out[7] = O12::cell(n); out[8] = O22::cell(n);
+			}
+		};
+
+		template<class Block, typename T>
+		void scaleRows(const Plane<T>& src, Plane<T>& dst, int y0, int y1)
+		{
+			const int factor = Block::FACTOR;
+			int w = src.width;
+			T n[9];
+			T* out[factor];
+			for(int y = y0; y < y1; y++)
+			{
+				const T* r0 = src.row(std::max(y - 1, 0));
+				const T* r1 = src.row(y);
+				const T* r2 = src.row(std::min(y + 1, src.height - 1));
+				for(int i = 0; i < factor; i++)
+					out[i] = dst.row(y * factor + i);
+				for(int x = 0; x < w; x++)
+				{
+					int xl = std::max(x - 1, 0);
+					int xr = std::min(x + 1, w - 1);
+					n[A] = r0[xl]; n[B] = r0[x]; n[C] = r0[xr];
+					n[D] = r1[xl]; n[E] = r1[x]; n[F] = r1[xr];
+					n[G] = r2[xl]; n[H] = r2[x]; n[I] = r2[xr];
+					Block::eval(n, out, x);
+				}
+			}
+		}
+
+		//rows are independent so the image is split into bands of the context's tile height
+		template<class Block, typename T>
+		struct ScaleBands
+		{
+			ScaleBands(const Plane<T>& source, Plane<T>& dest, int bandHeight) : src(source), dst(dest), rows(bandHeight) {}
+			void operator()(int band, Scratch&) const
+			{
+				scaleRows<Block>(src, dst, band * rows, std::min((band + 1) * rows, src.height));
+			}
+			const Plane<T>& src;
+			Plane<T>& dst;
+			int rows;
+		};
+
+		template<class Block, typename T>
+		void scale(const Plane<T>& src, Plane<T>& dst, ExecutionContext& context)
+		{
+			dst.resize(src.width * Block::FACTOR, src.height * Block::FACTOR);
+			int rows = context.tileHeight();
+			context.parallelFor((src.height + rows - 1) / rows, ScaleBands<Block, T>(src, dst, rows));
+		}
+
+		//****** MASK DRIVEN SCALING ******
+
+		/*
+			An Index names the relations a block depends on:
+				BITS						size of the index
+				index(m0, m1, m2, x, xl, xr)	index of pixel x from the mask rows around it
+				pair(bit, a, b)				cells that are equal when bit is set
+		*/
+
+		//labels the cells so that exactly the pairs set in index and what follows from them are equal
+		template<class Index>
+		void labels(int index, int* n)
+		{
+			for(int i = 0; i < 9; i++)
+				n[i] = i;
+			for(int bit = 0; bit < Index::BITS; bit++)
+			{
+				if(!(index & (1 << bit)))
+					continue;
+				int a, b;
+				Index::pair(bit, a, b);
+				int from = n[b];
+				int to = n[a];
+				for(int i = 0; i < 9; i++)
+					if(n[i] == from)
+						n[i] = to;
+			}
+		}
+
+		//cell each output pixel copies for every index
+		template<class Block, class Index>
+		struct BlockTable
+		{
+			enum { CELLS = Block::FACTOR * Block::FACTOR };
+			BlockTable()
+			{
+				int n[9];
+				for(int i = 0; i < (1 << Index::BITS); i++)
+				{
+					labels<Index>(i, n);
+					Block::cells(n, cells[i]);
+				}
+			}
+			uint8_t cells[1 << Index::BITS][CELLS];
+		};
+
+		template<class Block, class Index>
+		void lookupRows(const PixelPlane& src, const MaskPlane& mask, const BlockTable<Block, Index>& table, PixelPlane& dst, int y0, int y1)
+		{
+			const int factor = Block::FACTOR;
+			int w = src.width;
+			uint32_t n[9];
+			uint32_t* out[factor];
+			for(int y = y0; y < y1; y++)
+			{
+				int yu = std::max(y - 1, 0);
+				int yd = std::min(y + 1, src.height - 1);
+				const uint32_t* r0 = src.row(yu);
+				const uint32_t* r1 = src.row(y);
+				const uint32_t* r2 = src.row(yd);
+				const uint16_t* m0 = mask.row(yu);
+				const uint16_t* m1 = mask.row(y);
+				const uint16_t* m2 = mask.row(yd);
+				for(int i = 0; i < factor; i++)
+					out[i] = dst.row(y * factor + i);
+				for(int x = 0; x < w; x++)
+				{
+					//uniform neighbourhoods never match a pattern
+					if((m1[x] & EQ_NEIGHBOURS) == EQ_NEIGHBOURS)
+					{
+						for(int i = 0; i < factor; i++)
+							for(int j = 0; j < factor; j++)
+								out[i][x * factor + j] = r1[x];
+						continue;
+					}
+					int xl = std::max(x - 1, 0);
+					int xr = std::min(x + 1, w - 1);
+					n[A] = r0[xl]; n[B] = r0[x]; n[C] = r0[xr];
+					n[D] = r1[xl]; n[E] = r1[x]; n[F] = r1[xr];
+					n[G] = r2[xl]; n[H] = r2[x]; n[I] = r2[xr];
+					const uint8_t* cells = table.cells[Index::index(m0, m1, m2, x, xl, xr)];
+					for(int i = 0; i < factor; i++)
+						for(int j = 0; j < factor; j++)
+							out[i][x * factor + j] = n[cells[i * factor + j]];
+				}
+			}
+		}
+
+		template<class Block, class Index>
+		struct LookupBands
+		{
+			LookupBands(const PixelPlane& source, const MaskPlane& sourceMask, const BlockTable<Block, Index>& blockTable, PixelPlane& dest, int bandHeight)
+			:	src(source), mask(sourceMask), table(blockTable), dst(dest), rows(bandHeight) {}
+			void operator()(int band, Scratch&) const
+			{
+				lookupRows(src, mask, table, dst, band * rows, std::min((band + 1) * rows, src.height));
+			}
+			const PixelPlane& src;
+			const MaskPlane& mask;
+			const BlockTable<Block, Index>& table;
+			PixelPlane& dst;
+			int rows;
+		};
+
+		template<class Block, class Index>
+		void scale(const PixelPlane& src, const MaskPlane& mask, const BlockTable<Block, Index>& table, PixelPlane& dst, ExecutionContext& context)
+		{
+			dst.resize(src.width * Block::FACTOR, src.height * Block::FACTOR);
+			int rows = context.tileHeight();
+			context.parallelFor((src.height + rows - 1) / rows, LookupBands<Block, Index>(src, mask, table, dst, rows));
+		}
+
+		//****** IN PLACE REWRITES ******
+
+		//assigns the value of From to up to four cells
+		template<int From, int T0, int T1 = -1, int T2 = -1, int T3 = -1>
+		struct Fill
+		{
+			template<typename T> static void apply(T* n)
+			{
+				T value = n[From];
+				n[T0] = value;
+				if(T1 >= 0) n[T1] = value;
+				if(T2 >= 0) n[T2] = value;
+				if(T3 >= 0) n[T3] = value;
+			}
+		};
+
+		template<class Pred, class Action>
+		struct Rewrite
+		{
+			template<typename T> static bool apply(T* n)
+			{
+				if(!Pred::eval(n))
+					return false;
+				Action::apply(n);
+				return true;
+			}
+		};
+
+		struct Skip
+		{
+			template<typename T> static bool apply(T*) { return false; }
+		};
+
+		//rewrites are tried in order, each one sees the changes of the previous ones
+		template<class R0, class R1 = Skip, class R2 = Skip, class R3 = Skip>
+		struct Sequence
+		{
+			template<typename T> static bool apply(T* n)
+			{
+				bool changed = R0::apply(n);
+				changed |= R1::apply(n);
+				changed |= R2::apply(n);
+				changed |= R3::apply(n);
+				return changed;
+			}
+		};
+
+		//a window of Width x Height pixels, the current pixel is at (CenterX, CenterY)
+		template<int Width, int Height, int CenterX, int CenterY, class Rules>
+		struct Pass
+		{
+			enum { WIDTH = Width, HEIGHT = Height, CENTER_X = CenterX, CENTER_Y = CenterY };
+			typedef Rules Rewrites;
+		};
+
+		template<class P, typename T>
+		bool rewriteAt(Plane<T>& plane, int x, int y)
+		{
+			const int W = P::WIDTH;
+			const int H = P::HEIGHT;
+			T n[W * H];
+			int left = x - P::CENTER_X;
+			int top = y - P::CENTER_Y;
+			bool inside = left >= 0 && top >= 0 && left + W <= plane.width && top + H <= plane.height;
+			if(inside)
+			{
+				for(int wy = 0; wy < H; wy++)
+				{
+					const T* line = plane.row(top + wy) + left;
+					for(int wx = 0; wx < W; wx++)
+						n[wy * W + wx] = line[wx];
+				}
+			}
+			else
+			{
+				for(int wy = 0; wy < H; wy++)
+					for(int wx = 0; wx < W; wx++)
+						n[wy * W + wx] = plane.clamped(left + wx, top + wy);
+			}
+
+			if(!P::Rewrites::apply(n))
+				return false;
+
+			//write back column by column like Kernel::write, at the border the last
+			//write to a clamped pixel wins
+			for(int wx = 0; wx < W; wx++)
+				for(int wy = 0; wy < H; wy++)
+				{
+					int px = std::min(std::max(left + wx, 0), plane.width - 1);
+					int py = std::min(std::max(top + wy, 0), plane.height - 1);
+					plane.at(px, py) = n[wy * W + wx];
+				}
+			return true;
+		}
+
+		//visits every pixel in scan order
+		template<class P, typename T>
+		void rewrite(Plane<T>& plane)
+		{
+			for(int y = 0; y < plane.height; y++)
+				for(int x = 0; x < plane.width; x++)
+					rewriteAt<P>(plane, x, y);
+		}
+
+		//Candidate::eval(mask) has to hold for every pixel P can rewrite. The mask is kept
+		//up to date so it can be handed on to the next pass.
+		template<class P, class Candidate>
+		bool rewrite(PixelPlane& plane, MaskPlane& mask, PixelList* rewritten = NULL)
+		{
+			bool changed = false;
+			for(int y = 0; y < plane.height; y++)
+			{
+				const uint16_t* bits = mask.row(y);
+				for(int x = 0; x < plane.width; x++)
+				{
+					if(!Candidate::eval(bits[x]) || !rewriteAt<P>(plane, x, y))
+						continue;
+					changed = true;
+					if(rewritten)
+						rewritten->push_back((uint32_t)y * plane.width + x);
+					int left = x - P::CENTER_X;
+					int top = y - P::CENTER_Y;
+					updateMask(plane, mask, left - 1, top - 1, left + P::WIDTH, top + P::HEIGHT);
+				}
+			}
+			return changed;
+		}
+
+		//Sparse variant, only the pixels of worklist and the pixels ahead whose mask changes
+		//are visited. Dense worklists fall back to the full scan.
+		template<class P, class Candidate>
+		bool rewrite(PixelPlane& plane, MaskPlane& mask, const PixelList& worklist, PixelList* rewritten = NULL)
+		{
+			if(worklist.size() > plane.pixels.size() / 4)
+				return rewrite<P, Candidate>(plane, mask, rewritten);
+
+			std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t> > pending;
+			size_t next = 0;
+			int64_t last = -1;
+			bool changed = false;
+			int w = plane.width;
+			while(next < worklist.size() || !pending.empty())
+			{
+				uint32_t i;
+				if(pending.empty() || (next < worklist.size() && worklist[next] <= pending.top()))
+					i = worklist[next++];
+				else
+				{
+					i = pending.top();
+					pending.pop();
+				}
+				if((int64_t)i <= last)
+					continue;
+				last = i;
+
+				int x = i % w;
+				int y = i / w;
+				if(!Candidate::eval(mask.pixels[i]) || !rewriteAt<P>(plane, x, y))
+					continue;
+				changed = true;
+				if(rewritten)
+					rewritten->push_back(i);
+
+				int x0 = std::max(x - P::CENTER_X - 1, 0);
+				int y0 = std::max(y - P::CENTER_Y - 1, 0);
+				int x1 = std::min(x - P::CENTER_X + P::WIDTH, plane.width - 1);
+				int y1 = std::min(y - P::CENTER_Y + P::HEIGHT, plane.height - 1);
+				updateMask(plane, mask, x0, y0, x1, y1);
+				for(int my = y0; my <= y1; my++)
+					for(int mx = x0; mx <= x1; mx++)
+					{
+						uint32_t j = (uint32_t)my * w + mx;
+						if(j > i && Candidate::eval(mask.pixels[j]))
+							pending.push(j);
+					}
+			}
+			return changed;
+		}
+
+		//Repeats the rewrite until nothing changes or maxPasses is reached. After the first
+		//pass only pixels whose window contains a rewritten pixel are visited again.
+		template<class P, class Candidate>
+		void rewriteUntilStable(PixelPlane& plane, MaskPlane& mask, const PixelList& worklist, int maxPasses = 16)
+		{
+			PixelList work = worklist;
+			PixelList rewritten;
+			for(int pass = 0; pass < maxPasses && !work.empty(); pass++)
+			{
+				rewritten.clear();
+				if(!rewrite<P, Candidate>(plane, mask, work, &rewritten))
+					break;
+				work.clear();
+				int w = plane.width;
+				for(size_t i = 0; i < rewritten.size(); i++)
+				{
+					int x = rewritten[i] % w;
+					int y = rewritten[i] / w;
+					int reachX = P::WIDTH - 1;
+					int reachY = P::HEIGHT - 1;
+					for(int my = std::max(y - reachY, 0); my <= std::min(y + reachY, plane.height - 1); my++)
+						for(int mx = std::max(x - reachX, 0); mx <= std::min(x + reachX, w - 1); mx++)
+							work.push_back((uint32_t)my * w + mx);
+				}
+				std::sort(work.begin(), work.end());
+				work.erase(std::unique(work.begin(), work.end()), work.end());
+			}
+		}
+
+		//****** SHARED RULES ******
+
+		/*
+			A B C
+			D E F -> E0 E1 -> 00 10
+			G H I    E2 E3    01 11
+
+			if (B != H && D != F)
+				E0 = D == B ? D : E;
+				E1 = B == F ? F : E;
+				E2 = D == H ? D : E;
+				E3 = H == F ? F : E;
+		*/
+		typedef And<Neq<B,H>, Neq<D,F> > Scale2xPrereq;
+		typedef Block2<
+			Pick<And<Scale2xPrereq, Eq<D,B> >, D>,	Pick<And<Scale2xPrereq, Eq<B,F> >, F>,
+			Pick<And<Scale2xPrereq, Eq<D,H> >, D>,	Pick<And<Scale2xPrereq, Eq<H,F> >, F>
+		> Scale2xRules;
+	}
+}
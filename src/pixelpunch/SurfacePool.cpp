@@ -0,0 +1,106 @@
+#include "SurfacePool.h"
+
+using namespace cinder;
+using namespace pp;
+
+size_t _bucketSize(size_t bytes)
+{
+	size_t size = 4096;
+	while(size < bytes)
+		size <<= 1;
+	return size;
+}
+
+SurfacePool::Buffers::~Buffers()
+{
+	clear();
+}
+
+void SurfacePool::Buffers::recycle(uint8_t* memory, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.releases++;
+	stats.liveBytes -= size;
+	if(!open || stats.pooledBytes + size > capacity)
+	{
+		stats.discarded++;
+		delete[] memory;
+		return;
+	}
+	free[size].push_back(memory);
+	stats.pooledBytes += size;
+}
+
+void SurfacePool::Buffers::clear()
+{
+	for(BucketMap::iterator it = free.begin(); it != free.end(); ++it)
+	{
+		for(size_t i = 0; i < it->second.size(); i++)
+			delete[] it->second[i];
+		stats.discarded += it->second.size();
+	}
+	free.clear();
+	stats.pooledBytes = 0;
+}
+
+SurfacePool::SurfacePool(size_t capacity)
+:	mBuffers(new Buffers(capacity))
+{
+}
+
+SurfacePool::~SurfacePool()
+{
+	//SurfaceRefs still out free their buffers themselves
+	std::lock_guard<std::mutex> lock(mBuffers->mutex);
+	mBuffers->open = false;
+	mBuffers->clear();
+}
+
+SurfaceRef SurfacePool::acquire(int width, int height, bool alpha)
+{
+	int pixelInc = alpha ? 4 : 3;
+	size_t rowBytes = width * pixelInc;
+	size_t bucket = _bucketSize(rowBytes * height);
+
+	uint8_t* memory = NULL;
+	{
+		std::lock_guard<std::mutex> lock(mBuffers->mutex);
+		std::vector<uint8_t*>& free = mBuffers->free[bucket];
+		if(!free.empty())
+		{
+			memory = free.back();
+			free.pop_back();
+			mBuffers->stats.pooledBytes -= bucket;
+			mBuffers->stats.reuses++;
+		}
+		else
+			mBuffers->stats.allocations++;
+		mBuffers->stats.liveBytes += bucket;
+	}
+	if(!memory)
+		memory = new uint8_t[bucket];
+
+	SurfaceChannelOrder order = alpha ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB;
+	return SurfaceRef(new Surface(memory, width, height, rowBytes, order), Recycle(mBuffers, bucket));
+}
+
+void SurfacePool::clear()
+{
+	std::lock_guard<std::mutex> lock(mBuffers->mutex);
+	mBuffers->clear();
+}
+
+SurfacePoolStats SurfacePool::stats() const
+{
+	std::lock_guard<std::mutex> lock(mBuffers->mutex);
+	return mBuffers->stats;
+}
+
+void SurfacePool::resetStats()
+{
+	std::lock_guard<std::mutex> lock(mBuffers->mutex);
+	mBuffers->stats.allocations = 0;
+	mBuffers->stats.reuses = 0;
+	mBuffers->stats.releases = 0;
+	mBuffers->stats.discarded = 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <map>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace pp
+{
+	struct SurfacePoolStats
+	{
+		SurfacePoolStats() : allocations(0), reuses(0), releases(0), discarded(0), liveBytes(0), pooledBytes(0) {}
+		size_t allocations; //buffers that had to be allocated
+		size_t reuses;      //buffers handed out again after a release
+		size_t releases;    //buffers back in the pool because their last SurfaceRef went away
+		size_t discarded;   //released buffers freed because the pool was full
+		size_t liveBytes;   //handed out and still referred to by a SurfaceRef
+		size_t pooledBytes; //released and waiting for reuse
+	};
+
+	//Recycles the pixel buffers of intermediate Surfaces across renders. Buffers are kept
+	//in power of two size buckets so a Surface of a different size can still reuse the
+	//memory of a slightly larger one. acquire hands out a SurfaceRef over a pool buffer, the
+	//buffer goes back to the pool when the last SurfaceRef is gone, or is freed if the pool
+	//is gone by then. The Surface itself doesn't own the buffer, copies of it mustn't outlive
+	//the SurfaceRef.
+	class SurfacePool
+	{
+	public:
+		SurfacePool(size_t capacity = 256 << 20);
+		~SurfacePool();
+
+		cinder::SurfaceRef acquire(int width, int height, bool alpha);
+		void clear();
+
+		SurfacePoolStats stats() const;
+		void resetStats();
+
+	private:
+		SurfacePool(const SurfacePool&);
+		SurfacePool& operator=(const SurfacePool&);
+
+		//shared with the deleters of the SurfaceRefs handed out
+		struct Buffers
+		{
+			Buffers(size_t capacity) : capacity(capacity), open(true) {}
+			~Buffers();
+			void recycle(uint8_t* memory, size_t size);
+			void clear();
+
+			typedef std::map<size_t, std::vector<uint8_t*> > BucketMap;
+			size_t capacity;
+			bool open;
+			BucketMap free;
+			SurfacePoolStats stats;
+			std::mutex mutex;
+		};
+		struct Recycle
+		{
+			Recycle(const std::shared_ptr<Buffers>& buffers, size_t size) : buffers(buffers), size(size) {}
+			void operator()(cinder::Surface* surface) const
+			{
+				buffers->recycle(surface->getData(), size);
+				delete surface;
+			}
+			std::shared_ptr<Buffers> buffers;
+			size_t size;
+		};
+
+		std::shared_ptr<Buffers> mBuffers;
+	};
+}
@@ -0,0 +1,161 @@
+#include "PixelPunch.h"
+#include "TileCache.h"
+#include <cstring>
+
+using namespace cinder;
+using namespace pp;
+
+uint64_t _hashPixels(const std::vector<uint32_t>& pixels, uint64_t seed)
+{
+	uint64_t h = seed ^ (pixels.size() * 0x9E3779B97F4A7C15ULL);
+	for(size_t i = 0; i < pixels.size(); i++)
+	{
+		h = (h ^ pixels[i]) * 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+TileCache::TileCache(int tileSize, int halo, size_t capacity)
+:	mTileSize(std::max(1, tileSize)),
+	mHalo(std::max(0, halo)),
+	mCapacity(capacity)
+{
+}
+
+void TileCache::clear()
+{
+	mStats.evictions += mEntries.size();
+	mEntries.clear();
+	mStats.entries = 0;
+	mStats.bytes = 0;
+}
+
+void TileCache::resetStats()
+{
+	mStats.hits = 0;
+	mStats.misses = 0;
+	mStats.evictions = 0;
+}
+
+void TileCache::readTile(Surface& source, int x0, int y0, int width, int height)
+{
+	//copy tile and halo into mCrop and mKey, clamped just like Kernel reads at the image border
+	int cropWidth = width + 2 * mHalo;
+	int cropHeight = height + 2 * mHalo;
+	if(mCrop.getWidth() != cropWidth || mCrop.getHeight() != cropHeight || mCrop.hasAlpha() != source.hasAlpha())
+		mCrop = Surface(cropWidth, cropHeight, source.hasAlpha());
+	mKey.resize(cropWidth * cropHeight);
+
+	int srcInc = source.getPixelInc();
+	int srcR = source.getRedOffset();
+	int srcG = source.getGreenOffset();
+	int srcB = source.getBlueOffset();
+	int dstInc = mCrop.getPixelInc();
+	int dstR = mCrop.getRedOffset();
+	int dstG = mCrop.getGreenOffset();
+	int dstB = mCrop.getBlueOffset();
+	uint32_t* key = &mKey[0];
+	for(int cy = 0; cy < cropHeight; cy++)
+	{
+		int sy = constrain(y0 - mHalo + cy, 0, source.getHeight() - 1);
+		const uint8_t* srcLine = source.getData() + sy * source.getRowBytes();
+		uint8_t* dstLine = mCrop.getData() + cy * mCrop.getRowBytes();
+		for(int cx = 0; cx < cropWidth; cx++)
+		{
+			int sx = constrain(x0 - mHalo + cx, 0, source.getWidth() - 1);
+			const uint8_t* s = srcLine + sx * srcInc;
+			uint8_t* d = dstLine + cx * dstInc;
+			d[dstR] = s[srcR];
+			d[dstG] = s[srcG];
+			d[dstB] = s[srcB];
+			*key++ = (s[srcR] << 16) | (s[srcG] << 8) | s[srcB];
+		}
+	}
+}
+
+const TileCache::Entry* TileCache::find(uint64_t hash, ScaleMethod method, int width, int height) const
+{
+	std::pair<EntryMap::const_iterator, EntryMap::const_iterator> range = mEntries.equal_range(hash);
+	for(EntryMap::const_iterator it = range.first; it != range.second; ++it)
+	{
+		const Entry& e = it->second;
+		//a hash collision must never produce a wrong tile
+		if(e.method == method && e.width == width && e.height == height && e.key == mKey)
+			return &e;
+	}
+	return NULL;
+}
+
+const TileCache::Entry* TileCache::insert(uint64_t hash, ScaleMethod method, int width, int height, Surface& scaled)
+{
+	int factor = scaleFactor(method);
+	int inc = scaled.getPixelInc();
+	int blockPitch = width * factor * inc;
+	int blockRows = height * factor;
+	size_t size = mKey.size() * sizeof(uint32_t) + blockPitch * blockRows;
+	if(size > mCapacity)
+		return NULL;
+	if(mStats.bytes + size > mCapacity)
+		clear();
+
+	Entry e;
+	e.method = method;
+	e.width = width;
+	e.height = height;
+	e.key = mKey;
+	e.block.resize(blockPitch * blockRows);
+	//cut the tile from the scaled crop, dropping the scaled halo
+	for(int y = 0; y < blockRows; y++)
+	{
+		const uint8_t* line = scaled.getData() + (mHalo * factor + y) * scaled.getRowBytes() + mHalo * factor * inc;
+		memcpy(&e.block[y * blockPitch], line, blockPitch);
+	}
+	mStats.entries++;
+	mStats.bytes += size;
+	return &mEntries.insert(std::make_pair(hash, e))->second;
+}
+
+Surface TileCache::scale(Surface& source, ScaleMethod method, ExecutionContext* context, bool ownsPixels)
+{
+	//the cleanups of the HQ methods reach further than any halo, unscaled tiles would share mCrop
+	if(method == SM_NONE || !scaleIsLocal(method))
+		return pp::scale(source, method, context, false, ownsPixels);
+
+	int factor = scaleFactor(method);
+	Surface result;
+	genDest(source, factor, result, context);
+
+	uint64_t seed = (uint64_t)method << 56;
+	for(int y0 = 0; y0 < source.getHeight(); y0 += mTileSize)
+		for(int x0 = 0; x0 < source.getWidth(); x0 += mTileSize)
+		{
+			int width = std::min(mTileSize, source.getWidth() - x0);
+			int height = std::min(mTileSize, source.getHeight() - y0);
+			readTile(source, x0, y0, width, height);
+			uint64_t hash = _hashPixels(mKey, seed);
+
+			const Entry* e = find(hash, method, width, height);
+			Surface scaled;
+			if(e)
+				mStats.hits++;
+			else
+			{
+				mStats.misses++;
+				scaled = pp::scale(mCrop, method, context);
+				e = insert(hash, method, width, height, scaled);
+			}
+
+			int inc = result.getPixelInc();
+			int blockPitch = width * factor * inc;
+			for(int y = 0; y < height * factor; y++)
+			{
+				uint8_t* dst = result.getData() + (y0 * factor + y) * result.getRowBytes() + x0 * factor * inc;
+				if(e)
+					memcpy(dst, &e->block[y * blockPitch], blockPitch);
+				else //too large to be cached
+					memcpy(dst, scaled.getData() + (mHalo * factor + y) * scaled.getRowBytes() + mHalo * factor * inc, blockPitch);
+			}
+		}
+	return result;
+}
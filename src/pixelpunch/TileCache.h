@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "PixelScale.h"
+#include <vector>
+#include <map>
+
+namespace pp
+{
+	struct TileCacheStats
+	{
+		TileCacheStats() : hits(0), misses(0), evictions(0), entries(0), bytes(0) {}
+		size_t hits;
+		size_t misses;
+		size_t evictions;
+		size_t entries;
+		size_t bytes;
+	};
+
+	//Memoizes pp::scale per source tile. A tile is identified by its pixels plus a halo
+	//of neighbouring pixels so repeated tiles of a tilemap are only scaled once and then
+	//copied. Methods that aren't scaleIsLocal are passed on to pp::scale as a whole image,
+	//the HQ cleanup passes may propagate further than any halo. So is SM_NONE, which shares
+	//the source unless ownsPixels is false.
+	class TileCache
+	{
+	public:
+		TileCache(int tileSize = 8, int halo = 2, size_t capacity = 64 << 20);
+
+		cinder::Surface scale(cinder::Surface& source, ScaleMethod method, ExecutionContext* context = NULL, bool ownsPixels = true);
+		void clear();
+		void resetStats();
+
+		const TileCacheStats& stats() const { return mStats; }
+		int tileSize() const { return mTileSize; }
+		int halo() const { return mHalo; }
+
+	private:
+		struct Entry
+		{
+			ScaleMethod method;
+			int width;
+			int height;
+			std::vector<uint32_t> key;
+			std::vector<uint8_t> block;
+		};
+		typedef std::multimap<uint64_t, Entry> EntryMap;
+
+		void readTile(cinder::Surface& source, int x0, int y0, int width, int height);
+		const Entry* find(uint64_t hash, ScaleMethod method, int width, int height) const;
+		const Entry* insert(uint64_t hash, ScaleMethod method, int width, int height, cinder::Surface& scaled);
+
+		int mTileSize;
+		int mHalo;
+		size_t mCapacity;
+		EntryMap mEntries;
+		TileCacheStats mStats;
+		std::vector<uint32_t> mKey;
+		cinder::Surface mCrop;
+	};
+}
@@ -0,0 +1,38 @@
+#include "TileGraph.h"
+#include <algorithm>
+
+using namespace cinder;
+using namespace pp;
+
+TileGraph::TileGraph(ExecutionContext& context, int width, int height, int stages)
+:	mContext(context), mWidth(width), mHeight(height), mTileWidth(context.tileWidth()), mTileHeight(context.tileHeight()), mStages(std::max(stages, 1))
+{
+	mColumns = (width + mTileWidth - 1) / mTileWidth;
+	mRows = (height + mTileHeight - 1) / mTileHeight;
+	int tiles = mColumns * mRows;
+	mPending.reset(new std::atomic<int>[(size_t)tiles * (mStages - 1) + 1]);
+	for(int s = 1; s < mStages; s++)
+		for(int t = 0; t < tiles; t++)
+		{
+			//neighbours inside of the grid and the tile itself
+			int x = t % mColumns;
+			int y = t / mColumns;
+			int across = std::min(x + 1, mColumns - 1) - std::max(x - 1, 0) + 1;
+			int down = std::min(y + 1, mRows - 1) - std::max(y - 1, 0) + 1;
+			mPending[(s - 1) * tiles + t] = across * down;
+		}
+}
+
+int TileGraph::finish(int stage, int tile, int ready[9])
+{
+	int tiles = mColumns * mRows;
+	std::atomic<int>* pending = &mPending[stage * tiles];
+	int x = tile % mColumns;
+	int y = tile / mColumns;
+	int count = 0;
+	for(int ny = std::max(y - 1, 0); ny <= std::min(y + 1, mRows - 1); ny++)
+		for(int nx = std::max(x - 1, 0); nx <= std::min(x + 1, mColumns - 1); nx++)
+			if(--pending[ny * mColumns + nx] == 0)
+				ready[count++] = ny * mColumns + nx;
+	return count;
+}
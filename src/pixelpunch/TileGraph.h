@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ExecutionContext.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace pp
+{
+	//Stages of per tile work on an image where a tile of a stage reads the same tile and its
+	//8 neighbours of the stage before, like a 3x3 filter on the result of a transform. A tile
+	//of a later stage runs as soon as its inputs are done, on the thread that finished the last
+	//of them and while they are still in cache, instead of after the whole image of the stage
+	//before. Tiles have the tile size of the context.
+	class TileGraph
+	{
+	public:
+		TileGraph(ExecutionContext& context, int width, int height, int stages);
+
+		//calls stages(stage, x0, y0, x1, y1, scratch) for all tiles of all stages and returns
+		//when all are done. A graph runs once.
+		template<class Stages>
+		void run(const Stages& stages)
+		{
+			mContext.parallelFor(mColumns * mRows, Runner<Stages>(*this, stages));
+		}
+
+	private:
+		template<class Stages>
+		struct Runner
+		{
+			Runner(TileGraph& g, const Stages& s) : graph(g), stages(s) {}
+			void operator()(int tile, Scratch& scratch) const { graph.execute(stages, 0, tile, scratch); }
+			TileGraph& graph;
+			const Stages& stages;
+		};
+
+		template<class Stages>
+		void execute(const Stages& stages, int stage, int tile, Scratch& scratch)
+		{
+			int x0 = (tile % mColumns) * mTileWidth;
+			int y0 = (tile / mColumns) * mTileHeight;
+			stages(stage, x0, y0, std::min(x0 + mTileWidth, mWidth), std::min(y0 + mTileHeight, mHeight), scratch);
+			if(stage + 1 == mStages)
+				return;
+			int ready[9];
+			int count = finish(stage, tile, ready);
+			for(int i = 0; i < count; i++)
+				execute(stages, stage + 1, ready[i], scratch);
+		}
+
+		//tiles of the next stage that have all inputs now that tile is done, returns their count
+		int finish(int stage, int tile, int ready[9]);
+
+		ExecutionContext& mContext;
+		int mWidth;
+		int mHeight;
+		int mTileWidth;
+		int mTileHeight;
+		int mColumns;
+		int mRows;
+		int mStages;
+		std::unique_ptr<std::atomic<int>[]> mPending; //inputs not done yet of each tile of stages 1...
+	};
+}
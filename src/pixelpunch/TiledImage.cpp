@@ -0,0 +1,39 @@
+#include "TiledImage.h"
+
+using namespace cinder;
+using namespace pp;
+
+TiledImage::TiledImage()
+:	mWidth(0), mHeight(0), mColumns(0), mOffset(0)
+{
+}
+
+TiledImage::TiledImage(const Surface& source)
+{
+	build(source);
+}
+
+void TiledImage::build(const Surface& source)
+{
+	mWidth = source.getWidth();
+	mHeight = source.getHeight();
+	mColumns = (mWidth + TILE_SIZE - 1) >> TILE_BITS;
+	int rows = (mHeight + TILE_SIZE - 1) >> TILE_BITS;
+	mMemory.assign(((size_t)mColumns * rows << (2 * TILE_BITS)) + 16, 0);
+	uintptr_t address = reinterpret_cast<uintptr_t>(&mMemory[0]);
+	mOffset = (((address + 63) & ~(uintptr_t)63) - address) / sizeof(uint32_t);
+
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	int a = source.getAlphaOffset();
+	bool alpha = source.hasAlpha();
+	for(int y = 0; y < mHeight; y++)
+	{
+		const uint8_t* line = source.getData() + y * source.getRowBytes();
+		uint32_t* tileRow = &mMemory[mOffset + ((size_t)(y >> TILE_BITS) * mColumns << (2 * TILE_BITS)) + ((y & (TILE_SIZE - 1)) << TILE_BITS)];
+		for(int x = 0; x < mWidth; x++, line += inc)
+			tileRow[((x >> TILE_BITS) << (2 * TILE_BITS)) + (x & (TILE_SIZE - 1))] = ((alpha ? line[a] : 0xFF) << 24) | (line[r] << 16) | (line[g] << 8) | line[b];
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <algorithm>
+#include <vector>
+
+namespace pp
+{
+	//Copy of an image in 8x8 tiles, so pixels close to each other in any direction share
+	//cache lines. Rotations walk the source diagonally and in rows would touch another line
+	//for almost every sample once the angle is large. Colors are packed 0xAARRGGBB, a tile
+	//is 4 cache lines. Build it once per source and again when its pixels change.
+	class TiledImage
+	{
+	public:
+		static const int TILE_BITS = 3;
+		static const int TILE_SIZE = 1 << TILE_BITS;
+
+		TiledImage();
+		TiledImage(const cinder::Surface& source);
+
+		void build(const cinder::Surface& source);
+		int width() const { return mWidth; }
+		int height() const { return mHeight; }
+
+		//clamped to the image like getPixel
+		uint32_t at(int x, int y) const
+		{
+			x = std::min(std::max(x, 0), mWidth - 1);
+			y = std::min(std::max(y, 0), mHeight - 1);
+			size_t tile = (size_t)(y >> TILE_BITS) * mColumns + (x >> TILE_BITS);
+			return mMemory[mOffset + (tile << (2 * TILE_BITS)) + ((y & (TILE_SIZE - 1)) << TILE_BITS) + (x & (TILE_SIZE - 1))];
+		}
+		cinder::ColorA8u pixel(int x, int y) const
+		{
+			uint32_t c = at(x, y);
+			return cinder::ColorA8u((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+		}
+
+	private:
+		int mWidth;
+		int mHeight;
+		int mColumns; //of tiles
+		std::vector<uint32_t> mMemory;
+		size_t mOffset; //of the first tile in mMemory, tiles start on a cache line
+	};
+}
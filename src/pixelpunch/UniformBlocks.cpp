@@ -0,0 +1,105 @@
+#include "UniformBlocks.h"
+#include <algorithm>
+
+using namespace cinder;
+using namespace pp;
+
+UniformBlocks::UniformBlocks()
+:	mWidth(0), mHeight(0)
+{
+}
+
+UniformBlocks::UniformBlocks(const Surface& source)
+{
+	build(source);
+}
+
+void UniformBlocks::build(const Surface& source)
+{
+	mWidth = source.getWidth();
+	mHeight = source.getHeight();
+	for(int l = 0; l < LEVELS; l++)
+	{
+		Level& level = mLevels[l];
+		level.shift = 2 + 2 * l;
+		level.columns = (mWidth + (1 << level.shift) - 1) >> level.shift;
+		level.rows = (mHeight + (1 << level.shift) - 1) >> level.shift;
+		level.uniform.assign((size_t)level.columns * level.rows, 1);
+		level.colors.assign((size_t)level.columns * level.rows, 0);
+	}
+
+	//level 0 from the pixels, a block stays uniform while its pixels match the first one
+	Level& fine = mLevels[0];
+	int inc = source.getPixelInc();
+	int r = source.getRedOffset();
+	int g = source.getGreenOffset();
+	int b = source.getBlueOffset();
+	int a = source.getAlphaOffset();
+	bool alpha = source.hasAlpha();
+	for(int y = 0; y < mHeight; y++)
+	{
+		const uint8_t* line = source.getData() + y * source.getRowBytes();
+		size_t row = (size_t)(y >> fine.shift) * fine.columns;
+		for(int x = 0; x < mWidth; x++, line += inc)
+		{
+			uint32_t c = ((alpha ? line[a] : 0xFF) << 24) | (line[r] << 16) | (line[g] << 8) | line[b];
+			size_t block = row + (x >> fine.shift);
+			if((x & 3) == 0 && (y & 3) == 0)
+				fine.colors[block] = c;
+			else
+				fine.uniform[block] &= fine.colors[block] == c;
+		}
+	}
+
+	//coarser levels from the finer one
+	for(int l = 1; l < LEVELS; l++)
+	{
+		const Level& finer = mLevels[l - 1];
+		Level& level = mLevels[l];
+		for(int y = 0; y < finer.rows; y++)
+			for(int x = 0; x < finer.columns; x++)
+			{
+				size_t child = (size_t)y * finer.columns + x;
+				size_t block = (size_t)(y >> 2) * level.columns + (x >> 2);
+				if((x & 3) == 0 && (y & 3) == 0)
+					level.colors[block] = finer.colors[child];
+				level.uniform[block] &= finer.uniform[child] && finer.colors[child] == level.colors[block];
+			}
+	}
+}
+
+bool UniformBlocks::uniform(int x0, int y0, int x1, int y1, uint32_t& color) const
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, mWidth - 1);
+	y1 = std::min(y1, mHeight - 1);
+	if(x0 > x1 || y0 > y1)
+		return false;
+
+	//a coarse block is enough if the area is inside of one
+	for(int l = LEVELS - 1; l > 0; l--)
+	{
+		const Level& level = mLevels[l];
+		if((x0 >> level.shift) != (x1 >> level.shift) || (y0 >> level.shift) != (y1 >> level.shift))
+			continue;
+		size_t block = (size_t)(y0 >> level.shift) * level.columns + (x0 >> level.shift);
+		if(level.uniform[block])
+		{
+			color = level.colors[block];
+			return true;
+		}
+	}
+
+	const Level& fine = mLevels[0];
+	size_t first = (size_t)(y0 >> fine.shift) * fine.columns + (x0 >> fine.shift);
+	for(int by = y0 >> fine.shift; by <= (y1 >> fine.shift); by++)
+		for(int bx = x0 >> fine.shift; bx <= (x1 >> fine.shift); bx++)
+		{
+			size_t block = (size_t)by * fine.columns + bx;
+			if(!fine.uniform[block] || fine.colors[block] != fine.colors[first])
+				return false;
+		}
+	color = fine.colors[first];
+	return true;
+}
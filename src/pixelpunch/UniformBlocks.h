@@ -0,0 +1,43 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <vector>
+
+namespace pp
+{
+	//Where an image has a single color, so samplers can skip their taps if all pixels they
+	//would read are the same. Level 0 summarises 4x4 blocks, level 1 16x16 blocks. Colors are
+	//packed 0xAARRGGBB and compared including alpha. Build it once per source and again when
+	//its pixels change.
+	class UniformBlocks
+	{
+	public:
+		static const int LEVELS = 2;
+
+		UniformBlocks();
+		UniformBlocks(const cinder::Surface& source);
+
+		void build(const cinder::Surface& source);
+		int width() const { return mWidth; }
+		int height() const { return mHeight; }
+
+		//true if all pixels in [x0, x1] x [y0, y1] have the same color, the area is clipped to
+		//the image just like getPixel clamps
+		bool uniform(int x0, int y0, int x1, int y1, uint32_t& color) const;
+
+	private:
+		struct Level
+		{
+			int shift; //log2 of the block size
+			int columns;
+			int rows;
+			std::vector<uint8_t> uniform; //1 per single colored block
+			std::vector<uint32_t> colors; //of the first pixel of each block
+		};
+
+		int mWidth;
+		int mHeight;
+		Level mLevels[LEVELS];
+	};
+}
@@ -0,0 +1,168 @@
+#include "VirtualScaledImage.h"
+#include <algorithm>
+#include <atomic>
+
+using namespace cinder;
+using namespace pp;
+
+VirtualScaledImage::VirtualScaledImage()
+:	mMethod(SM_NONE), mFactor(1), mBlockSize(16), mCapacity(256), mWidth(0), mHeight(0), mColumns(0)
+{
+}
+
+VirtualScaledImage::VirtualScaledImage(const Surface& source, ScaleMethod method, int blockSize, size_t cacheBlocks)
+:	mMethod(SM_NONE), mFactor(1), mBlockSize(16), mCapacity(256), mWidth(0), mHeight(0), mColumns(0)
+{
+	build(source, method, blockSize, cacheBlocks);
+}
+
+static std::atomic<uint64_t> sNextCache(1);
+
+VirtualScaledImage::Cache::Cache()
+:	id(sNextCache++)
+{
+}
+
+bool VirtualScaledImage::build(const Surface& source, ScaleMethod method, int blockSize, size_t cacheBlocks)
+{
+	clear();
+	if(!scaleIsLocal(method))
+		return false;
+	mSource = source;
+	mMethod = method;
+	mFactor = scaleFactor(method);
+	mBlockSize = std::max(blockSize, 1);
+	mCapacity = std::max<size_t>(cacheBlocks, 1);
+	mWidth = mFactor * source.getWidth();
+	mHeight = mFactor * source.getHeight();
+	mColumns = (source.getWidth() + mBlockSize - 1) / mBlockSize;
+	//a new cache, samplers still reading the old one keep it alive
+	mCache.reset(new Cache());
+	return true;
+}
+
+void VirtualScaledImage::clear()
+{
+	mSource = Surface();
+	mWidth = 0;
+	mHeight = 0;
+	mColumns = 0;
+	mCache.reset();
+}
+
+Surface VirtualScaledImage::shape() const
+{
+	bool alpha = mSource.hasAlpha();
+	return Surface((uint8_t*)NULL, mWidth, mHeight, mWidth * (alpha ? 4 : 3), SurfaceChannelOrder(alpha ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB));
+}
+
+const VirtualScaledImage::Block& VirtualScaledImage::block(int key) const
+{
+	int slot = ((key % mColumns) & 1) | (((key / mColumns) & 1) << 1);
+	static thread_local LastBlocks last;
+	if(last.cache != mCache->id)
+	{
+		for(int i = 0; i < 4; i++)
+			last.blocks[i].reset();
+		last.cache = mCache->id;
+	}
+	BlockRef& ref = last.blocks[slot];
+	if(!ref || ref->key != key)
+		ref = load(key);
+	return *ref;
+}
+
+VirtualScaledImage::BlockRef VirtualScaledImage::load(int key) const
+{
+	{
+		std::lock_guard<std::mutex> guard(mCache->lock);
+		std::map<int, BlockList::iterator>::iterator found = mCache->index.find(key);
+		if(found != mCache->index.end())
+		{
+			mCache->blocks.splice(mCache->blocks.begin(), mCache->blocks, found->second);
+			return mCache->blocks.front();
+		}
+	}
+
+	//scaled without holding the lock so threads missing different blocks don't wait.
+	//The halo is clamped at the image border just like Kernel reads there.
+	int halo = scaleHalo(mMethod);
+	int bx = (key % mColumns) * mBlockSize;
+	int by = (key / mColumns) * mBlockSize;
+	int bw = std::min(mBlockSize, mSource.getWidth() - bx);
+	int bh = std::min(mBlockSize, mSource.getHeight() - by);
+	PixelPlane crop(bw + 2 * halo, bh + 2 * halo);
+	int inc = mSource.getPixelInc();
+	int r = mSource.getRedOffset();
+	int g = mSource.getGreenOffset();
+	int b = mSource.getBlueOffset();
+	for(int y = 0; y < crop.height; y++)
+	{
+		int sy = std::min(std::max(by - halo + y, 0), mSource.getHeight() - 1);
+		const uint8_t* line = mSource.getData() + sy * mSource.getRowBytes();
+		uint32_t* dst = crop.row(y);
+		for(int x = 0; x < crop.width; x++)
+		{
+			const uint8_t* s = line + std::min(std::max(bx - halo + x, 0), mSource.getWidth() - 1) * inc;
+			dst[x] = (s[r] << 16) | (s[g] << 8) | s[b];
+		}
+	}
+	PixelPlane scaled;
+	scale(crop, mMethod, scaled);
+
+	std::shared_ptr<Block> result(new Block());
+	result->key = key;
+	result->originX = bx * mFactor;
+	result->originY = by * mFactor;
+	result->pixels.resize(bw * mFactor, bh * mFactor);
+	for(int y = 0; y < result->pixels.height; y++)
+	{
+		const uint32_t* src = scaled.row(y + halo * mFactor) + halo * mFactor;
+		uint32_t* dst = result->pixels.row(y);
+		for(int x = 0; x < result->pixels.width; x++)
+			dst[x] = 0xFF000000 | src[x];
+	}
+
+	std::lock_guard<std::mutex> guard(mCache->lock);
+	//another thread may have been faster
+	std::map<int, BlockList::iterator>::iterator found = mCache->index.find(key);
+	if(found != mCache->index.end())
+		return *found->second;
+	if(mCache->blocks.size() >= mCapacity)
+	{
+		mCache->index.erase(mCache->blocks.back()->key);
+		mCache->blocks.pop_back();
+	}
+	mCache->blocks.push_front(result);
+	mCache->index[key] = mCache->blocks.begin();
+	return result;
+}
+
+uint32_t VirtualScaledImage::at(int x, int y) const
+{
+	uint32_t result;
+	window(x, y, 1, 1, &result);
+	return result;
+}
+
+void VirtualScaledImage::window(int x, int y, int width, int height, uint32_t* result) const
+{
+	int span = mBlockSize * mFactor;
+	int key = -1;
+	const Block* current = NULL;
+	for(int j = 0; j < height; j++)
+	{
+		int sy = std::min(std::max(y + j, 0), mHeight - 1);
+		for(int i = 0; i < width; i++)
+		{
+			int sx = std::min(std::max(x + i, 0), mWidth - 1);
+			int k = (sy / span) * mColumns + sx / span;
+			if(k != key)
+			{
+				current = &block(k);
+				key = k;
+			}
+			*result++ = current->pixels.at(sx - current->originX, sy - current->originY);
+		}
+	}
+}
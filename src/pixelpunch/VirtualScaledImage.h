@@ -0,0 +1,88 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "Plane.h"
+#include "PixelScale.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace pp
+{
+	//A source scaled by a ScaleMethod that is never materialised. Blocks of the scaled image
+	//are computed from the source block and its halo the first time they are read and kept
+	//in a small LRU cache, so memory stays bounded however large the scaled image would be.
+	//Exact for the methods that are scaleIsLocal, the others can't be scaled in blocks. Reading
+	//is safe from several threads at once, the source has to stay alive and unchanged. Colors
+	//are packed 0xFFRRGGBB, alpha isn't scaled.
+	class VirtualScaledImage
+	{
+	public:
+		VirtualScaledImage();
+		//blockSize is in source pixels
+		VirtualScaledImage(const cinder::Surface& source, ScaleMethod method, int blockSize = 16, size_t cacheBlocks = 256);
+
+		//false and empty if the method isn't scaleIsLocal
+		bool build(const cinder::Surface& source, ScaleMethod method, int blockSize = 16, size_t cacheBlocks = 256);
+		void clear();
+		bool empty() const { return mWidth == 0 || mHeight == 0; }
+		int width() const { return mWidth; }
+		int height() const { return mHeight; }
+		ScaleMethod method() const { return mMethod; }
+
+		//size and channels of the scaled image without pixels, the source of samplers reading this
+		cinder::Surface shape() const;
+
+		//clamped to the image like getPixel
+		uint32_t at(int x, int y) const;
+		//width x height pixels from x, y in rows, looks up each block only once
+		void window(int x, int y, int width, int height, uint32_t* result) const;
+
+	private:
+		struct Block
+		{
+			int key;
+			int originX; //of pixels in scaled coordinates
+			int originY;
+			PixelPlane pixels;
+		};
+		typedef std::shared_ptr<const Block> BlockRef;
+		typedef std::list<BlockRef> BlockList;
+
+		//shared by all threads reading at once, evicted blocks stay alive until the last
+		//read using them is done
+		struct Cache
+		{
+			Cache();
+			uint64_t id; //never reused, tells blocks of this cache from those of one freed before
+			std::mutex lock;
+			BlockList blocks; //most recently used first
+			std::map<int, BlockList::iterator> index;
+		};
+
+		//the blocks a thread read last, one per parity of the block column and row so a window
+		//across a block corner hits all four without locking the cache
+		struct LastBlocks
+		{
+			LastBlocks() : cache(0) {}
+			uint64_t cache;
+			BlockRef blocks[4];
+		};
+
+		//valid until the thread asks for another block of the same parity
+		const Block& block(int key) const;
+		BlockRef load(int key) const;
+
+		cinder::Surface mSource;
+		ScaleMethod mMethod;
+		int mFactor;
+		int mBlockSize;
+		size_t mCapacity;
+		int mWidth;
+		int mHeight;
+		int mColumns; //of blocks
+		std::shared_ptr<Cache> mCache;
+	};
+}
@@ -0,0 +1,265 @@
+#include "BatchPipeline.h"
+#include "ImageFiles.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace cinder;
+using namespace pp;
+
+typedef std::chrono::steady_clock Clock;
+
+//state shared by the threads of one run
+struct BatchPipeline::Run
+{
+	Run(const BatchOptions& options, const std::vector<std::string>& s)
+	:	sources(s), next(0), decoded(options.queueDepth), rendered(options.queueDepth), context(options.threads), decoding(options.decoders), processing(options.workers) {}
+
+	const std::vector<std::string>& sources;
+	std::atomic<size_t> next; //index of the next source to decode
+	BoundedQueue<Batch> decoded;
+	BoundedQueue<Batch> rendered;
+	ExecutionContext context;
+	MapCache maps;
+	std::atomic<int> decoding; //threads still running, the last one closes the queue it feeds
+	std::atomic<int> processing;
+
+	std::mutex lock; //guards the report
+	BatchReport report;
+};
+
+double _since(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+BatchPipeline::BatchPipeline(const BatchOptions& options)
+:	mOptions(options)
+{
+	mOptions.decoders = std::max(mOptions.decoders, 1);
+	mOptions.workers = std::max(mOptions.workers, 1);
+	mOptions.encoders = std::max(mOptions.encoders, 1);
+}
+
+std::string BatchPipeline::outputPath(const std::string& source) const
+{
+	return pp::outputPath(source, mOptions.outputDir, mOptions.format);
+}
+
+BatchReport BatchPipeline::run(const std::vector<std::string>& sources)
+{
+	Run run(mOptions, sources);
+	Clock::time_point start = Clock::now();
+	std::vector<std::thread> threads;
+	for(int i = 0; i < mOptions.decoders; i++)
+		threads.push_back(std::thread(&BatchPipeline::decode, this, std::ref(run)));
+	for(int i = 0; i < mOptions.workers; i++)
+		threads.push_back(std::thread(&BatchPipeline::process, this, std::ref(run)));
+	for(int i = 0; i < mOptions.encoders; i++)
+		threads.push_back(std::thread(&BatchPipeline::encode, this, std::ref(run)));
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	BatchReport& report = run.report;
+	report.seconds = _since(start);
+	report.files = sources.size();
+	report.decode.output = run.decoded.stats();
+	report.process.output = run.rendered.stats();
+	return report;
+}
+
+void BatchPipeline::decode(Run& run)
+{
+	Batch batch(new std::vector<File>());
+	size_t pixels = 0;
+	double busy = 0;
+	size_t count = 0;
+	for(size_t i = run.next++; i < run.sources.size(); i = run.next++)
+	{
+		Clock::time_point start = Clock::now();
+		File file;
+		file.source = run.sources[i];
+		//paletted PNGs stay indices until process knows whether the settings keep them
+		if(loadIndexedFile(file.source, file.indexed, file.error))
+			pixels += file.indexed.indices.pixels.size();
+		else if(file.error.empty() && loadImageFile(file.source, file.image, file.error))
+			pixels += (size_t)file.image.getWidth() * file.image.getHeight();
+		batch->push_back(file);
+		count++;
+		busy += _since(start);
+
+		if(pixels >= mOptions.batchPixels || batch->size() >= mOptions.batchFiles)
+		{
+			run.decoded.push(batch);
+			batch.reset(new std::vector<File>());
+			pixels = 0;
+		}
+	}
+	if(!batch->empty())
+		run.decoded.push(batch);
+
+	std::lock_guard<std::mutex> lock(run.lock);
+	run.report.decode.files += count;
+	run.report.decode.busySeconds += busy;
+	if(--run.decoding == 0)
+		run.decoded.close();
+}
+
+void BatchPipeline::process(Run& run)
+{
+	Batch batch;
+	double busy = 0;
+	size_t count = 0;
+	size_t sourcePixels = 0;
+	size_t resultPixels = 0;
+	while(run.decoded.pop(batch))
+	{
+		Clock::time_point start = Clock::now();
+		for(size_t i = 0; i < batch->size(); i++)
+		{
+			File& file = (*batch)[i];
+			if(!file.error.empty())
+				continue;
+			RenderSettings settings = mOptions.settings;
+			std::unique_ptr<RenderSource> source;
+			if(file.indexed.empty())
+				source.reset(new RenderSource(file.image));
+			else if(settings.transform == TM_IDENTITY && scalesIndices(settings.scale))
+			{
+				sourcePixels += file.indexed.indices.pixels.size();
+				scale(file.indexed, settings.scale, file.indexed, false, &run.context);
+				resultPixels += file.indexed.indices.pixels.size();
+				count++;
+				continue;
+			}
+			else
+			{
+				//samplers and the hqx methods need colors, the palette is known already
+				Palette palette;
+				getColors(file.indexed, palette);
+				expand(file.indexed, file.image);
+				file.indexed = IndexedImage();
+				source.reset(new RenderSource(file.image, palette));
+			}
+			if(mOptions.rotation != 0)
+			{
+				int factor = scaleFactor(settings.scale);
+				rotatedQuad((float)factor * file.image.getWidth(), (float)factor * file.image.getHeight(), mOptions.rotation, settings.quad);
+			}
+			sourcePixels += (size_t)file.image.getWidth() * file.image.getHeight();
+			file.image = render(*source, settings, &run.maps, &run.context);
+			resultPixels += (size_t)file.image.getWidth() * file.image.getHeight();
+			count++;
+		}
+		busy += _since(start);
+		run.rendered.push(batch);
+	}
+
+	std::lock_guard<std::mutex> lock(run.lock);
+	run.report.process.files += count;
+	run.report.process.busySeconds += busy;
+	run.report.sourcePixels += sourcePixels;
+	run.report.resultPixels += resultPixels;
+	if(--run.processing == 0)
+		run.rendered.close();
+}
+
+//what was written and what was read back, alpha counts as opaque where one has none
+bool _samePixels(const Surface& a, const Surface& b)
+{
+	if(a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight())
+		return false;
+	for(int y = 0; y < a.getHeight(); y++)
+	{
+		const uint8_t* pa = a.getData() + y * a.getRowBytes();
+		const uint8_t* pb = b.getData() + y * b.getRowBytes();
+		for(int x = 0; x < a.getWidth(); x++, pa += a.getPixelInc(), pb += b.getPixelInc())
+		{
+			int alphaA = a.hasAlpha() ? pa[a.getAlphaOffset()] : 0xFF;
+			int alphaB = b.hasAlpha() ? pb[b.getAlphaOffset()] : 0xFF;
+			if(pa[a.getRedOffset()] != pb[b.getRedOffset()] || pa[a.getGreenOffset()] != pb[b.getGreenOffset()] || pa[a.getBlueOffset()] != pb[b.getBlueOffset()] || alphaA != alphaB)
+				return false;
+		}
+	}
+	return true;
+}
+
+void BatchPipeline::encode(Run& run)
+{
+	Batch batch;
+	while(run.rendered.pop(batch))
+	{
+		Clock::time_point start = Clock::now();
+		size_t count = 0;
+		size_t bytes = 0;
+		std::vector<std::string> errors;
+		for(size_t i = 0; i < batch->size(); i++)
+		{
+			File& file = (*batch)[i];
+			std::string path = outputPath(file.source);
+			bool saved = false;
+			if(file.error.empty() && !file.indexed.empty())
+				saved = saveIndexedFile(path, file.indexed, file.error, mOptions.level, &run.context);
+			else if(file.error.empty())
+				saved = saveImageFile(path, file.image, file.error, mOptions.level, &run.context);
+			if(saved && mOptions.check)
+			{
+				Surface written = file.image;
+				if(!file.indexed.empty())
+					expand(file.indexed, written);
+				Surface read;
+				if(!loadImageFile(path, read, file.error))
+					saved = false;
+				else if(!_samePixels(written, read))
+				{
+					file.error = path + " doesn't read back as written";
+					saved = false;
+				}
+			}
+			struct stat info;
+			if(saved && stat(path.c_str(), &info) == 0)
+				bytes += info.st_size;
+			if(saved)
+				count++;
+			if(!file.error.empty())
+				errors.push_back(file.error);
+		}
+		double busy = _since(start);
+
+		std::lock_guard<std::mutex> lock(run.lock);
+		run.report.encode.files += count;
+		run.report.encode.busySeconds += busy;
+		run.report.encodedBytes += bytes;
+		run.report.failed += errors.size();
+		run.report.errors.insert(run.report.errors.end(), errors.begin(), errors.end());
+	}
+}
+
+bool pp::isImagePath(const std::string& path)
+{
+	static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".gif", ".bmp", ".tga", ".tif", ".tiff", ".pam", ".qoi" };
+	std::string extension = fileExtension(path);
+	for(size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+		if(extension == extensions[i])
+			return true;
+	return false;
+}
+
+std::vector<std::string> pp::listImages(const std::string& directory)
+{
+	std::vector<std::string> result;
+	DIR* dir = opendir(directory.c_str());
+	if(!dir)
+		return result;
+	while(dirent* entry = readdir(dir))
+		if(isImagePath(entry->d_name))
+			result.push_back(directory + "/" + entry->d_name);
+	closedir(dir);
+	std::sort(result.begin(), result.end());
+	return result;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "BoundedQueue.h"
+#include "PngFiles.h"
+#include "pixelpunch/IndexedImage.h"
+#include "pixelpunch/Render.h"
+#include <string>
+#include <vector>
+
+namespace pp
+{
+	struct BatchOptions
+	{
+		BatchOptions() : rotation(0), level(DEFAULT_PNG_LEVEL), decoders(2), workers(2), encoders(2), threads(0), queueDepth(8), batchPixels(256 * 256), batchFiles(32), check(false) {}
+		std::string outputDir;
+		std::string format; //extension of the results with the dot, empty = same as the source
+		RenderSettings settings;
+		float rotation; //degrees, used instead of settings.quad if not 0
+		int level; //PNG compression, deflated on the threads of the workers' context
+		int decoders;
+		int workers;
+		int encoders;
+		int threads; //of the context the workers share, 0 = all cores
+		size_t queueDepth; //batches between two stages
+		size_t batchPixels; //small files are passed on together until they have this many pixels
+		size_t batchFiles; //or this many files
+		bool check; //every result is read back and compared with what was written, an error if it differs
+	};
+
+	struct StageReport
+	{
+		StageReport() : files(0), busySeconds(0) {}
+		size_t files;
+		double busySeconds; //summed up over the threads of the stage
+		QueueStats output; //of the queue it feeds, blockedSeconds is its backpressure
+	};
+
+	struct BatchReport
+	{
+		BatchReport() : files(0), failed(0), seconds(0), sourcePixels(0), resultPixels(0), encodedBytes(0) {}
+		size_t files;
+		size_t failed;
+		double seconds;
+		size_t sourcePixels;
+		size_t resultPixels;
+		size_t encodedBytes; //of the files written
+		StageReport decode;
+		StageReport process;
+		StageReport encode;
+		std::vector<std::string> errors;
+	};
+
+	//Renders many files as a pipeline of three stages with their own threads: decoders read
+	//sources, workers render them and encoders write the results. Stages are connected by
+	//bounded queues so memory stays bounded when one stage is slower than the others. Small
+	//files travel in batches so the queues aren't dominated by per-file overhead. Paletted
+	//PNGs that are only scaled go from file to file as indices.
+	class BatchPipeline
+	{
+	public:
+		BatchPipeline(const BatchOptions& options);
+		BatchReport run(const std::vector<std::string>& sources);
+
+		//where the result of a source goes
+		std::string outputPath(const std::string& source) const;
+
+	private:
+		//paletted sources stay indexed as long as the settings allow it
+		struct File
+		{
+			std::string source;
+			cinder::Surface image;
+			IndexedImage indexed;
+			std::string error;
+		};
+		typedef std::shared_ptr<std::vector<File> > Batch;
+
+		struct Run;
+		void decode(Run& run);
+		void process(Run& run);
+		void encode(Run& run);
+
+		BatchOptions mOptions;
+	};
+
+	//files directly in a directory that can be read as sources, sorted by name
+	std::vector<std::string> listImages(const std::string& directory);
+	bool isImagePath(const std::string& path); //has an extension listImages lists
+}
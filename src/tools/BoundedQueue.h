@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace pp
+{
+	struct QueueStats
+	{
+		QueueStats() : pushed(0), maxDepth(0), meanDepth(0), blockedSeconds(0) {}
+		size_t pushed;
+		size_t maxDepth;
+		double meanDepth; //over the time since the queue was made
+		double blockedSeconds; //producers waiting because the queue was full, summed up
+	};
+
+	//Queue between the stages of a pipeline. Producers block while it is full, so a slow stage
+	//holds back the ones before it instead of letting memory grow.
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		BoundedQueue(size_t capacity) : mCapacity(capacity ? capacity : 1), mClosed(false), mStart(Clock::now()), mChanged(mStart), mDepthTime(0) {}
+
+		//false if the queue was closed
+		bool push(const T& item)
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			if(mItems.size() >= mCapacity && !mClosed)
+			{
+				Clock::time_point start = Clock::now();
+				while(mItems.size() >= mCapacity && !mClosed)
+					mNotFull.wait(lock);
+				mStats.blockedSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+			}
+			if(mClosed)
+				return false;
+			changing();
+			mItems.push_back(item);
+			mStats.pushed++;
+			mStats.maxDepth = std::max(mStats.maxDepth, mItems.size());
+			mNotEmpty.notify_one();
+			return true;
+		}
+
+		//false once the queue is closed and empty
+		bool pop(T& item)
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			while(mItems.empty() && !mClosed)
+				mNotEmpty.wait(lock);
+			if(mItems.empty())
+				return false;
+			changing();
+			item = mItems.front();
+			mItems.pop_front();
+			mNotFull.notify_one();
+			return true;
+		}
+
+		//no more pushes, pops still get what is left
+		void close()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mClosed = true;
+			mNotEmpty.notify_all();
+			mNotFull.notify_all();
+		}
+
+		size_t size()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			return mItems.size();
+		}
+
+		QueueStats stats()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			changing();
+			QueueStats result = mStats;
+			double seconds = std::chrono::duration<double>(mChanged - mStart).count();
+			result.meanDepth = seconds > 0 ? mDepthTime / seconds : 0;
+			return result;
+		}
+
+	private:
+		//depth weighted by how long the queue had it, call with mLock held
+		void changing()
+		{
+			Clock::time_point now = Clock::now();
+			mDepthTime += mItems.size() * std::chrono::duration<double>(now - mChanged).count();
+			mChanged = now;
+		}
+
+		std::mutex mLock;
+		std::condition_variable mNotEmpty;
+		std::condition_variable mNotFull;
+		std::deque<T> mItems;
+		size_t mCapacity;
+		bool mClosed;
+		QueueStats mStats;
+		Clock::time_point mStart;
+		Clock::time_point mChanged;
+		double mDepthTime;
+	};
+}
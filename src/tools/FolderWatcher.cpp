@@ -0,0 +1,129 @@
+#include "FolderWatcher.h"
+#include "BatchPipeline.h"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+	#include <sys/inotify.h>
+#endif
+
+using namespace pp;
+
+#if defined(__linux__)
+
+FolderWatcher::FolderWatcher()
+:	mNotify(-1)
+{
+}
+
+bool FolderWatcher::open(const std::string& directory, std::string& error)
+{
+	close();
+	mDirectory = directory;
+	mNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	//editors that save through a temporary file move it in
+	if(mNotify < 0 || inotify_add_watch(mNotify, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0)
+	{
+		error = "can't watch " + directory + ": " + strerror(errno);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void FolderWatcher::close()
+{
+	if(mNotify >= 0)
+		::close(mNotify);
+	mNotify = -1;
+}
+
+void FolderWatcher::wait(int milliseconds, std::vector<std::string>& changed)
+{
+	pollfd fd;
+	fd.fd = mNotify;
+	fd.events = POLLIN;
+	if(mNotify < 0 || poll(&fd, 1, milliseconds) <= 0)
+		return;
+
+	char buffer[16 * 1024] __attribute__((aligned(__alignof__(inotify_event))));
+	ssize_t bytes;
+	while((bytes = read(mNotify, buffer, sizeof(buffer))) > 0)
+		for(char* next = buffer; next < buffer + bytes; )
+		{
+			const inotify_event* event = (const inotify_event*)next;
+			next += sizeof(inotify_event) + event->len;
+			//events were lost, any file may have changed
+			if(event->mask & IN_Q_OVERFLOW)
+			{
+				std::vector<std::string> all = listImages(mDirectory);
+				changed.insert(changed.end(), all.begin(), all.end());
+			}
+			else if(event->len > 0 && !(event->mask & IN_ISDIR))
+				changed.push_back(mDirectory + "/" + event->name);
+		}
+}
+
+#else
+
+long long _modifiedTime(const std::string& path)
+{
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+		return -1;
+#if defined(__APPLE__)
+	return (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+	return (long long)info.st_mtime * 1000000000LL;
+#endif
+}
+
+FolderWatcher::FolderWatcher()
+{
+}
+
+bool FolderWatcher::open(const std::string& directory, std::string& error)
+{
+	struct stat info;
+	if(stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+	{
+		error = "can't watch " + directory;
+		return false;
+	}
+	mDirectory = directory;
+	mModified.clear();
+	std::vector<std::string> files = listImages(directory);
+	for(size_t i = 0; i < files.size(); i++)
+		mModified[files[i]] = _modifiedTime(files[i]);
+	return true;
+}
+
+void FolderWatcher::close()
+{
+	mModified.clear();
+}
+
+void FolderWatcher::wait(int milliseconds, std::vector<std::string>& changed)
+{
+	poll(NULL, 0, milliseconds);
+	std::vector<std::string> files = listImages(mDirectory);
+	for(size_t i = 0; i < files.size(); i++)
+	{
+		long long modified = _modifiedTime(files[i]);
+		std::map<std::string, long long>::iterator found = mModified.find(files[i]);
+		if(found == mModified.end() || found->second != modified)
+		{
+			mModified[files[i]] = modified;
+			changed.push_back(files[i]);
+		}
+	}
+}
+
+#endif
+
+FolderWatcher::~FolderWatcher()
+{
+	close();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace pp
+{
+	//Tells which files directly in a directory were written to, created or moved there. Uses
+	//inotify on Linux, elsewhere the modification times of listImages are compared every
+	//time it waits.
+	class FolderWatcher
+	{
+	public:
+		FolderWatcher();
+		~FolderWatcher();
+
+		bool open(const std::string& directory, std::string& error);
+		void close();
+
+		//waits up to milliseconds for changes and appends the paths of the files that changed.
+		//A file written in several steps may show up once for every step.
+		void wait(int milliseconds, std::vector<std::string>& changed);
+
+	private:
+		FolderWatcher(const FolderWatcher&);
+		FolderWatcher& operator=(const FolderWatcher&);
+
+		std::string mDirectory;
+#if defined(__linux__)
+		int mNotify;
+#else
+		std::map<std::string, long long> mModified;
+#endif
+	};
+}
@@ -0,0 +1,124 @@
+#include "ImageFiles.h"
+#include "QoiFiles.h"
+#include "cinder/ImageIo.h"
+#include "pixelpunch/ImageStream.h"
+#include "pixelpunch/MappedImage.h"
+#include <algorithm>
+#include <cctype>
+#include <exception>
+
+using namespace cinder;
+using namespace pp;
+
+std::string pp::fileExtension(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return std::string();
+	std::string result = path.substr(dot);
+	std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+	return result;
+}
+
+std::string pp::outputPath(const std::string& source, const std::string& directory, const std::string& extension)
+{
+	size_t slash = source.find_last_of('/');
+	std::string name = slash == std::string::npos ? source : source.substr(slash + 1);
+	if(!extension.empty())
+		name = name.substr(0, name.size() - fileExtension(name).size()) + extension;
+	return directory + "/" + name;
+}
+
+bool pp::loadImageFile(const std::string& path, Surface& result, std::string& error)
+{
+	if(fileExtension(path) == ".pam")
+	{
+		PamReader reader(path);
+		if(!reader.isOpen())
+		{
+			error = "can't read " + path;
+			return false;
+		}
+		result = Surface(reader.width(), reader.height(), reader.hasAlpha());
+		for(int y = 0; y < reader.height(); y++)
+			if(!reader.readRow(y, result, y))
+			{
+				error = "truncated " + path;
+				return false;
+			}
+		return true;
+	}
+
+	if(fileExtension(path) == ".qoi")
+		return readQoi(path, result, error);
+
+	IndexedImage indexed;
+	if(loadIndexedFile(path, indexed, error))
+	{
+		expand(indexed, result);
+		return true;
+	}
+	if(!error.empty())
+		return false;
+
+	try
+	{
+		result = loadImage(path);
+		return true;
+	}
+	catch(std::exception& e)
+	{
+		error = "can't read " + path + ": " + e.what();
+		return false;
+	}
+}
+
+bool pp::saveImageFile(const std::string& path, const Surface& image, std::string& error, int level, ExecutionContext* context)
+{
+	if(fileExtension(path) == ".pam")
+	{
+		if(writeMapped(path, image))
+			return true;
+		error = "can't write " + path;
+		return false;
+	}
+
+	if(fileExtension(path) == ".qoi")
+		return writeQoi(path, image, error);
+
+	if(fileExtension(path) == ".png")
+	{
+		IndexedImage indexed;
+		if(index(image, indexed))
+			return writeIndexedPng(path, indexed, error, level, context);
+		return writePng(path, image, error, level, context);
+	}
+
+	try
+	{
+		writeImage(path, image);
+		return true;
+	}
+	catch(std::exception& e)
+	{
+		error = "can't write " + path + ": " + e.what();
+		return false;
+	}
+}
+
+bool pp::loadIndexedFile(const std::string& path, IndexedImage& result, std::string& error)
+{
+	if(fileExtension(path) != ".png" || !isIndexedPng(path))
+		return false;
+	return readIndexedPng(path, result, error);
+}
+
+bool pp::saveIndexedFile(const std::string& path, const IndexedImage& image, std::string& error, int level, ExecutionContext* context)
+{
+	if(fileExtension(path) == ".png")
+		return writeIndexedPng(path, image, error, level, context);
+	Surface expanded;
+	expand(image, expanded);
+	return saveImageFile(path, expanded, error, level, context);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "PngFiles.h"
+#include <string>
+
+namespace pp
+{
+	//PAM, QOI and paletted PNG through the pixelpunch readers, anything else through Cinder's
+	//ImageIo. PAM, QOI and PNG are written by pixelpunch, PNGs with at most 256 colors
+	//paletted, with level and the threads of context for the compression. Errors are returned
+	//as text instead of thrown so tools can report them per file.
+	bool loadImageFile(const std::string& path, cinder::Surface& result, std::string& error);
+	bool saveImageFile(const std::string& path, const cinder::Surface& image, std::string& error, int level = DEFAULT_PNG_LEVEL, ExecutionContext* context = NULL);
+
+	//false with an empty error if the file isn't a paletted PNG
+	bool loadIndexedFile(const std::string& path, IndexedImage& result, std::string& error);
+	//paletted PNG, other formats are expanded
+	bool saveIndexedFile(const std::string& path, const IndexedImage& image, std::string& error, int level = DEFAULT_PNG_LEVEL, ExecutionContext* context = NULL);
+
+	std::string fileExtension(const std::string& path); //lower case with the dot, e.g. ".png"
+	//the file in directory with the name of source, with extension instead of its own if not empty
+	std::string outputPath(const std::string& source, const std::string& directory, const std::string& extension);
+}
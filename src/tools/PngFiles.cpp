@@ -0,0 +1,484 @@
+#include "PngFiles.h"
+#include "pixelpunch/ImageStream.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <zlib.h>
+
+using namespace cinder;
+using namespace pp;
+
+static const uint8_t PNG_SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+static const size_t PNG_HEADER_BYTES = 8 + 8 + 13 + 4; //signature and IHDR
+
+struct PngHeader
+{
+	uint32_t width;
+	uint32_t height;
+	int bitDepth;
+	int colorType;
+	int interlace;
+};
+
+uint32_t _readUint32(const uint8_t* data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+void _appendUint32(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(0xFF & (value >> 24));
+	out.push_back(0xFF & (value >> 16));
+	out.push_back(0xFF & (value >> 8));
+	out.push_back(0xFF & value);
+}
+
+void _writeChunk(std::ostream& out, const char* type, const uint8_t* data, size_t length)
+{
+	std::vector<uint8_t> bytes;
+	_appendUint32(bytes, (uint32_t)length);
+	bytes.insert(bytes.end(), type, type + 4);
+	out.write((const char*)&bytes[0], bytes.size());
+	out.write((const char*)data, length);
+	//crc32 with no data returns 0 instead of the crc it was given, IEND has none
+	uLong crc = crc32(0, (const Bytef*)type, 4);
+	if(length > 0)
+		crc = crc32(crc, data, (uInt)length);
+	bytes.clear();
+	_appendUint32(bytes, (uint32_t)crc);
+	out.write((const char*)&bytes[0], bytes.size());
+}
+
+bool _readHeader(const uint8_t* data, size_t size, PngHeader& header)
+{
+	if(size < PNG_HEADER_BYTES || memcmp(data, PNG_SIGNATURE, 8) != 0 || _readUint32(data + 8) != 13 || memcmp(data + 12, "IHDR", 4) != 0)
+		return false;
+	header.width = _readUint32(data + 16);
+	header.height = _readUint32(data + 20);
+	header.bitDepth = data[24];
+	header.colorType = data[25];
+	header.interlace = data[28];
+	return header.width > 0 && header.height > 0 && header.width < (1u << 30) && header.height < (1u << 30);
+}
+
+bool _indexedHeader(const PngHeader& header)
+{
+	int depth = header.bitDepth;
+	return header.colorType == 3 && header.interlace == 0 && (depth == 1 || depth == 2 || depth == 4 || depth == 8);
+}
+
+bool _readFile(const std::string& path, std::vector<uint8_t>& result)
+{
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	if(!file)
+		return false;
+	std::streamoff size = file.tellg();
+	if(size <= 0)
+		return false;
+	result.resize((size_t)size);
+	file.seekg(0);
+	return (bool)file.read((char*)&result[0], size);
+}
+
+int _paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+//undoes the filters in place, paletted pixels are at most a byte so bpp is always 1
+bool _unfilter(uint8_t* raw, size_t rowBytes, uint32_t height)
+{
+	const uint8_t* previous = NULL;
+	for(uint32_t y = 0; y < height; y++, raw += rowBytes + 1)
+	{
+		uint8_t* line = raw + 1;
+		switch(raw[0])
+		{
+		case 0:
+			break;
+		case 1:
+			for(size_t x = 1; x < rowBytes; x++)
+				line[x] += line[x - 1];
+			break;
+		case 2:
+			if(previous)
+				for(size_t x = 0; x < rowBytes; x++)
+					line[x] += previous[x];
+			break;
+		case 3:
+			for(size_t x = 0; x < rowBytes; x++)
+				line[x] += ((x ? line[x - 1] : 0) + (previous ? previous[x] : 0)) / 2;
+			break;
+		case 4:
+			for(size_t x = 0; x < rowBytes; x++)
+				line[x] += _paeth(x ? line[x - 1] : 0, previous ? previous[x] : 0, x && previous ? previous[x - 1] : 0);
+			break;
+		default:
+			return false;
+		}
+		previous = line;
+	}
+	return true;
+}
+
+bool pp::isIndexedPng(const std::string& path)
+{
+	uint8_t data[PNG_HEADER_BYTES];
+	std::ifstream file(path.c_str(), std::ios::binary);
+	PngHeader header;
+	return file.read((char*)data, sizeof(data)) && _readHeader(data, sizeof(data), header) && _indexedHeader(header);
+}
+
+bool pp::readIndexedPng(const std::string& path, IndexedImage& result, std::string& error)
+{
+	std::vector<uint8_t> file;
+	PngHeader header;
+	if(!_readFile(path, file))
+	{
+		error = "can't read " + path;
+		return false;
+	}
+	if(!_readHeader(&file[0], file.size(), header) || !_indexedHeader(header))
+	{
+		error = path + " isn't a paletted PNG";
+		return false;
+	}
+
+	//the filtered rows are inflated straight into one buffer, IDAT by IDAT
+	size_t rowBytes = ((size_t)header.width * header.bitDepth + 7) / 8;
+	std::vector<uint8_t> raw((rowBytes + 1) * header.height);
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit(&stream) != Z_OK)
+	{
+		error = "can't inflate " + path;
+		return false;
+	}
+	stream.next_out = &raw[0];
+	stream.avail_out = (uInt)raw.size();
+
+	std::vector<uint32_t> colors;
+	int status = Z_OK;
+	bool corrupt = false;
+	for(size_t offset = 8; offset + 12 <= file.size() && !corrupt; )
+	{
+		uint32_t length = _readUint32(&file[offset]);
+		if(length > file.size() - offset - 12)
+			break;
+		const uint8_t* type = &file[offset + 4];
+		const uint8_t* data = type + 4;
+		if(crc32(0, type, length + 4) != _readUint32(data + length))
+			corrupt = true;
+		else if(memcmp(type, "PLTE", 4) == 0)
+		{
+			colors.resize(std::min<size_t>(length / 3, IndexedImage::MAX_COLORS));
+			for(size_t i = 0; i < colors.size(); i++)
+				colors[i] = 0xFF000000 | (data[3 * i] << 16) | (data[3 * i + 1] << 8) | data[3 * i + 2];
+		}
+		else if(memcmp(type, "tRNS", 4) == 0)
+		{
+			for(size_t i = 0; i < length && i < colors.size(); i++)
+				colors[i] = (colors[i] & 0xFFFFFF) | ((uint32_t)data[i] << 24);
+		}
+		else if(memcmp(type, "IDAT", 4) == 0 && status == Z_OK)
+		{
+			stream.next_in = (Bytef*)data;
+			stream.avail_in = length;
+			status = inflate(&stream, Z_NO_FLUSH);
+			//no progress, an empty IDAT or blocks without data past the last row
+			if(status == Z_BUF_ERROR)
+				status = Z_OK;
+			corrupt = status != Z_OK && status != Z_STREAM_END;
+		}
+		else if(memcmp(type, "IEND", 4) == 0)
+			break;
+		offset += length + 12;
+	}
+	inflateEnd(&stream);
+
+	//all rows are there, a stream that doesn't end after them is taken like libpng does
+	if(corrupt || stream.avail_out != 0 || colors.empty() || !_unfilter(&raw[0], rowBytes, header.height))
+	{
+		error = "corrupt or truncated " + path;
+		return false;
+	}
+
+	result.indices.resize(header.width, header.height);
+	result.colors.swap(colors);
+	int depth = header.bitDepth;
+	int perByte = 8 / depth;
+	uint32_t mask = (1u << depth) - 1;
+	for(uint32_t y = 0; y < header.height; y++)
+	{
+		const uint8_t* line = &raw[y * (rowBytes + 1) + 1];
+		uint32_t* dst = result.indices.row(y);
+		if(depth == 8)
+			std::copy(line, line + header.width, dst);
+		else
+			for(uint32_t x = 0; x < header.width; x++)
+				dst[x] = (line[x / perByte] >> (8 - depth * (x % perByte + 1))) & mask;
+	}
+	mergeDuplicates(result);
+	return true;
+}
+
+//Deflates one piece of the filtered rows as raw deflate data primed with the 32K before it,
+//so splitting barely costs compression. All pieces but the last end with a sync flush on a
+//byte boundary, so they can simply be put one after the other.
+struct DeflatePiece
+{
+	DeflatePiece(const std::vector<uint8_t>& raw, size_t pieceBytes, int level, std::vector<std::vector<uint8_t> >& pieces, std::vector<uLong>& checksums)
+	:	raw(raw), pieceBytes(pieceBytes), level(level), pieces(pieces), checksums(checksums) {}
+
+	void operator()(int index, Scratch&) const
+	{
+		size_t begin = index * pieceBytes;
+		size_t end = std::min(begin + pieceBytes, raw.size());
+		bool last = end == raw.size();
+		std::vector<uint8_t>& out = pieces[index];
+		checksums[index] = adler32(adler32(0, NULL, 0), &raw[begin], (uInt)(end - begin));
+
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if(deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return;
+		if(begin > 0)
+		{
+			size_t dictionary = std::min<size_t>(begin, 32768);
+			deflateSetDictionary(&stream, &raw[begin - dictionary], (uInt)dictionary);
+		}
+		out.resize(deflateBound(&stream, (uLong)(end - begin)) + 16);
+		stream.next_in = (Bytef*)&raw[begin];
+		stream.avail_in = (uInt)(end - begin);
+		stream.next_out = &out[0];
+		stream.avail_out = (uInt)out.size();
+		int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+		//an empty piece marks the failure
+		bool done = last ? status == Z_STREAM_END : status == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+		out.resize(done ? out.size() - stream.avail_out : 0);
+		deflateEnd(&stream);
+	}
+
+	const std::vector<uint8_t>& raw;
+	size_t pieceBytes;
+	int level;
+	std::vector<std::vector<uint8_t> >& pieces;
+	std::vector<uLong>& checksums;
+};
+
+//a zlib stream of raw, pieces are deflated in parallel and joined like pigz does
+bool _deflate(const std::vector<uint8_t>& raw, int level, ExecutionContext* context, std::vector<uint8_t>& result)
+{
+	static const size_t PIECE_BYTES = 256 << 10;
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	level = std::min(std::max(level, 0), 9);
+	size_t pieceBytes = ctx.threads() > 1 ? PIECE_BYTES : raw.size();
+	int count = (int)((raw.size() + pieceBytes - 1) / pieceBytes);
+	std::vector<std::vector<uint8_t> > pieces(count);
+	std::vector<uLong> checksums(count);
+	ctx.parallelFor(count, DeflatePiece(raw, pieceBytes, level, pieces, checksums));
+
+	//header with the level hint, FCHECK makes it a multiple of 31
+	int cmf = 0x78;
+	int flg = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+	flg += 31 - (cmf * 256 + flg) % 31;
+	result.clear();
+	result.push_back((uint8_t)cmf);
+	result.push_back((uint8_t)flg);
+	uLong adler = checksums[0];
+	for(int i = 0; i < count; i++)
+	{
+		if(pieces[i].empty())
+			return false;
+		result.insert(result.end(), pieces[i].begin(), pieces[i].end());
+		if(i > 0)
+		{
+			size_t begin = i * pieceBytes;
+			adler = adler32_combine(adler, checksums[i], (z_off_t)(std::min(begin + pieceBytes, raw.size()) - begin));
+		}
+	}
+	_appendUint32(result, (uint32_t)adler);
+	return true;
+}
+
+bool _writePng(const std::string& path, const std::vector<uint8_t>& ihdr, const std::vector<uint8_t>& plte, const std::vector<uint8_t>& trns,
+	const std::vector<uint8_t>& raw, int level, ExecutionContext* context, std::string& error)
+{
+	std::vector<uint8_t> compressed;
+	if(!_deflate(raw, level, context, compressed))
+	{
+		error = "can't deflate " + path;
+		return false;
+	}
+
+	std::ofstream file(path.c_str(), std::ios::binary);
+	file.write((const char*)PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+	_writeChunk(file, "IHDR", &ihdr[0], ihdr.size());
+	if(!plte.empty())
+		_writeChunk(file, "PLTE", &plte[0], plte.size());
+	if(!trns.empty())
+		_writeChunk(file, "tRNS", &trns[0], trns.size());
+	//decoders read IDAT by IDAT, keep them moderate
+	static const size_t IDAT_BYTES = 1 << 20;
+	for(size_t offset = 0; offset < compressed.size(); offset += IDAT_BYTES)
+		_writeChunk(file, "IDAT", &compressed[offset], std::min(IDAT_BYTES, compressed.size() - offset));
+	_writeChunk(file, "IEND", NULL, 0);
+	if(!file)
+	{
+		error = "can't write " + path;
+		return false;
+	}
+	return true;
+}
+
+std::vector<uint8_t> _header(int width, int height, int depth, int colorType)
+{
+	std::vector<uint8_t> ihdr;
+	_appendUint32(ihdr, width);
+	_appendUint32(ihdr, height);
+	ihdr.push_back((uint8_t)depth);
+	ihdr.push_back((uint8_t)colorType);
+	ihdr.push_back(0); //deflate
+	ihdr.push_back(0); //adaptive filters
+	ihdr.push_back(0); //not interlaced
+	return ihdr;
+}
+
+bool pp::writeIndexedPng(const std::string& path, const IndexedImage& image, std::string& error, int level, ExecutionContext* context)
+{
+	if(image.empty() || image.colors.empty() || image.colors.size() > IndexedImage::MAX_COLORS)
+	{
+		error = "can't write " + path + " as a paletted PNG";
+		return false;
+	}
+
+	size_t count = image.colors.size();
+	int depth = count <= 2 ? 1 : count <= 4 ? 2 : count <= 16 ? 4 : 8;
+	int perByte = 8 / depth;
+	uint32_t mask = (1u << depth) - 1;
+	size_t rowBytes = ((size_t)image.width() * depth + 7) / 8;
+	//filter type 0 on every row, the others rarely pay off for indices
+	std::vector<uint8_t> raw((rowBytes + 1) * image.height(), 0);
+	for(int y = 0; y < image.height(); y++)
+	{
+		uint8_t* line = &raw[y * (rowBytes + 1) + 1];
+		const uint32_t* src = image.indices.row(y);
+		if(depth == 8)
+			for(int x = 0; x < image.width(); x++)
+				line[x] = (uint8_t)src[x];
+		else
+			for(int x = 0; x < image.width(); x++)
+				line[x / perByte] |= (src[x] & mask) << (8 - depth * (x % perByte + 1));
+	}
+
+	std::vector<uint8_t> plte;
+	std::vector<uint8_t> trns;
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t color = image.colors[i];
+		plte.push_back(0xFF & (color >> 16));
+		plte.push_back(0xFF & (color >> 8));
+		plte.push_back(0xFF & color);
+		trns.push_back(color >> 24);
+	}
+	//entries after the last translucent one are opaque by default
+	while(!trns.empty() && trns.back() == 0xFF)
+		trns.pop_back();
+	return _writePng(path, _header(image.width(), image.height(), depth, 3), plte, trns, raw, level, context, error);
+}
+
+//Filters bands of rows of a truecolor image. Each row gets the filter whose output has the
+//smallest sum of absolute values, the heuristic libpng uses.
+struct FilterRows
+{
+	static const int BAND = 32;
+
+	FilterRows(const Surface& image, int channels, bool adaptive, std::vector<uint8_t>& raw)
+	:	image(image), channels(channels), adaptive(adaptive), raw(raw), rowBytes((size_t)image.getWidth() * channels) {}
+
+	void operator()(int index, Scratch& scratch) const
+	{
+		uint8_t* rows[2];
+		rows[0] = scratch.get<uint8_t>(7 * rowBytes);
+		rows[1] = rows[0] + rowBytes;
+		uint8_t* candidates = rows[1] + rowBytes;
+		int y0 = index * BAND;
+		int y1 = std::min(y0 + BAND, image.getHeight());
+		//the row above the band, zeros above the image
+		if(y0 > 0)
+			packRow(image, y0 - 1, rows[(y0 - 1) & 1], channels);
+		else
+			std::fill(rows[1], rows[1] + rowBytes, 0);
+		for(int y = y0; y < y1; y++)
+		{
+			uint8_t* line = rows[y & 1];
+			const uint8_t* up = rows[(y + 1) & 1];
+			packRow(image, y, line, channels);
+			uint8_t* out = &raw[y * (rowBytes + 1)];
+			if(!adaptive)
+			{
+				out[0] = 0;
+				std::copy(line, line + rowBytes, out + 1);
+				continue;
+			}
+			//None, Sub, Up, Average, Paeth
+			uint8_t* candidate[5];
+			for(int filter = 0; filter < 5; filter++)
+				candidate[filter] = candidates + filter * rowBytes;
+			size_t c = channels;
+			for(size_t x = 0; x < rowBytes; x++)
+			{
+				int left = x >= c ? line[x - c] : 0;
+				int corner = x >= c ? up[x - c] : 0;
+				candidate[0][x] = line[x];
+				candidate[1][x] = (uint8_t)(line[x] - left);
+				candidate[2][x] = (uint8_t)(line[x] - up[x]);
+				candidate[3][x] = (uint8_t)(line[x] - (left + up[x]) / 2);
+				candidate[4][x] = (uint8_t)(line[x] - _paeth(left, up[x], corner));
+			}
+			int best = 0;
+			size_t bestSum = (size_t)-1;
+			for(int filter = 0; filter < 5; filter++)
+			{
+				size_t sum = 0;
+				for(size_t x = 0; x < rowBytes; x++)
+					sum += abs((int8_t)candidate[filter][x]);
+				if(sum < bestSum)
+				{
+					best = filter;
+					bestSum = sum;
+				}
+			}
+			out[0] = (uint8_t)best;
+			std::copy(candidates + best * rowBytes, candidates + (best + 1) * rowBytes, out + 1);
+		}
+	}
+
+	const Surface& image;
+	int channels;
+	bool adaptive;
+	std::vector<uint8_t>& raw;
+	size_t rowBytes;
+};
+
+bool pp::writePng(const std::string& path, const Surface& image, std::string& error, int level, ExecutionContext* context)
+{
+	if(!image.getData() || image.getWidth() <= 0 || image.getHeight() <= 0)
+	{
+		error = "can't write an empty image to " + path;
+		return false;
+	}
+	int channels = image.hasAlpha() ? 4 : 3;
+	std::vector<uint8_t> raw(((size_t)image.getWidth() * channels + 1) * image.getHeight());
+	//stored data doesn't get smaller by filtering
+	ExecutionContext& ctx = ExecutionContext::get(context);
+	ctx.parallelFor((image.getHeight() + FilterRows::BAND - 1) / FilterRows::BAND, FilterRows(image, channels, level > 0, raw));
+	return _writePng(path, _header(image.getWidth(), image.getHeight(), 8, image.hasAlpha() ? 6 : 2), std::vector<uint8_t>(), std::vector<uint8_t>(), raw, level, context, error);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pixelpunch/IndexedImage.h"
+#include <string>
+
+//PNGs read and written with zlib directly. Paletted files stay indices and a palette from
+//file to file instead of being expanded to RGB(A) by Cinder's ImageIo. Only non interlaced
+//color type 3 is read, everything else is left to Cinder.
+namespace pp
+{
+	//peeks at the header, true if readIndexedPng can read the file
+	bool isIndexedPng(const std::string& path);
+	//entries of the palette with the same color are merged
+	bool readIndexedPng(const std::string& path, IndexedImage& result, std::string& error);
+
+	//Writers split the filtered rows into pieces that are deflated on the threads of the
+	//context and joined into one zlib stream. level is zlib's, 0 stores, 9 is the smallest.
+	static const int DEFAULT_PNG_LEVEL = 6;
+
+	//uses the smallest bit depth the palette fits, tRNS only if some color isn't opaque
+	bool writeIndexedPng(const std::string& path, const IndexedImage& image, std::string& error, int level = DEFAULT_PNG_LEVEL, ExecutionContext* context = NULL);
+	//RGB or RGBA like the surface, each row with the filter that leaves the smallest differences
+	bool writePng(const std::string& path, const cinder::Surface& image, std::string& error, int level = DEFAULT_PNG_LEVEL, ExecutionContext* context = NULL);
+}
@@ -0,0 +1,232 @@
+#include "QoiFiles.h"
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace cinder;
+using namespace pp;
+
+enum
+{
+	QOI_OP_INDEX = 0x00,
+	QOI_OP_DIFF = 0x40,
+	QOI_OP_LUMA = 0x80,
+	QOI_OP_RUN = 0xC0,
+	QOI_OP_RGB = 0xFE,
+	QOI_OP_RGBA = 0xFF,
+	QOI_MASK = 0xC0
+};
+static const size_t QOI_HEADER_BYTES = 14;
+static const uint64_t QOI_MAX_PIXELS = 400000000; //the limit of the reference decoder
+static const uint8_t QOI_END[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+struct QoiPixel
+{
+	QoiPixel() : r(0), g(0), b(0), a(0) {}
+	QoiPixel(uint8_t r, uint8_t g, uint8_t b, uint8_t a) : r(r), g(g), b(b), a(a) {}
+	bool operator==(const QoiPixel& other) const { return r == other.r && g == other.g && b == other.b && a == other.a; }
+	int hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) % 64; }
+	uint8_t r, g, b, a;
+};
+
+uint32_t _readBigEndian(const uint8_t* data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+void _writeBigEndian(uint8_t* data, uint32_t value)
+{
+	data[0] = 0xFF & (value >> 24);
+	data[1] = 0xFF & (value >> 16);
+	data[2] = 0xFF & (value >> 8);
+	data[3] = 0xFF & value;
+}
+
+bool pp::readQoi(const std::string& path, Surface& result, std::string& error)
+{
+	std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+	std::streamoff size = file ? (std::streamoff)file.tellg() : 0;
+	std::vector<uint8_t> data(size > 0 ? (size_t)size : 0);
+	file.seekg(0);
+	if(data.size() < QOI_HEADER_BYTES + sizeof(QOI_END) || !file.read((char*)&data[0], data.size()))
+	{
+		error = "can't read " + path;
+		return false;
+	}
+	uint32_t width = _readBigEndian(&data[4]);
+	uint32_t height = _readBigEndian(&data[8]);
+	int channels = data[12];
+	if(memcmp(&data[0], "qoif", 4) != 0 || width == 0 || height == 0 || (uint64_t)width * height > QOI_MAX_PIXELS || (channels != 3 && channels != 4))
+	{
+		error = path + " isn't a QOI file";
+		return false;
+	}
+
+	result = Surface(width, height, channels == 4);
+	int inc = result.getPixelInc();
+	int r = result.getRedOffset();
+	int g = result.getGreenOffset();
+	int b = result.getBlueOffset();
+	int a = channels == 4 ? result.getAlphaOffset() : -1;
+	QoiPixel index[64];
+	QoiPixel pixel(0, 0, 0, 255);
+	int run = 0;
+	size_t offset = QOI_HEADER_BYTES;
+	size_t end = data.size() - sizeof(QOI_END);
+	for(uint32_t y = 0; y < height; y++)
+	{
+		uint8_t* line = result.getData() + y * result.getRowBytes();
+		for(uint32_t x = 0; x < width; x++, line += inc)
+		{
+			if(run > 0)
+				run--;
+			else if(offset < end)
+			{
+				int op = data[offset++];
+				if(op == QOI_OP_RGB)
+				{
+					pixel.r = data[offset++];
+					pixel.g = data[offset++];
+					pixel.b = data[offset++];
+				}
+				else if(op == QOI_OP_RGBA)
+				{
+					pixel.r = data[offset++];
+					pixel.g = data[offset++];
+					pixel.b = data[offset++];
+					pixel.a = data[offset++];
+				}
+				else if((op & QOI_MASK) == QOI_OP_INDEX)
+					pixel = index[op];
+				else if((op & QOI_MASK) == QOI_OP_DIFF)
+				{
+					pixel.r += ((op >> 4) & 3) - 2;
+					pixel.g += ((op >> 2) & 3) - 2;
+					pixel.b += (op & 3) - 2;
+				}
+				else if((op & QOI_MASK) == QOI_OP_LUMA)
+				{
+					int second = data[offset++];
+					int dg = (op & 0x3F) - 32;
+					pixel.r += dg - 8 + ((second >> 4) & 0x0F);
+					pixel.g += dg;
+					pixel.b += dg - 8 + (second & 0x0F);
+				}
+				else
+					run = op & 0x3F;
+				index[pixel.hash()] = pixel;
+			}
+			else
+			{
+				error = "truncated " + path;
+				return false;
+			}
+			line[r] = pixel.r;
+			line[g] = pixel.g;
+			line[b] = pixel.b;
+			if(a >= 0)
+				line[a] = pixel.a;
+		}
+	}
+	return true;
+}
+
+bool pp::writeQoi(const std::string& path, const Surface& image, std::string& error)
+{
+	uint32_t width = image.getWidth();
+	uint32_t height = image.getHeight();
+	int channels = image.hasAlpha() ? 4 : 3;
+	if(!image.getData() || width == 0 || height == 0)
+	{
+		error = "can't write an empty image to " + path;
+		return false;
+	}
+
+	//worst case is a full op for every pixel
+	std::vector<uint8_t> data(QOI_HEADER_BYTES + (size_t)width * height * (channels + 1) + sizeof(QOI_END));
+	memcpy(&data[0], "qoif", 4);
+	_writeBigEndian(&data[4], width);
+	_writeBigEndian(&data[8], height);
+	data[12] = (uint8_t)channels;
+	data[13] = 0; //sRGB with linear alpha
+	uint8_t* out = &data[QOI_HEADER_BYTES];
+
+	int inc = image.getPixelInc();
+	int r = image.getRedOffset();
+	int g = image.getGreenOffset();
+	int b = image.getBlueOffset();
+	int a = channels == 4 ? image.getAlphaOffset() : -1;
+	QoiPixel index[64];
+	QoiPixel previous(0, 0, 0, 255);
+	int run = 0;
+	for(uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* line = image.getData() + y * image.getRowBytes();
+		for(uint32_t x = 0; x < width; x++, line += inc)
+		{
+			QoiPixel pixel(line[r], line[g], line[b], a >= 0 ? line[a] : 255);
+			if(pixel == previous)
+			{
+				if(++run == 62)
+				{
+					*out++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if(run > 0)
+			{
+				*out++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			int hash = pixel.hash();
+			if(index[hash] == pixel)
+				*out++ = (uint8_t)(QOI_OP_INDEX | hash);
+			else if(pixel.a != previous.a)
+			{
+				*out++ = QOI_OP_RGBA;
+				*out++ = pixel.r;
+				*out++ = pixel.g;
+				*out++ = pixel.b;
+				*out++ = pixel.a;
+			}
+			else
+			{
+				int dr = (int8_t)(pixel.r - previous.r);
+				int dg = (int8_t)(pixel.g - previous.g);
+				int db = (int8_t)(pixel.b - previous.b);
+				int drg = dr - dg;
+				int dbg = db - dg;
+				if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					*out++ = (uint8_t)(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+				else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					*out++ = (uint8_t)(QOI_OP_LUMA | (dg + 32));
+					*out++ = (uint8_t)(((drg + 8) << 4) | (dbg + 8));
+				}
+				else
+				{
+					*out++ = QOI_OP_RGB;
+					*out++ = pixel.r;
+					*out++ = pixel.g;
+					*out++ = pixel.b;
+				}
+			}
+			index[hash] = pixel;
+			previous = pixel;
+		}
+	}
+	if(run > 0)
+		*out++ = (uint8_t)(QOI_OP_RUN | (run - 1));
+	memcpy(out, QOI_END, sizeof(QOI_END));
+	out += sizeof(QOI_END);
+
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if(!file.write((const char*)&data[0], out - &data[0]))
+	{
+		error = "can't write " + path;
+		return false;
+	}
+	return true;
+}
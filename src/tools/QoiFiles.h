@@ -0,0 +1,15 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include <string>
+
+//The Quite OK Image format (qoiformat.org), lossless and encoded in one fast pass without
+//entropy coding. Meant for intermediate results that only the tools read back, where how
+//fast they are written matters more than how small they are.
+namespace pp
+{
+	bool readQoi(const std::string& path, cinder::Surface& result, std::string& error);
+	//3 or 4 channels like the surface, sRGB
+	bool writeQoi(const std::string& path, const cinder::Surface& image, std::string& error);
+}
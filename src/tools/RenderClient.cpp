@@ -0,0 +1,88 @@
+#include "RenderClient.h"
+#include "pixelpunch/ImageStream.h"
+#include <atomic>
+#include <cstdio>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace cinder;
+using namespace pp;
+
+//segments of all clients in a process need different names
+static std::atomic<int> sInputs(0);
+
+RenderClient::RenderClient()
+{
+}
+
+RenderClient::~RenderClient()
+{
+	close();
+}
+
+bool RenderClient::connect(const std::string& socketPath)
+{
+	close();
+	mSocket = LineSocket(connectUnix(socketPath));
+	return mSocket.fd() >= 0;
+}
+
+void RenderClient::close()
+{
+	if(mSocket.fd() >= 0)
+		::close(mSocket.fd());
+	mSocket = LineSocket();
+	mInput.unlink();
+	mInput.close();
+}
+
+bool RenderClient::render(const RenderRequest& request, RenderReply& reply, Surface& result)
+{
+	std::string line;
+	if(!mSocket.writeLine(formatRequest(request)) || !mSocket.readLine(line) || !parseReply(line, reply))
+	{
+		reply = RenderReply();
+		reply.error = "lost the connection to the daemon";
+		return false;
+	}
+	if(!reply.ok)
+		return false;
+
+	//the daemon handed the segment over, it's removed whether it can be mapped or not
+	SharedImage output;
+	bool mapped = output.open(reply.shm, reply.width, reply.height, reply.channels);
+	shm_unlink(reply.shm.c_str());
+	if(!mapped)
+	{
+		reply.ok = false;
+		reply.error = "can't map " + reply.shm;
+		return false;
+	}
+	result = Surface(reply.width, reply.height, reply.channels == 4);
+	for(int y = 0; y < reply.height; y++)
+		unpackRow(output.data() + (size_t)y * reply.width * reply.channels, reply.channels, result, y);
+	return true;
+}
+
+bool RenderClient::stats(std::string& line)
+{
+	return mSocket.writeLine("stats") && mSocket.readLine(line);
+}
+
+bool RenderClient::sendImage(const Surface& image, RenderRequest& request)
+{
+	mInput.unlink();
+	char name[64];
+	snprintf(name, sizeof(name), "/pp-in-%d-%d", (int)getpid(), sInputs++);
+	int channels = image.hasAlpha() ? 4 : 3;
+	if(!mInput.create(name, image.getWidth(), image.getHeight(), channels))
+		return false;
+	for(int y = 0; y < image.getHeight(); y++)
+		packRow(image, y, mInput.data() + (size_t)y * image.getWidth() * channels, channels);
+	request.source.clear();
+	request.shm = name;
+	request.width = image.getWidth();
+	request.height = image.getHeight();
+	request.channels = channels;
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "RenderProtocol.h"
+#include <string>
+
+namespace pp
+{
+	//One connection to the render daemon, jobs are sent one after the other.
+	class RenderClient
+	{
+	public:
+		RenderClient();
+		~RenderClient();
+
+		bool connect(const std::string& socketPath);
+		void close();
+
+		//sends the request, waits for the reply and copies the result out of shared memory.
+		//Use sendImage to pass source pixels in shared memory instead of a path.
+		bool render(const RenderRequest& request, RenderReply& reply, cinder::Surface& result);
+		bool stats(std::string& line);
+
+		//copies image into a new shared memory segment and points request at it, the segment
+		//is unlinked when the next one is made or the client closes
+		bool sendImage(const cinder::Surface& image, RenderRequest& request);
+
+	private:
+		RenderClient(const RenderClient&);
+		RenderClient& operator=(const RenderClient&);
+
+		LineSocket mSocket;
+		SharedImage mInput;
+	};
+}
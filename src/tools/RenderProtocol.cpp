@@ -0,0 +1,328 @@
+#include "RenderProtocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//OS X has no MSG_NOSIGNAL, the tools ignore SIGPIPE there
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+using namespace cinder;
+using namespace pp;
+
+RenderRequest::RenderRequest()
+:	id(0), priority(0), width(0), height(0), channels(0)
+{
+}
+
+RenderReply::RenderReply()
+:	id(0), ok(false), width(0), height(0), channels(0), milliseconds(0)
+{
+}
+
+//****** MESSAGES ******
+
+std::string pp::formatRequest(const RenderRequest& request)
+{
+	const RenderSettings& s = request.settings;
+	std::ostringstream line;
+	line << "render id=" << request.id << " priority=" << request.priority;
+	if(request.shm.empty())
+		line << " source=" << request.source;
+	else
+		line << " shm=" << request.shm << " width=" << request.width << " height=" << request.height << " channels=" << request.channels;
+	line << " scale=" << scaleMethodName(s.scale) << " transform=" << transformMethodName(s.transform) << " sampling=" << samplingMethodName(s.sampling);
+	line << " quad=";
+	for(int i = 0; i < 4; i++)
+		line << (i ? "," : "") << s.quad[i].x << "," << s.quad[i].y;
+	line << " threshold=" << s.mixThreshold;
+	return line.str();
+}
+
+bool pp::parseSetting(const std::string& key, const std::string& value, RenderSettings& settings)
+{
+	if(key == "scale")
+		return parseScaleMethod(value, settings.scale);
+	if(key == "transform")
+		return parseTransformMethod(value, settings.transform);
+	if(key == "sampling")
+		return parseSamplingMethod(value, settings.sampling);
+	if(key == "threshold")
+		settings.mixThreshold = (float)atof(value.c_str());
+	else if(key == "quad")
+	{
+		float v[8];
+		if(sscanf(value.c_str(), "%f,%f,%f,%f,%f,%f,%f,%f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+			return false;
+		for(int c = 0; c < 4; c++)
+			settings.quad[c] = vec2(v[2 * c], v[2 * c + 1]);
+	}
+	else
+		return false;
+	return true;
+}
+
+//key=value words after the first one, paths can't contain spaces
+bool _fields(const std::string& line, const char* command, std::vector<std::pair<std::string, std::string> >& fields)
+{
+	std::istringstream in(line);
+	std::string word;
+	if(!(in >> word) || word != command)
+		return false;
+	while(in >> word)
+	{
+		size_t equals = word.find('=');
+		if(equals == std::string::npos)
+			return false;
+		fields.push_back(std::make_pair(word.substr(0, equals), word.substr(equals + 1)));
+	}
+	return true;
+}
+
+bool pp::parseRequest(const std::string& line, RenderRequest& request, std::string& error)
+{
+	std::vector<std::pair<std::string, std::string> > fields;
+	if(!_fields(line, "render", fields))
+	{
+		error = "not a render request";
+		return false;
+	}
+	request = RenderRequest();
+	RenderSettings& s = request.settings;
+	for(size_t i = 0; i < fields.size(); i++)
+	{
+		const std::string& key = fields[i].first;
+		const std::string& value = fields[i].second;
+		bool valid = true;
+		if(key == "id")
+			request.id = atoi(value.c_str());
+		else if(key == "priority")
+			request.priority = atoi(value.c_str());
+		else if(key == "source")
+			request.source = value;
+		else if(key == "shm")
+			request.shm = value;
+		else if(key == "width")
+			request.width = atoi(value.c_str());
+		else if(key == "height")
+			request.height = atoi(value.c_str());
+		else if(key == "channels")
+			request.channels = atoi(value.c_str());
+		else
+			valid = parseSetting(key, value, s);
+		if(!valid)
+		{
+			error = "bad " + key + " " + value;
+			return false;
+		}
+	}
+	if(request.source.empty() == request.shm.empty())
+	{
+		error = "needs either source or shm";
+		return false;
+	}
+	if(!request.shm.empty() && (request.width <= 0 || request.height <= 0 || (request.channels != 3 && request.channels != 4)))
+	{
+		error = "shm needs width, height and 3 or 4 channels";
+		return false;
+	}
+	return true;
+}
+
+std::string pp::formatReply(const RenderReply& reply)
+{
+	std::ostringstream line;
+	if(!reply.ok)
+	{
+		line << "error id=" << reply.id << " " << reply.error;
+		return line.str();
+	}
+	line << "ok id=" << reply.id << " shm=" << reply.shm << " width=" << reply.width << " height=" << reply.height << " channels=" << reply.channels << " ms=" << reply.milliseconds;
+	return line.str();
+}
+
+bool pp::parseReply(const std::string& line, RenderReply& reply)
+{
+	reply = RenderReply();
+	if(line.compare(0, 6, "error ") == 0)
+	{
+		//the message is the rest of the line
+		size_t end = line.find(' ', 6);
+		if(line.compare(6, 3, "id=") == 0)
+			reply.id = atoi(line.c_str() + 9);
+		reply.error = end == std::string::npos ? std::string() : line.substr(end + 1);
+		return true;
+	}
+
+	std::vector<std::pair<std::string, std::string> > fields;
+	if(!_fields(line, "ok", fields))
+		return false;
+	reply.ok = true;
+	for(size_t i = 0; i < fields.size(); i++)
+	{
+		const std::string& key = fields[i].first;
+		const std::string& value = fields[i].second;
+		if(key == "id")
+			reply.id = atoi(value.c_str());
+		else if(key == "shm")
+			reply.shm = value;
+		else if(key == "width")
+			reply.width = atoi(value.c_str());
+		else if(key == "height")
+			reply.height = atoi(value.c_str());
+		else if(key == "channels")
+			reply.channels = atoi(value.c_str());
+		else if(key == "ms")
+			reply.milliseconds = atof(value.c_str());
+	}
+	return true;
+}
+
+//****** SHARED MEMORY ******
+
+SharedImage::SharedImage()
+:	mData(NULL), mSize(0), mWidth(0), mHeight(0), mChannels(0)
+{
+}
+
+SharedImage::~SharedImage()
+{
+	close();
+}
+
+bool SharedImage::create(const std::string& name, int width, int height, int channels)
+{
+	close();
+	size_t size = (size_t)width * height * channels;
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0)
+		return false;
+	if(ftruncate(fd, size) != 0)
+	{
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(view == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+	mName = name;
+	mData = (uint8_t*)view;
+	mSize = size;
+	mWidth = width;
+	mHeight = height;
+	mChannels = channels;
+	return true;
+}
+
+bool SharedImage::open(const std::string& name, int width, int height, int channels)
+{
+	close();
+	size_t size = (size_t)width * height * channels;
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(fd < 0)
+		return false;
+	//a segment smaller than the image would fault on read
+	struct stat info;
+	void* view = MAP_FAILED;
+	if(fstat(fd, &info) == 0 && (size_t)info.st_size >= size)
+		view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(view == MAP_FAILED)
+		return false;
+	mName = name;
+	mData = (uint8_t*)view;
+	mSize = size;
+	mWidth = width;
+	mHeight = height;
+	mChannels = channels;
+	return true;
+}
+
+void SharedImage::close()
+{
+	if(mData)
+		munmap(mData, mSize);
+	mData = NULL;
+	mSize = 0;
+	mName.clear();
+}
+
+void SharedImage::unlink()
+{
+	if(!mName.empty())
+		shm_unlink(mName.c_str());
+}
+
+Surface SharedImage::surface() const
+{
+	return Surface(mData, mWidth, mHeight, mWidth * mChannels, SurfaceChannelOrder(mChannels == 4 ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB));
+}
+
+//****** SOCKETS ******
+
+bool LineSocket::readLine(std::string& line)
+{
+	while(true)
+	{
+		size_t end = mBuffer.find('\n');
+		if(end != std::string::npos)
+		{
+			line = mBuffer.substr(0, end);
+			mBuffer.erase(0, end + 1);
+			return true;
+		}
+		char chunk[4096];
+		ssize_t count = read(mFd, chunk, sizeof(chunk));
+		if(count <= 0)
+			return false;
+		mBuffer.append(chunk, count);
+	}
+}
+
+bool LineSocket::writeLine(const std::string& line)
+{
+	std::string message = line + "\n";
+	const char* data = message.data();
+	size_t left = message.size();
+	while(left > 0)
+	{
+		ssize_t count = send(mFd, data, left, MSG_NOSIGNAL);
+		if(count <= 0)
+			return false;
+		data += count;
+		left -= count;
+	}
+	return true;
+}
+
+int pp::connectUnix(const std::string& path)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+	if(connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "pixelpunch/Render.h"
+#include <string>
+#include <vector>
+
+//Jobs for the render daemon, one line of text per message over a Unix domain socket:
+//
+//  render id=7 priority=2 source=/art/hero.png scale=scale2x transform=projective
+//         sampling=minimizeerror quad=0,0,64,8,60,70,-4,64 threshold=0.5
+//  ok id=7 shm=/pp-1234-7 width=64 height=70 channels=4 ms=3.2
+//  error id=7 can't read /art/hero.png
+//
+//Instead of source a job can pass its pixels in shared memory with shm=<name> width=<w>
+//height=<h> channels=<3|4>, tightly packed RGB(A) rows. Results are always passed that way,
+//the client unlinks the result segment once it has read it. "stats" asks for the counters of
+//the daemon. POSIX only.
+namespace pp
+{
+	struct RenderRequest
+	{
+		RenderRequest();
+		int id;
+		int priority; //higher runs first
+		std::string source; //path, or empty if the pixels are in shm
+		std::string shm;
+		int width;
+		int height;
+		int channels;
+		RenderSettings settings;
+	};
+
+	struct RenderReply
+	{
+		RenderReply();
+		int id;
+		bool ok;
+		std::string error;
+		std::string shm;
+		int width;
+		int height;
+		int channels;
+		double milliseconds; //render time in the daemon without waiting in the queue
+	};
+
+	//scale, transform, sampling, threshold or quad as in a request, false for other keys
+	bool parseSetting(const std::string& key, const std::string& value, RenderSettings& settings);
+	std::string formatRequest(const RenderRequest& request);
+	bool parseRequest(const std::string& line, RenderRequest& request, std::string& error);
+	std::string formatReply(const RenderReply& reply);
+	bool parseReply(const std::string& line, RenderReply& reply);
+
+	//A mapped POSIX shared memory segment holding a tightly packed RGB(A) image.
+	class SharedImage
+	{
+	public:
+		SharedImage();
+		~SharedImage();
+
+		bool create(const std::string& name, int width, int height, int channels);
+		bool open(const std::string& name, int width, int height, int channels);
+		void close();
+		void unlink(); //the name only, the mapping stays valid until close
+
+		uint8_t* data() const { return mData; }
+		size_t size() const { return mSize; }
+		//refers to the mapped pixels, valid until close
+		cinder::Surface surface() const;
+
+	private:
+		SharedImage(const SharedImage&);
+		SharedImage& operator=(const SharedImage&);
+
+		std::string mName;
+		uint8_t* mData;
+		size_t mSize;
+		int mWidth;
+		int mHeight;
+		int mChannels;
+	};
+
+	//lines over a connected socket
+	class LineSocket
+	{
+	public:
+		LineSocket(int fd = -1) : mFd(fd) {}
+		int fd() const { return mFd; }
+		bool readLine(std::string& line);
+		bool writeLine(const std::string& line);
+
+	private:
+		int mFd;
+		std::string mBuffer;
+	};
+
+	int connectUnix(const std::string& path); //-1 if there is no daemon
+}
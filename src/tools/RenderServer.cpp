@@ -0,0 +1,342 @@
+#include "RenderServer.h"
+#include "ImageFiles.h"
+#include "pixelpunch/ImageStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace cinder;
+using namespace pp;
+
+//nanoseconds, saves in the same second have to count as changes
+long long _modified(const struct stat& info)
+{
+#if defined(__APPLE__)
+	return (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+	return (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+}
+
+RenderServer::RenderServer(const Options& options)
+:	mOptions(options), mContext(options.threads), mMaps(options.maps), mListener(-1), mStopping(false), mNextJob(0)
+{
+	mContext.setPool(&mPool);
+}
+
+RenderServer::~RenderServer()
+{
+	stop();
+}
+
+bool RenderServer::start(std::string& error)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(mOptions.socketPath.size() >= sizeof(address.sun_path))
+	{
+		error = "socket path too long";
+		return false;
+	}
+	strcpy(address.sun_path, mOptions.socketPath.c_str());
+
+	//a socket file left behind by a daemon that didn't stop cleanly
+	unlink(mOptions.socketPath.c_str());
+	mListener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(mListener < 0 || bind(mListener, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(mListener, 64) != 0)
+	{
+		error = std::string("can't listen on ") + mOptions.socketPath + ": " + strerror(errno);
+		if(mListener >= 0)
+			close(mListener);
+		mListener = -1;
+		return false;
+	}
+
+	mStopping = false;
+	for(int i = 0; i < std::max(mOptions.jobThreads, 1); i++)
+		mWorkers.push_back(std::thread(&RenderServer::work, this));
+	mAccept = std::thread(&RenderServer::listen, this);
+	return true;
+}
+
+void RenderServer::stop()
+{
+	if(mListener < 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mStopping = true;
+		for(std::set<int>::iterator it = mOpen.begin(); it != mOpen.end(); ++it)
+			shutdown(*it, SHUT_RDWR);
+		//jobs that didn't start are dropped, their connections give up waiting
+		while(!mQueue.empty())
+			mQueue.pop();
+	}
+	mQueued.notify_all();
+	mDone.notify_all();
+	shutdown(mListener, SHUT_RDWR);
+	close(mListener);
+	mListener = -1;
+	unlink(mOptions.socketPath.c_str());
+
+	mAccept.join();
+	for(size_t i = 0; i < mWorkers.size(); i++)
+		mWorkers[i].join();
+	mWorkers.clear();
+	for(std::list<std::thread>::iterator it = mConnections.begin(); it != mConnections.end(); ++it)
+		it->join();
+	mConnections.clear();
+	mFinished.clear();
+}
+
+RenderServerStats RenderServer::stats()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	RenderServerStats result = mStats;
+	result.queued = mQueue.size();
+	result.sources = mSources.size();
+	return result;
+}
+
+void RenderServer::listen()
+{
+	while(true)
+	{
+		int fd = accept(mListener, NULL, NULL);
+		std::lock_guard<std::mutex> lock(mLock);
+		if(mStopping)
+		{
+			if(fd >= 0)
+				close(fd);
+			return;
+		}
+		reap();
+		if(fd < 0)
+			continue;
+		mOpen.insert(fd);
+		mConnections.push_back(std::thread(&RenderServer::serve, this, fd));
+	}
+}
+
+//joins the threads of connections that ended, called with mLock held
+void RenderServer::reap()
+{
+	for(std::list<std::thread>::iterator it = mConnections.begin(); it != mConnections.end(); )
+		if(std::find(mFinished.begin(), mFinished.end(), it->get_id()) != mFinished.end())
+		{
+			it->join();
+			it = mConnections.erase(it);
+		}
+		else
+			++it;
+	mFinished.clear();
+}
+
+void RenderServer::serve(int fd)
+{
+	LineSocket socket(fd);
+	std::string line;
+	while(socket.readLine(line))
+	{
+		if(line == "stats")
+		{
+			RenderServerStats s = stats();
+			char text[256];
+			snprintf(text, sizeof(text), "ok stats jobs=%zu failed=%zu queued=%zu hits=%zu misses=%zu sources=%zu bytes=%zu", s.jobs, s.failed, s.queued, s.sourceHits, s.sourceMisses, s.sources, s.sourceBytes);
+			if(!socket.writeLine(text))
+				break;
+			continue;
+		}
+
+		JobRef job(new Job());
+		if(!parseRequest(line, job->request, job->reply.error))
+		{
+			if(!socket.writeLine(formatReply(job->reply)))
+				break;
+			continue;
+		}
+		job->reply.id = job->request.id;
+
+		std::unique_lock<std::mutex> lock(mLock);
+		if(mStopping)
+			break;
+		job->sequence = mNextJob++;
+		mQueue.push(job);
+		mQueued.notify_one();
+		while(!job->done && !mStopping)
+			mDone.wait(lock);
+		if(!job->done)
+		{
+			//a job thread still rendering it unlinks the result
+			job->abandoned = true;
+			break;
+		}
+		lock.unlock();
+
+		if(!socket.writeLine(formatReply(job->reply)))
+		{
+			//nobody is going to unlink the result
+			if(job->reply.ok)
+				shm_unlink(job->reply.shm.c_str());
+			break;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mLock);
+	mOpen.erase(fd);
+	close(fd);
+	mFinished.push_back(std::this_thread::get_id());
+}
+
+void RenderServer::work()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	while(true)
+	{
+		while(!mStopping && mQueue.empty())
+			mQueued.wait(lock);
+		if(mStopping)
+			return;
+		JobRef job = mQueue.top();
+		mQueue.pop();
+		lock.unlock();
+
+		render(*job);
+
+		lock.lock();
+		mStats.jobs++;
+		if(!job->reply.ok)
+			mStats.failed++;
+		if(job->abandoned && job->reply.ok)
+			shm_unlink(job->reply.shm.c_str());
+		job->done = true;
+		mDone.notify_all();
+	}
+}
+
+void RenderServer::render(Job& job)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RenderRequest& request = job.request;
+	RenderReply& reply = job.reply;
+
+	//pixels passed in shared memory are only read during the job and not cached
+	std::shared_ptr<RenderSource> source;
+	SharedImage input;
+	if(request.shm.empty())
+		source = this->source(request.source, reply.error);
+	else if(input.open(request.shm, request.width, request.height, request.channels))
+		source.reset(new RenderSource(input.surface(), false));
+	else
+		reply.error = "can't map " + request.shm;
+	if(!source)
+		return;
+
+	Surface result = pp::render(*source, request.settings, &mMaps, &mContext);
+	char name[64];
+	snprintf(name, sizeof(name), "/pp-%d-%zu", (int)getpid(), job.sequence);
+	reply.width = result.getWidth();
+	reply.height = result.getHeight();
+	reply.channels = result.hasAlpha() ? 4 : 3;
+	SharedImage output;
+	if(output.create(name, reply.width, reply.height, reply.channels))
+	{
+		for(int y = 0; y < reply.height; y++)
+			packRow(result, y, output.data() + (size_t)y * reply.width * reply.channels, reply.channels);
+		reply.ok = true;
+		reply.shm = name;
+	}
+	else
+		reply.error = std::string("can't create ") + name;
+	reply.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::shared_ptr<RenderSource> RenderServer::source(const std::string& path, std::string& error)
+{
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+	{
+		error = "can't find " + path;
+		return std::shared_ptr<RenderSource>();
+	}
+	long long modified = _modified(info);
+
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for(SourceList::iterator it = mSources.begin(); it != mSources.end(); ++it)
+			if(it->first == path)
+			{
+				if(it->second.modified != modified)
+				{
+					mSources.erase(it);
+					break;
+				}
+				mSources.splice(mSources.begin(), mSources, it);
+				mStats.sourceHits++;
+				return it->second.source;
+			}
+		mStats.sourceMisses++;
+	}
+
+	//decoded without the lock, jobs of other sources go on meanwhile
+	//paletted sources bring their palette along
+	Surface image;
+	IndexedImage indexed;
+	CachedSource cached;
+	if(loadIndexedFile(path, indexed, error))
+	{
+		Palette palette;
+		getColors(indexed, palette);
+		expand(indexed, image);
+		cached.source.reset(new RenderSource(image, palette));
+	}
+	else if(error.empty() && loadImageFile(path, image, error))
+		cached.source.reset(new RenderSource(image));
+	else
+		return std::shared_ptr<RenderSource>();
+	cached.modified = modified;
+
+	//sizes grow while jobs scale and rebuild, so they are summed up again for every insert.
+	//bytes() waits for a source another job is scaling, so it's asked without the lock.
+	std::vector<std::shared_ptr<RenderSource> > sources;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for(SourceList::iterator it = mSources.begin(); it != mSources.end(); ++it)
+			if(it->first == path)
+			{
+				//another job decoded it meanwhile
+				mSources.erase(it);
+				break;
+			}
+		mSources.push_front(std::make_pair(path, cached));
+		for(SourceList::iterator it = mSources.begin(); it != mSources.end(); ++it)
+			sources.push_back(it->second.source);
+	}
+	std::map<const RenderSource*, size_t> sizes;
+	for(size_t i = 0; i < sources.size(); i++)
+		sizes[sources[i].get()] = sources[i]->bytes();
+
+	std::lock_guard<std::mutex> lock(mLock);
+	size_t bytes = 0;
+	SourceList::iterator it = mSources.begin();
+	for(; it != mSources.end(); ++it)
+	{
+		//sources inserted meanwhile were counted by their own insert
+		std::map<const RenderSource*, size_t>::iterator size = sizes.find(it->second.source.get());
+		size_t sourceBytes = size != sizes.end() ? size->second : 0;
+		if(bytes + sourceBytes > mOptions.cacheBytes && it != mSources.begin())
+			break;
+		bytes += sourceBytes;
+	}
+	mSources.erase(it, mSources.end());
+	mStats.sourceBytes = bytes;
+	return cached.source;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "RenderProtocol.h"
+#include "pixelpunch/ExecutionContext.h"
+#include "pixelpunch/SurfacePool.h"
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pp
+{
+	struct RenderServerStats
+	{
+		RenderServerStats() : jobs(0), failed(0), queued(0), sourceHits(0), sourceMisses(0), sources(0), sourceBytes(0) {}
+		size_t jobs;
+		size_t failed;
+		size_t queued; //waiting right now
+		size_t sourceHits;
+		size_t sourceMisses;
+		size_t sources; //decoded and cached
+		size_t sourceBytes;
+	};
+
+	//Long running renderer for the jobs of RenderProtocol.h. Decoded sources with their scaled
+	//images and palettes and the coordinate maps stay cached between jobs. A cached source is
+	//decoded again when its file changes. Jobs wait in one queue ordered by priority and run on
+	//a few job threads that share the workers of one ExecutionContext, so a burst of jobs
+	//doesn't start more threads than there are cores. Every connection gets a thread that
+	//handles its jobs one after the other.
+	class RenderServer
+	{
+	public:
+		struct Options
+		{
+			Options() : jobThreads(2), threads(0), cacheBytes((size_t)512 << 20), maps(32) {}
+			std::string socketPath;
+			int jobThreads; //jobs rendered at once
+			int threads; //workers of the context, 0 = all cores
+			size_t cacheBytes; //of decoded sources and what was made of them
+			size_t maps;
+		};
+
+		RenderServer(const Options& options);
+		~RenderServer();
+
+		bool start(std::string& error);
+		void stop();
+		RenderServerStats stats();
+
+	private:
+		//shared by the connection and the job thread, either may be gone first on stop
+		struct Job
+		{
+			Job() : sequence(0), done(false), abandoned(false) {}
+			RenderRequest request;
+			RenderReply reply;
+			size_t sequence; //first come first served within a priority
+			bool done;
+			bool abandoned; //the connection stopped waiting, the result is removed again
+		};
+		typedef std::shared_ptr<Job> JobRef;
+		struct JobOrder
+		{
+			bool operator()(const JobRef& a, const JobRef& b) const
+			{
+				return a->request.priority != b->request.priority ? a->request.priority < b->request.priority : a->sequence > b->sequence;
+			}
+		};
+		struct CachedSource
+		{
+			std::shared_ptr<RenderSource> source;
+			long long modified; //of the file when it was decoded
+		};
+		typedef std::list<std::pair<std::string, CachedSource> > SourceList;
+
+		void listen();
+		void serve(int fd);
+		void reap();
+		void work();
+		void render(Job& job);
+		std::shared_ptr<RenderSource> source(const std::string& path, std::string& error);
+
+		Options mOptions;
+		SurfacePool mPool;
+		ExecutionContext mContext;
+		MapCache mMaps;
+		int mListener;
+		bool mStopping;
+		size_t mNextJob;
+		std::thread mAccept;
+		std::vector<std::thread> mWorkers;
+		std::list<std::thread> mConnections;
+		std::vector<std::thread::id> mFinished; //connections that ended and can be joined
+		std::set<int> mOpen; //connected sockets, shut down on stop
+
+		std::mutex mLock; //guards everything below and the members above that change
+		std::condition_variable mQueued;
+		std::condition_variable mDone;
+		std::priority_queue<JobRef, std::vector<JobRef>, JobOrder> mQueue;
+		SourceList mSources; //most recently used first
+		RenderServerStats mStats;
+	};
+}
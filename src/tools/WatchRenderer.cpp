@@ -0,0 +1,145 @@
+#include "WatchRenderer.h"
+#include "BatchPipeline.h"
+#include "ImageFiles.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <sys/stat.h>
+
+using namespace cinder;
+using namespace pp;
+
+double _milliseconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+WatchRenderer::WatchRenderer(const WatchOptions& options)
+:	mOptions(options), mContext(options.threads)
+{
+	mContext.setPool(&mPool);
+	mOptions.settleMilliseconds = std::max(mOptions.settleMilliseconds, 0);
+}
+
+bool WatchRenderer::open(std::string& error)
+{
+	char source[PATH_MAX];
+	char output[PATH_MAX];
+	if(!realpath(mOptions.sourceDir.c_str(), source) || !realpath(mOptions.outputDir.c_str(), output))
+	{
+		error = "can't find " + mOptions.sourceDir + " or " + mOptions.outputDir;
+		return false;
+	}
+	if(std::string(source) == output)
+	{
+		error = "results can't go into the directory that is watched";
+		return false;
+	}
+	if(!mWatcher.open(mOptions.sourceDir, error))
+		return false;
+
+	//settled already, so the first poll renders them
+	std::vector<std::string> files = listImages(mOptions.sourceDir);
+	Clock::time_point settled = Clock::now() - std::chrono::milliseconds(mOptions.settleMilliseconds);
+	for(size_t i = 0; i < files.size(); i++)
+	{
+		Edit& edit = mEdits[files[i]];
+		edit.first = edit.last = settled;
+	}
+	return true;
+}
+
+void WatchRenderer::poll(int milliseconds, std::vector<WatchResult>& results)
+{
+	//don't sleep past the moment the next edit settles
+	Clock::time_point now = Clock::now();
+	std::chrono::milliseconds settle(mOptions.settleMilliseconds);
+	for(std::map<std::string, Edit>::iterator it = mEdits.begin(); it != mEdits.end(); ++it)
+		milliseconds = std::min(milliseconds, std::max(0, (int)std::ceil(_milliseconds(now, it->second.last + settle))));
+
+	std::vector<std::string> changed;
+	mWatcher.wait(milliseconds, changed);
+	now = Clock::now();
+	for(size_t i = 0; i < changed.size(); i++)
+	{
+		if(!isImagePath(changed[i]))
+			continue;
+		std::map<std::string, Edit>::iterator found = mEdits.find(changed[i]);
+		Edit& edit = found != mEdits.end() ? found->second : mEdits[changed[i]];
+		if(found == mEdits.end())
+			edit.first = now;
+		edit.last = now;
+		edit.events++;
+	}
+
+	for(std::map<std::string, Edit>::iterator it = mEdits.begin(); it != mEdits.end(); )
+		if(now - it->second.last >= settle)
+		{
+			results.push_back(process(it->first, it->second));
+			mEdits.erase(it++);
+		}
+		else
+			++it;
+}
+
+WatchResult WatchRenderer::process(const std::string& path, const Edit& edit)
+{
+	WatchResult result;
+	result.source = path;
+	result.output = outputPath(path, mOptions.outputDir, mOptions.format);
+	result.events = edit.events;
+
+	//paletted files bring their palette along
+	Clock::time_point start = Clock::now();
+	Surface image;
+	IndexedImage indexed;
+	Palette palette;
+	bool paletted = loadIndexedFile(path, indexed, result.error);
+	if(paletted)
+	{
+		getColors(indexed, palette);
+		expand(indexed, image);
+	}
+	else if(!result.error.empty() || !loadImageFile(path, image, result.error))
+	{
+		//gone or still being written, the next write brings it back
+		mSources.erase(path);
+		return result;
+	}
+	Clock::time_point decoded = Clock::now();
+	result.decodeMilliseconds = _milliseconds(start, decoded);
+
+	const int size = RenderSource::UPDATE_BLOCK;
+	result.blocks = (size_t)((image.getWidth() + size - 1) / size) * ((image.getHeight() + size - 1) / size);
+	std::shared_ptr<RenderSource>& source = mSources[path];
+	struct stat info;
+	if(!source)
+	{
+		source.reset(paletted ? new RenderSource(image, palette) : new RenderSource(image));
+		result.changedBlocks = result.blocks;
+	}
+	else
+		result.changedBlocks = source->update(image, paletted ? &palette : NULL, &mContext);
+	if(result.changedBlocks == 0 && stat(result.output.c_str(), &info) == 0)
+	{
+		result.latencyMilliseconds = _milliseconds(edit.first, Clock::now());
+		return result;
+	}
+
+	RenderSettings settings = mOptions.settings;
+	if(mOptions.rotation != 0)
+	{
+		int factor = scaleFactor(settings.scale);
+		rotatedQuad((float)factor * image.getWidth(), (float)factor * image.getHeight(), mOptions.rotation, settings.quad);
+	}
+	Surface rendered = render(*source, settings, &mMaps, &mContext);
+	Clock::time_point renderEnd = Clock::now();
+	result.renderMilliseconds = _milliseconds(decoded, renderEnd);
+
+	saveImageFile(result.output, rendered, result.error, mOptions.level, &mContext);
+	Clock::time_point end = Clock::now();
+	result.encodeMilliseconds = _milliseconds(renderEnd, end);
+	result.latencyMilliseconds = _milliseconds(edit.first, end);
+	return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "FolderWatcher.h"
+#include "PngFiles.h"
+#include "pixelpunch/Render.h"
+#include "pixelpunch/SurfacePool.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pp
+{
+	struct WatchOptions
+	{
+		WatchOptions() : rotation(0), level(DEFAULT_PNG_LEVEL), threads(0), settleMilliseconds(100) {}
+		std::string sourceDir;
+		std::string outputDir; //not the source directory, results would be taken for edits
+		std::string format; //extension of the results with the dot, empty = same as the source
+		RenderSettings settings;
+		float rotation; //degrees, used instead of settings.quad if not 0
+		int level; //PNG compression
+		int threads; //of the context, 0 = all cores
+		int settleMilliseconds; //writes to a file closer together than this are one edit
+	};
+
+	struct WatchResult
+	{
+		WatchResult() : blocks(0), changedBlocks(0), events(0), decodeMilliseconds(0), renderMilliseconds(0), encodeMilliseconds(0), latencyMilliseconds(0) {}
+		std::string source;
+		std::string output;
+		std::string error; //empty if the result is up to date
+		size_t blocks; //of RenderSource::UPDATE_BLOCK pixels in the source
+		size_t changedBlocks; //0 if the pixels didn't change, the result is left alone then
+		size_t events; //file events handled as this edit, 0 for the first render of a file
+		double decodeMilliseconds;
+		double renderMilliseconds;
+		double encodeMilliseconds;
+		double latencyMilliseconds; //from the first write of the edit until the result was written
+	};
+
+	//Keeps the results of a directory up to date while its files are edited. Sources stay
+	//decoded between edits together with their scaled images, tiled copies and palettes, so
+	//a saved file only has the blocks that changed scaled again, and a file saved without
+	//changes isn't rendered at all. Writes in quick succession are taken as one edit. The
+	//workers and buffers of one context stay warm for the whole session.
+	class WatchRenderer
+	{
+	public:
+		WatchRenderer(const WatchOptions& options);
+
+		//starts watching, the files already there are rendered by the first poll
+		bool open(std::string& error);
+		//waits up to milliseconds for edits and renders the ones that settled
+		void poll(int milliseconds, std::vector<WatchResult>& results);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		struct Edit
+		{
+			Edit() : events(0) {}
+			Clock::time_point first;
+			Clock::time_point last;
+			size_t events;
+		};
+
+		WatchResult process(const std::string& path, const Edit& edit);
+
+		WatchOptions mOptions;
+		FolderWatcher mWatcher;
+		ExecutionContext mContext;
+		SurfacePool mPool;
+		MapCache mMaps;
+		std::map<std::string, std::shared_ptr<RenderSource> > mSources;
+		std::map<std::string, Edit> mEdits; //waiting to settle
+	};
+}
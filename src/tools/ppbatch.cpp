@@ -0,0 +1,102 @@
+//Renders all images of a directory into another one with the same settings, as a pipeline
+//of decoders, workers and encoders, then prints throughput and how busy each stage was.
+//
+//  ppbatch sources/ results/ [scale=scale2x transform=projective sampling=bicubic rotate=30
+//          threshold=0.5] [--decoders 2] [--workers 2] [--encoders 2] [--threads 0]
+//          [--queue 8] [--format .png] [--level 6] [--check]
+//
+//A stage that is busy all the time and whose input queue is full is the one to give more
+//threads, time blocked means the stage after it is too slow. The encode line shows how fast
+//results were written for the format and PNG level, --format .qoi is the fastest lossless
+//one for intermediate results. --check reads every result back and fails the files that
+//don't come back as they were written.
+
+#include "BatchPipeline.h"
+#include "RenderProtocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace pp;
+
+void _printStage(const char* name, const StageReport& stage, int threads, double seconds, bool queue)
+{
+	double utilization = seconds > 0 ? 100 * stage.busySeconds / (threads * seconds) : 0;
+	printf("%-8s %7zu %8.2f %5.0f%%", name, stage.files, stage.busySeconds, utilization);
+	if(queue)
+		printf(" %8.1f / %-4zu %9.2f", stage.output.meanDepth, stage.output.maxDepth, stage.output.blockedSeconds);
+	printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: ppbatch sources results [key=value...] [--decoders n] [--workers n] [--encoders n] [--threads n] [--queue n] [--format .ext] [--level 0-9] [--check]\n");
+		return 1;
+	}
+	BatchOptions options;
+	options.outputDir = argv[2];
+	options.settings.transform = TM_IDENTITY;
+	for(int i = 3; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		size_t equals = arg.find('=');
+		if(arg == "--check")
+			options.check = true;
+		else if(arg.compare(0, 2, "--") == 0 && i + 1 < argc)
+		{
+			const char* value = argv[++i];
+			if(arg == "--decoders")
+				options.decoders = atoi(value);
+			else if(arg == "--workers")
+				options.workers = atoi(value);
+			else if(arg == "--encoders")
+				options.encoders = atoi(value);
+			else if(arg == "--threads")
+				options.threads = atoi(value);
+			else if(arg == "--queue")
+				options.queueDepth = atoi(value);
+			else if(arg == "--format")
+				options.format = value;
+			else if(arg == "--level")
+				options.level = atoi(value);
+			else
+			{
+				fprintf(stderr, "unknown option %s\n", arg.c_str());
+				return 1;
+			}
+		}
+		else if(equals != std::string::npos && arg.compare(0, equals, "rotate") == 0)
+			options.rotation = (float)atof(arg.c_str() + equals + 1);
+		else if(equals == std::string::npos || !parseSetting(arg.substr(0, equals), arg.substr(equals + 1), options.settings))
+		{
+			fprintf(stderr, "bad setting %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<std::string> sources = listImages(argv[1]);
+	if(sources.empty())
+	{
+		fprintf(stderr, "no images in %s\n", argv[1]);
+		return 1;
+	}
+	BatchPipeline pipeline(options);
+	BatchReport report = pipeline.run(sources);
+
+	for(size_t i = 0; i < report.errors.size(); i++)
+		fprintf(stderr, "%s\n", report.errors[i].c_str());
+	double seconds = report.seconds > 0 ? report.seconds : 1e-9;
+	printf("%zu files, %zu failed in %.2f s: %.1f files/s, %.1f MPix/s read, %.1f MPix/s written\n", report.files, report.failed, report.seconds,
+		report.files / seconds, report.sourcePixels / seconds / 1e6, report.resultPixels / seconds / 1e6);
+	printf("stage      files   busy s  util  queue mean / max  blocked s\n");
+	_printStage("decode", report.decode, options.decoders, report.seconds, true);
+	_printStage("process", report.process, options.workers, report.seconds, true);
+	_printStage("encode", report.encode, options.encoders, report.seconds, false);
+	//per second an encoder was busy, so it doesn't depend on how many there are
+	double encoding = report.encode.busySeconds > 0 ? report.encode.busySeconds : 1e-9;
+	printf("encoded %.1f MB, %.2f bits/pixel: %.1f MPix/s, %.1f MB/s per encoder\n", report.encodedBytes / 1e6,
+		report.resultPixels ? 8.0 * report.encodedBytes / report.resultPixels : 0.0, report.resultPixels / encoding / 1e6, report.encodedBytes / encoding / 1e6);
+	return report.failed ? 1 : 0;
+}
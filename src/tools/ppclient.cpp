@@ -0,0 +1,85 @@
+//Sends one job to ppserve and saves the result.
+//
+//  ppclient source.png result.png [--socket path] [--shm] [scale=scale2x transform=projective
+//           sampling=bicubic quad=0,0,64,8,60,70,-4,64 threshold=0.5 priority=1]
+//
+//--shm passes the source pixels in shared memory instead of the path.
+
+#include "RenderClient.h"
+#include "ImageFiles.h"
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace cinder;
+using namespace pp;
+
+int main(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: ppclient source result [--socket path] [--shm] [key=value...]\n");
+		return 1;
+	}
+	std::string socketPath = "/tmp/pixelpunch.sock";
+	bool shm = false;
+	//the daemon runs in another directory
+	char source[PATH_MAX];
+	if(!realpath(argv[1], source))
+	{
+		fprintf(stderr, "can't find %s\n", argv[1]);
+		return 1;
+	}
+	std::string line = std::string("render id=1 source=") + source;
+	for(int i = 3; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--socket") && i + 1 < argc)
+			socketPath = argv[++i];
+		else if(!strcmp(argv[i], "--shm"))
+			shm = true;
+		else
+			line += std::string(" ") + argv[i];
+	}
+
+	RenderRequest request;
+	std::string error;
+	if(!parseRequest(line, request, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	RenderClient client;
+	if(!client.connect(socketPath))
+	{
+		fprintf(stderr, "no daemon on %s\n", socketPath.c_str());
+		return 1;
+	}
+	if(shm)
+	{
+		Surface image;
+		if(!loadImageFile(source, image, error) || !client.sendImage(image, request))
+		{
+			fprintf(stderr, "%s\n", error.empty() ? "can't create shared memory" : error.c_str());
+			return 1;
+		}
+	}
+
+	RenderReply reply;
+	Surface result;
+	if(!client.render(request, reply, result))
+	{
+		fprintf(stderr, "%s\n", reply.error.c_str());
+		return 1;
+	}
+	if(!saveImageFile(argv[2], result, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	printf("%s %dx%d in %.1f ms\n", argv[2], reply.width, reply.height, reply.milliseconds);
+	return 0;
+}
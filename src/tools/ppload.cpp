@@ -0,0 +1,157 @@
+//Load generator for ppserve: a number of connections send jobs with random settings and
+//priorities for the given sources as fast as the daemon answers them, then latencies and
+//throughput are printed.
+//
+//  ppload source.png... [--socket path] [--connections 8] [--requests 500] [--shm]
+
+#include "RenderClient.h"
+#include "ImageFiles.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace cinder;
+using namespace pp;
+
+struct Load
+{
+	std::string socketPath;
+	std::vector<std::string> sources;
+	std::vector<Surface> images;
+	bool shm;
+	std::atomic<int> remaining;
+	std::atomic<int> failed;
+	std::mutex lock;
+	std::vector<double> latencies; //milliseconds from sending to having the result
+	double rendering; //sum of the times the daemon reported
+};
+
+//a rotation around the center of the scaled source
+void _randomJob(std::mt19937& random, const Load& load, int index, RenderRequest& request)
+{
+	static const ScaleMethod scales[] = { SM_NONE, SM_SCALE2x, SM_SCALE3x, SM_EAGLE2x, SM_SCALE2x_HQ, SM_HQ2x };
+	static const SamplingMethod samplings[] = { SAMPLE_NEAREST, SAMPLE_BILINEAR, SAMPLE_BICUBIC, SAMPLE_FIRST_BILINEAR, SAMPLE_BEST_FIT_WIDE, SAMPLE_MINIMIZE_ERROR, SAMPLE_ROTSPRITE };
+	RenderSettings& s = request.settings;
+	s.scale = scales[random() % (sizeof(scales) / sizeof(scales[0]))];
+	s.transform = TM_PROJECTIVE;
+	s.sampling = samplings[random() % (sizeof(samplings) / sizeof(samplings[0]))];
+	int factor = scaleFactor(s.scale);
+	float w = (float)factor * load.images[index].getWidth();
+	float h = (float)factor * load.images[index].getHeight();
+	rotatedQuad(w, h, (float)(random() % 360), s.quad);
+	request.priority = random() % 4;
+	request.source = load.sources[index];
+}
+
+void _connection(Load* load, int seed)
+{
+	RenderClient client;
+	if(!client.connect(load->socketPath))
+	{
+		load->failed += std::max(load->remaining.exchange(0), 0);
+		return;
+	}
+	std::mt19937 random(seed);
+	std::vector<double> latencies;
+	double rendering = 0;
+	while(load->remaining-- > 0)
+	{
+		RenderRequest request;
+		int index = random() % load->sources.size();
+		_randomJob(random, *load, index, request);
+		request.id = (int)latencies.size();
+		if(load->shm)
+			client.sendImage(load->images[index], request);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RenderReply reply;
+		Surface result;
+		if(!client.render(request, reply, result))
+		{
+			load->failed++;
+			continue;
+		}
+		latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		rendering += reply.milliseconds;
+	}
+
+	std::lock_guard<std::mutex> lock(load->lock);
+	load->latencies.insert(load->latencies.end(), latencies.begin(), latencies.end());
+	load->rendering += rendering;
+}
+
+double _percentile(const std::vector<double>& sorted, double p)
+{
+	return sorted.empty() ? 0 : sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)];
+}
+
+int main(int argc, char* argv[])
+{
+	Load load;
+	load.socketPath = "/tmp/pixelpunch.sock";
+	load.shm = false;
+	load.rendering = 0;
+	load.failed = 0;
+	int connections = 8;
+	int requests = 500;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--socket") && i + 1 < argc)
+			load.socketPath = argv[++i];
+		else if(!strcmp(argv[i], "--connections") && i + 1 < argc)
+			connections = std::max(atoi(argv[++i]), 1);
+		else if(!strcmp(argv[i], "--requests") && i + 1 < argc)
+			requests = std::max(atoi(argv[++i]), 1);
+		else if(!strcmp(argv[i], "--shm"))
+			load.shm = true;
+		else
+		{
+			char path[PATH_MAX];
+			Surface image;
+			std::string error;
+			if(!realpath(argv[i], path) || !loadImageFile(path, image, error))
+			{
+				fprintf(stderr, "can't read %s\n", argv[i]);
+				return 1;
+			}
+			load.sources.push_back(path);
+			load.images.push_back(image);
+		}
+	}
+	if(load.sources.empty())
+	{
+		fprintf(stderr, "usage: ppload source... [--socket path] [--connections n] [--requests n] [--shm]\n");
+		return 1;
+	}
+	load.remaining = requests;
+
+	signal(SIGPIPE, SIG_IGN);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for(int i = 0; i < connections; i++)
+		threads.push_back(std::thread(_connection, &load, i + 1));
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<double>& l = load.latencies;
+	std::sort(l.begin(), l.end());
+	printf("%zu jobs in %.2f s, %.1f jobs/s, %d failed\n", l.size(), seconds, l.size() / seconds, (int)load.failed);
+	printf("latency ms: p50 %.1f  p95 %.1f  p99 %.1f  max %.1f\n", _percentile(l, 0.5), _percentile(l, 0.95), _percentile(l, 0.99), l.empty() ? 0 : l.back());
+	printf("rendering ms: mean %.1f\n", l.empty() ? 0 : load.rendering / l.size());
+
+	RenderClient client;
+	std::string stats;
+	if(client.connect(load.socketPath) && client.stats(stats))
+		printf("daemon: %s\n", stats.c_str());
+	return load.failed ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+//Render daemon: keeps decoded sources and coordinate maps warm between jobs sent by
+//ppclient, ppload or a build tool over a Unix domain socket, see RenderProtocol.h.
+//
+//  ppserve [--socket /tmp/pixelpunch.sock] [--jobs 2] [--threads 0] [--cache-mb 512]
+
+#include "RenderServer.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+using namespace pp;
+
+int main(int argc, char* argv[])
+{
+	RenderServer::Options options;
+	options.socketPath = "/tmp/pixelpunch.sock";
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		if(!strcmp(argv[i], "--socket"))
+			options.socketPath = argv[i + 1];
+		else if(!strcmp(argv[i], "--jobs"))
+			options.jobThreads = atoi(argv[i + 1]);
+		else if(!strcmp(argv[i], "--threads"))
+			options.threads = atoi(argv[i + 1]);
+		else if(!strcmp(argv[i], "--cache-mb"))
+			options.cacheBytes = (size_t)atoi(argv[i + 1]) << 20;
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	//signals are taken by sigwait below, the threads started by the server inherit the mask
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	RenderServer server(options);
+	std::string error;
+	if(!server.start(error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	printf("listening on %s\n", options.socketPath.c_str());
+	fflush(stdout);
+
+	int received;
+	sigwait(&signals, &received);
+	server.stop();
+	RenderServerStats stats = server.stats();
+	printf("%zu jobs, %zu failed, sources %zu hits / %zu misses\n", stats.jobs, stats.failed, stats.sourceHits, stats.sourceMisses);
+	return 0;
+}
@@ -0,0 +1,88 @@
+//Watches a directory and keeps the results of its images up to date while they are edited,
+//printing for every edit how much of the image changed and how long it took from the first
+//write of the file until its result was written.
+//
+//  ppwatch sources/ results/ [scale=scale2x transform=projective sampling=bicubic rotate=30
+//          threshold=0.5] [--threads 0] [--format .png] [--level 6] [--settle 100]
+//
+//Writes to a file less than --settle milliseconds apart are one edit, so the latency includes
+//that wait. Stop it with Ctrl-C.
+
+#include "WatchRenderer.h"
+#include "RenderProtocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace pp;
+
+int main(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: ppwatch sources results [key=value...] [--threads n] [--format .ext] [--level 0-9] [--settle ms]\n");
+		return 1;
+	}
+	WatchOptions options;
+	options.sourceDir = argv[1];
+	options.outputDir = argv[2];
+	options.settings.transform = TM_IDENTITY;
+	for(int i = 3; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		size_t equals = arg.find('=');
+		if(arg.compare(0, 2, "--") == 0 && i + 1 < argc)
+		{
+			const char* value = argv[++i];
+			if(arg == "--threads")
+				options.threads = atoi(value);
+			else if(arg == "--format")
+				options.format = value;
+			else if(arg == "--level")
+				options.level = atoi(value);
+			else if(arg == "--settle")
+				options.settleMilliseconds = atoi(value);
+			else
+			{
+				fprintf(stderr, "unknown option %s\n", arg.c_str());
+				return 1;
+			}
+		}
+		else if(equals != std::string::npos && arg.compare(0, equals, "rotate") == 0)
+			options.rotation = (float)atof(arg.c_str() + equals + 1);
+		else if(equals == std::string::npos || !parseSetting(arg.substr(0, equals), arg.substr(equals + 1), options.settings))
+		{
+			fprintf(stderr, "bad setting %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	WatchRenderer watcher(options);
+	std::string error;
+	if(!watcher.open(error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	printf("watching %s, edits settle after %d ms\n", argv[1], options.settleMilliseconds);
+	fflush(stdout);
+	while(true)
+	{
+		std::vector<WatchResult> results;
+		watcher.poll(1000, results);
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			const WatchResult& result = results[i];
+			if(!result.error.empty())
+				printf("%s: %s\n", result.source.c_str(), result.error.c_str());
+			else if(result.changedBlocks == 0)
+				printf("%s: unchanged, %zu events\n", result.source.c_str(), result.events);
+			else
+				printf("%s: %zu/%zu blocks changed, %zu events, decode %.1f ms, render %.1f ms, encode %.1f ms, %.1f ms from first write to %s\n",
+					result.source.c_str(), result.changedBlocks, result.blocks, result.events, result.decodeMilliseconds, result.renderMilliseconds,
+					result.encodeMilliseconds, result.latencyMilliseconds, result.output.c_str());
+		}
+		fflush(stdout);
+	}
+	return 0;
+}